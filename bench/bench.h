@@ -0,0 +1,102 @@
+#pragma once
+
+#include <dynohook/platform.h>
+#include <dynohook/perf_counters.h>
+
+#include <array>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <functional>
+#include <string>
+#include <vector>
+
+#if DYNO_PLATFORM_MSVC
+#include <intrin.h>
+#else
+#include <x86intrin.h>
+#endif
+
+namespace bench {
+	struct Options {
+		size_t iterations{ 100000 }; // calls per timed batch
+		size_t repetitions{ 5 }; // timed batches per thread, the median is reported
+		unsigned maxThreads{ 1 }; // thread counts 1, 2, 4 ... up to this are measured
+		std::vector<std::string> filters; // only run cases whose name contains one of these
+		std::vector<size_t> sizes{ 1000, 10000, 100000 }; // population sizes of the scalability suites
+		bool perf{ false }; // sample hardware counters around every timed batch
+	};
+
+	struct Sample {
+		double ns{ 0 }; // per call
+		double cycles{ 0 }; // per call, reference cycles of the time stamp counter
+		std::array<double, dyno::kPerfEventCount> perf{}; // per call, only with Options::perf
+		uint8_t perfValid{ 0 }; // bit per dyno::PerfEvent, events counted on every thread
+	};
+
+	inline uint64_t readTsc() {
+		return __rdtsc();
+	}
+
+	inline uint64_t nowNs() {
+		return (uint64_t) std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+	}
+
+	// number of operator new calls made by the calling thread so far
+	uint64_t allocations();
+
+	// keeps the compiler from dropping a result that is never used
+	template<typename T>
+	inline void doNotOptimize(const T& value) {
+#if DYNO_PLATFORM_MSVC
+		static volatile const void* sink;
+		sink = &value;
+#else
+		asm volatile("" : : "r,m"(value) : "memory");
+#endif
+	}
+
+	/**
+	 * Collects flat result records and prints them as a single JSON document.
+	 */
+	class Report {
+	public:
+		class Record {
+		public:
+			Record& set(const char* key, const std::string& value);
+			Record& set(const char* key, const char* value);
+			Record& set(const char* key, double value);
+			Record& set(const char* key, uint64_t value);
+
+		private:
+			friend class Report;
+			std::string m_json;
+		};
+
+		Record& add(const char* suite);
+		void print(FILE* out) const;
+
+	private:
+		std::vector<Record> m_records;
+	};
+
+	/**
+	 * @brief Runs batch(iterations) repetitions times on each of the given number of threads,
+	 * all threads start together.
+	 * @return median per call cost over every batch of every thread.
+	 */
+	Sample measure(const Options& options, unsigned threads, const std::function<void(size_t)>& batch);
+
+	// adds the per call hardware counters of the sample to the record, nothing if none were counted
+	void addPerf(Report::Record& record, const Sample& sample);
+
+	// thread counts to measure, powers of two up to maxThreads plus maxThreads itself
+	std::vector<unsigned> threadCounts(const Options& options);
+
+	bool selected(const Options& options, const std::string& name);
+
+	// suites
+	void runDispatch(const Options& options, Report& report);
+	void runInstall(const Options& options, Report& report);
+	void runDisasm(const Options& options, Report& report);
+}
\ No newline at end of file
@@ -0,0 +1,272 @@
+#include "bench.h"
+
+#include <dynohook/detours/x64_detour.h>
+#include <dynohook/os.h>
+
+#include <algorithm>
+#include <cstring>
+#include <fstream>
+
+#if DYNO_PLATFORM_WINDOWS
+#include <dynohook/conventions/x64_windows_call.h>
+#define DEFAULT_CALLCONV dyno::x64WindowsCall
+#else
+#include <dynohook/conventions/x64_systemV_call.h>
+#define DEFAULT_CALLCONV dyno::x64SystemVcall
+#endif
+
+#if DYNO_PLATFORM_LINUX
+#include <elf.h>
+#include <link.h>
+#endif
+
+using namespace dyno;
+
+// Decoding and prologue planning throughput over the functions of the ELF objects loaded into this process.
+// Nothing is patched, the planning stops where hook() would start writing the trampoline.
+
+namespace {
+	// detour which only exposes the analysis steps of hook()
+	class AnalysisDetour final : public Detour {
+	public:
+		explicit AnalysisDetour(uintptr_t fnAddress) : Detour(fnAddress, [] { return new DEFAULT_CALLCONV({}, DataType::Void); }, Mode::x64) {}
+
+		bool hook() override {
+			return false;
+		}
+
+		Mode getArchType() const override {
+			return Mode::x64;
+		}
+
+		insts_t disassemble(size_t size) {
+			return m_disasm.disassemble(m_fnAddress, m_fnAddress, m_fnAddress + size, *this);
+		}
+
+		struct Plan {
+			bool prologue{ false };
+			bool expanded{ false };
+			size_t entries{ 0 };
+			size_t relocations{ 0 };
+			size_t translations{ 0 };
+		};
+
+		Plan plan(const insts_t& insts, uintptr_t minProlSz, intptr_t delta) {
+			Plan result;
+			uintptr_t roundProlSz = minProlSz;
+			auto prologueOpt = calcNearestSz(insts, minProlSz, roundProlSz);
+			if (!prologueOpt)
+				return result;
+
+			auto prologue = *prologueOpt;
+			const size_t before = prologue.size();
+			if (!expandProlSelfJmps(prologue, insts, minProlSz, roundProlSz))
+				return result;
+
+			result.prologue = true;
+			result.expanded = prologue.size() != before;
+
+			insts_t instsNeedingEntry;
+			insts_t instsNeedingReloc;
+			insts_t instsNeedingTranslation;
+			buildRelocationList(prologue, roundProlSz, delta, instsNeedingEntry, instsNeedingReloc, instsNeedingTranslation);
+			result.entries = instsNeedingEntry.size();
+			result.relocations = instsNeedingReloc.size();
+			result.translations = instsNeedingTranslation.size();
+			return result;
+		}
+	};
+
+	// same window hook() decodes
+	constexpr size_t kWindowSize = 100;
+
+	// trampolines of the near schemes end up within a few hundred megabytes of the target
+	constexpr intptr_t kTrampolineDelta = 0x10000000;
+
+	struct Object {
+		std::string path;
+		std::vector<uintptr_t> functions;
+	};
+
+#if DYNO_PLATFORM_LINUX
+	// function symbols of an ELF file, relocated by the load bias of the mapped object
+	std::vector<uintptr_t> readFunctions(const std::string& path, uintptr_t bias, const ElfW(Phdr)* phdrs, size_t phnum) {
+		std::vector<uintptr_t> functions;
+
+		std::ifstream file(path, std::ios::binary);
+		std::vector<char> data((std::istreambuf_iterator<char>(file)), std::istreambuf_iterator<char>());
+		if (data.size() < sizeof(ElfW(Ehdr)))
+			return functions;
+
+		const auto* ehdr = (const ElfW(Ehdr)*) data.data();
+		if (std::memcmp(ehdr->e_ident, ELFMAG, SELFMAG) != 0 || ehdr->e_shoff == 0 ||
+			ehdr->e_shoff + (size_t) ehdr->e_shnum * sizeof(ElfW(Shdr)) > data.size())
+			return functions;
+
+		const auto* shdrs = (const ElfW(Shdr)*) (data.data() + ehdr->e_shoff);
+
+		// prefer the full symbol table, stripped objects only have the dynamic one
+		const ElfW(Shdr)* symtab = nullptr;
+		for (size_t i = 0; i < ehdr->e_shnum; i++) {
+			if (shdrs[i].sh_type == SHT_SYMTAB)
+				symtab = &shdrs[i];
+			else if (shdrs[i].sh_type == SHT_DYNSYM && !symtab)
+				symtab = &shdrs[i];
+		}
+		if (!symtab || symtab->sh_offset + symtab->sh_size > data.size())
+			return functions;
+
+		auto executable = [&](uintptr_t address, size_t size) {
+			for (size_t i = 0; i < phnum; i++) {
+				const auto& phdr = phdrs[i];
+				if (phdr.p_type == PT_LOAD && (phdr.p_flags & PF_X) &&
+					address >= bias + phdr.p_vaddr && address + size <= bias + phdr.p_vaddr + phdr.p_memsz)
+					return true;
+			}
+			return false;
+		};
+
+		const auto* symbols = (const ElfW(Sym)*) (data.data() + symtab->sh_offset);
+		const size_t count = symtab->sh_size / sizeof(ElfW(Sym));
+		for (size_t i = 0; i < count; i++) {
+			const auto& symbol = symbols[i];
+			if (ELF64_ST_TYPE(symbol.st_info) != STT_FUNC || symbol.st_shndx == SHN_UNDEF || symbol.st_size == 0)
+				continue;
+
+			const uintptr_t address = bias + symbol.st_value;
+			if (executable(address, std::min<size_t>(symbol.st_size, kWindowSize)))
+				functions.push_back(address);
+		}
+
+		// aliases share an address, analyse each function once
+		std::sort(functions.begin(), functions.end());
+		functions.erase(std::unique(functions.begin(), functions.end()), functions.end());
+		return functions;
+	}
+
+	std::vector<Object> loadedObjects() {
+		std::vector<Object> objects;
+		dl_iterate_phdr([](struct dl_phdr_info* info, size_t, void* data) {
+			auto& out = *(std::vector<Object>*) data;
+
+			// the main executable has no name, the vdso has no file
+			std::string path = info->dlpi_name && info->dlpi_name[0] ? info->dlpi_name : (out.empty() ? "/proc/self/exe" : "");
+			if (path.empty())
+				return 0;
+
+			Object object{ path, readFunctions(path, info->dlpi_addr, info->dlpi_phdr, info->dlpi_phnum) };
+			if (!object.functions.empty())
+				out.push_back(std::move(object));
+			return 0;
+		}, &objects);
+		return objects;
+	}
+#else
+	std::vector<Object> loadedObjects() {
+		return {};
+	}
+#endif
+
+	struct Totals {
+		size_t functions{ 0 };
+		size_t decoded{ 0 };
+		size_t instructions{ 0 };
+		size_t bytes{ 0 };
+		size_t prologues{ 0 };
+		size_t expanded{ 0 };
+		size_t entries{ 0 };
+		size_t relocations{ 0 };
+		size_t translations{ 0 };
+		uint64_t disasmNs{ 0 };
+		uint64_t planNs{ 0 };
+		uint64_t disasmAllocations{ 0 };
+		uint64_t planAllocations{ 0 };
+	};
+
+	Totals analyse(const Object& object) {
+		Totals totals;
+		totals.functions = object.functions.size();
+
+		for (uintptr_t function : object.functions) {
+			// a fresh detour per function like a real install, its construction isn't part of the measurement
+			AnalysisDetour detour(function);
+
+			uint64_t allocations = bench::allocations();
+			uint64_t start = bench::nowNs();
+			const insts_t insts = detour.disassemble(kWindowSize);
+			totals.disasmNs += bench::nowNs() - start;
+			totals.disasmAllocations += bench::allocations() - allocations;
+
+			if (insts.empty())
+				continue;
+
+			totals.decoded++;
+			totals.instructions += insts.size();
+			for (const auto& inst : insts)
+				totals.bytes += inst.size();
+
+			allocations = bench::allocations();
+			start = bench::nowNs();
+			const auto plan = detour.plan(insts, x64Detour::getMinJmpSize(), kTrampolineDelta);
+			totals.planNs += bench::nowNs() - start;
+			totals.planAllocations += bench::allocations() - allocations;
+
+			if (plan.prologue) {
+				totals.prologues++;
+				totals.expanded += plan.expanded;
+				totals.entries += plan.entries;
+				totals.relocations += plan.relocations;
+				totals.translations += plan.translations;
+			}
+		}
+		return totals;
+	}
+}
+
+namespace bench {
+	void runDisasm(const Options& options, Report& report) {
+		const auto objects = loadedObjects();
+		if (objects.empty()) {
+			report.add("disasm").set("skipped", "no ELF objects with function symbols found");
+			return;
+		}
+
+		for (const auto& object : objects) {
+			if (!selected(options, object.path))
+				continue;
+
+			// the fastest pass is reported, the counts are the same for every pass
+			Totals best = analyse(object);
+			for (size_t i = 1; i < options.repetitions; i++) {
+				Totals totals = analyse(object);
+				if (totals.disasmNs + totals.planNs < best.disasmNs + best.planNs)
+					best = totals;
+			}
+
+			auto perSecond = [](size_t count, uint64_t ns) {
+				return ns ? (double) count * 1e9 / (double) ns : 0.0;
+			};
+			auto perFunction = [&](uint64_t count, size_t functions) {
+				return functions ? (double) count / (double) functions : 0.0;
+			};
+
+			report.add("disasm")
+				.set("object", object.path)
+				.set("functions", (uint64_t) best.functions)
+				.set("decoded", (uint64_t) best.decoded)
+				.set("instructions", (uint64_t) best.instructions)
+				.set("bytes", (uint64_t) best.bytes)
+				.set("disasm_ms", (double) best.disasmNs / 1e6)
+				.set("insts_per_sec", perSecond(best.instructions, best.disasmNs))
+				.set("disasm_allocs_per_function", perFunction(best.disasmAllocations, best.functions))
+				.set("plan_ms", (double) best.planNs / 1e6)
+				.set("plans_per_sec", perSecond(best.decoded, best.planNs))
+				.set("plan_allocs_per_function", perFunction(best.planAllocations, best.decoded))
+				.set("prologues", (uint64_t) best.prologues)
+				.set("self_jmp_expanded", (uint64_t) best.expanded)
+				.set("needing_entry", (uint64_t) best.entries)
+				.set("needing_reloc", (uint64_t) best.relocations)
+				.set("needing_translation", (uint64_t) best.translations);
+		}
+	}
+}
\ No newline at end of file
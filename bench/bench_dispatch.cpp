@@ -0,0 +1,272 @@
+#include "bench.h"
+
+#include <dynohook/manager.h>
+
+#include <cstring>
+
+#if DYNO_PLATFORM_WINDOWS
+#include <dynohook/conventions/x64_windows_call.h>
+#define DEFAULT_CALLCONV dyno::x64WindowsCall
+#else
+#include <dynohook/conventions/x64_systemV_call.h>
+#define DEFAULT_CALLCONV dyno::x64SystemVcall
+#endif
+
+using namespace dyno;
+
+// Per call cost of every callback configuration on top of an unhooked call of the same target.
+
+namespace {
+	// the callbacks run on every call, they have to stay as cheap as possible to only measure the dispatch
+	ReturnAction handled(CallbackType, IHook&) {
+		return ReturnAction::Handled;
+	}
+
+	template<typename R>
+	ReturnAction overrideReturn(CallbackType, IHook& hook) {
+		hook.setReturn<R>(R{});
+		return ReturnAction::Override;
+	}
+
+	template<typename R>
+	ReturnAction supercede(CallbackType, IHook& hook) {
+		hook.setReturn<R>(R{});
+		return ReturnAction::Supercede;
+	}
+
+	enum class Callbacks { None, Pre, Post, PrePost, Override, Supercede };
+
+	const char* callbacksName(Callbacks callbacks) {
+		switch (callbacks) {
+			case Callbacks::None: return "none";
+			case Callbacks::Pre: return "pre";
+			case Callbacks::Post: return "post";
+			case Callbacks::PrePost: return "pre+post";
+			case Callbacks::Override: return "override";
+			case Callbacks::Supercede: return "supercede";
+		}
+		return "";
+	}
+
+	constexpr Callbacks allCallbacks[] = { Callbacks::None, Callbacks::Pre, Callbacks::Post, Callbacks::PrePost, Callbacks::Override, Callbacks::Supercede };
+
+	template<typename R>
+	void addCallbacks(IHook& hook, Callbacks callbacks) {
+		switch (callbacks) {
+			case Callbacks::None:
+				break;
+			case Callbacks::Pre:
+				hook.addCallback(CallbackType::Pre, &handled);
+				break;
+			case Callbacks::Post:
+				hook.addCallback(CallbackType::Post, &handled);
+				break;
+			case Callbacks::PrePost:
+				hook.addCallback(CallbackType::Pre, &handled);
+				hook.addCallback(CallbackType::Post, &handled);
+				break;
+			case Callbacks::Override:
+				hook.addCallback(CallbackType::Pre, &overrideReturn<R>);
+				break;
+			case Callbacks::Supercede:
+				hook.addCallback(CallbackType::Pre, &supercede<R>);
+				break;
+		}
+	}
+
+	template<typename R>
+	void removeCallbacks(IHook& hook) {
+		hook.removeCallback(CallbackType::Pre, &handled);
+		hook.removeCallback(CallbackType::Post, &handled);
+		hook.removeCallback(CallbackType::Pre, &overrideReturn<R>);
+		hook.removeCallback(CallbackType::Pre, &supercede<R>);
+	}
+}
+
+// targets, each one is big enough for every detour scheme and never inlined into the call loops
+DYNO_NOINLINE int benchInt(int a, int b) {
+	volatile int result = a;
+	result = result * 3 + b;
+	return result;
+}
+
+DYNO_NOINLINE double benchFloat(float a, double b) {
+	volatile double result = a;
+	result = result * 3.0 + b;
+	return result;
+}
+
+DYNO_NOINLINE int64_t benchMany(int64_t a, int64_t b, int64_t c, int64_t d, int64_t e, int64_t f, int64_t g, int64_t h, int64_t i, int64_t j) {
+	volatile int64_t result = a;
+	result = result + b + c + d + e + f + g + h + i + j;
+	return result;
+}
+
+// more floating point arguments than vector registers, the tail is passed on the stack
+DYNO_NOINLINE double benchStack(double a, double b, double c, double d, double e, double f, double g, double h, double i, double j) {
+	volatile double result = a;
+	result = result + b + c + d + e + f + g + h + i + j;
+	return result;
+}
+
+class BenchVirtual {
+public:
+	virtual ~BenchVirtual() = default;
+
+	virtual DYNO_NOINLINE int intCall(int a, int b) {
+		volatile int result = a;
+		result = result * 3 + b;
+		return result;
+	}
+
+	virtual DYNO_NOINLINE double floatCall(float a, double b) {
+		volatile double result = a;
+		result = result * 3.0 + b;
+		return result;
+	}
+
+	virtual DYNO_NOINLINE int64_t manyCall(int64_t a, int64_t b, int64_t c, int64_t d, int64_t e, int64_t f, int64_t g, int64_t h, int64_t i, int64_t j) {
+		volatile int64_t result = a;
+		result = result + b + c + d + e + f + g + h + i + j;
+		return result;
+	}
+
+	virtual DYNO_NOINLINE double stackCall(double a, double b, double c, double d, double e, double f, double g, double h, double i, double j) {
+		volatile double result = a;
+		result = result + b + c + d + e + f + g + h + i + j;
+		return result;
+	}
+};
+
+namespace {
+	// vtable index of each method, the destructor takes one slot with msvc and two with the itanium abi
+#if DYNO_PLATFORM_MSVC
+	constexpr int kFirstMethod = 1;
+#else
+	constexpr int kFirstMethod = 2;
+#endif
+
+	struct Signature {
+		const char* name;
+		std::vector<DataType> args;
+		DataType ret;
+		void* function;
+		int vtableIndex;
+		std::function<void(size_t)> direct; // calls the detour target
+		std::function<void(size_t)> virtualCall; // calls the virtual target through the object
+		void (*add)(IHook&, Callbacks);
+		void (*remove)(IHook&);
+	};
+
+	// read through volatile pointers so the calls can neither be inlined nor devirtualized
+	int (* volatile intTarget)(int, int) = &benchInt;
+	double (* volatile floatTarget)(float, double) = &benchFloat;
+	int64_t (* volatile manyTarget)(int64_t, int64_t, int64_t, int64_t, int64_t, int64_t, int64_t, int64_t, int64_t, int64_t) = &benchMany;
+	double (* volatile stackTarget)(double, double, double, double, double, double, double, double, double, double) = &benchStack;
+
+	BenchVirtual benchObject;
+	BenchVirtual* volatile objectTarget = &benchObject;
+
+	std::vector<Signature> signatures() {
+		return {
+			{ "int", { DataType::Int32, DataType::Int32 }, DataType::Int32, (void*) &benchInt, kFirstMethod,
+				[](size_t n) { for (size_t i = 0; i < n; i++) bench::doNotOptimize(intTarget((int) i, 2)); },
+				[](size_t n) { for (size_t i = 0; i < n; i++) bench::doNotOptimize(objectTarget->intCall((int) i, 2)); },
+				&addCallbacks<int>, &removeCallbacks<int> },
+			{ "float", { DataType::Float, DataType::Double }, DataType::Double, (void*) &benchFloat, kFirstMethod + 1,
+				[](size_t n) { for (size_t i = 0; i < n; i++) bench::doNotOptimize(floatTarget((float) i, 2.0)); },
+				[](size_t n) { for (size_t i = 0; i < n; i++) bench::doNotOptimize(objectTarget->floatCall((float) i, 2.0)); },
+				&addCallbacks<double>, &removeCallbacks<double> },
+			{ "int64x10", std::vector<DataType>(10, DataType::Int64), DataType::Int64, (void*) &benchMany, kFirstMethod + 2,
+				[](size_t n) { for (size_t i = 0; i < n; i++) bench::doNotOptimize(manyTarget((int64_t) i, 2, 3, 4, 5, 6, 7, 8, 9, 10)); },
+				[](size_t n) { for (size_t i = 0; i < n; i++) bench::doNotOptimize(objectTarget->manyCall((int64_t) i, 2, 3, 4, 5, 6, 7, 8, 9, 10)); },
+				&addCallbacks<int64_t>, &removeCallbacks<int64_t> },
+			{ "doublex10", std::vector<DataType>(10, DataType::Double), DataType::Double, (void*) &benchStack, kFirstMethod + 3,
+				[](size_t n) { for (size_t i = 0; i < n; i++) bench::doNotOptimize(stackTarget((double) i, 2, 3, 4, 5, 6, 7, 8, 9, 10)); },
+				[](size_t n) { for (size_t i = 0; i < n; i++) bench::doNotOptimize(objectTarget->stackCall((double) i, 2, 3, 4, 5, 6, 7, 8, 9, 10)); },
+				&addCallbacks<double>, &removeCallbacks<double> },
+		};
+	}
+
+	// the bridge saves the registers of a call at one address per hook, concurrent calls into one hook are not supported yet
+	constexpr bool kConcurrentDispatch = false;
+
+	void record(bench::Report& report, const char* kind, const Signature& signature, const char* callbacks, unsigned threads,
+				const bench::Sample& sample, const bench::Sample& baseline) {
+		auto& record = report.add("dispatch")
+			.set("hook", kind)
+			.set("signature", signature.name)
+			.set("callbacks", callbacks)
+			.set("threads", (uint64_t) threads)
+			.set("ns_per_call", sample.ns)
+			.set("cycles_per_call", sample.cycles)
+			.set("overhead_ns", sample.ns - baseline.ns)
+			.set("overhead_cycles", sample.cycles - baseline.cycles);
+		bench::addPerf(record, sample);
+	}
+
+	void runKind(const bench::Options& options, bench::Report& report, const char* kind, const Signature& signature) {
+		const bool isVirtual = !std::strcmp(kind, "vhook");
+		const auto& calls = isVirtual ? signature.virtualCall : signature.direct;
+
+		std::vector<DataType> args = signature.args;
+		if (isVirtual)
+			args.insert(args.begin(), DataType::Pointer); // this
+
+		ConvFunc convention = [args, ret = signature.ret] {
+			std::vector<DataObject> objects(args.begin(), args.end());
+			return new DEFAULT_CALLCONV(objects, ret);
+		};
+
+		for (unsigned threads : bench::threadCounts(options)) {
+			const bench::Sample baseline = bench::measure(options, threads, calls);
+			record(report, kind, signature, "direct", threads, baseline, baseline);
+
+			IHookManager& manager = HookManager::Get();
+			auto hook = isVirtual ? manager.hookVirtual(objectTarget, signature.vtableIndex, convention) : manager.hookDetour(signature.function, convention);
+			if (!hook) {
+				std::fprintf(stderr, "failed to hook %s %s\n", kind, signature.name);
+				return;
+			}
+
+			for (Callbacks callbacks : allCallbacks) {
+				const std::string name = std::string(kind) + "/" + signature.name + "/" + callbacksName(callbacks);
+				if (!bench::selected(options, name))
+					continue;
+
+				if (threads > 1 && !kConcurrentDispatch) {
+					report.add("dispatch")
+						.set("hook", kind)
+						.set("signature", signature.name)
+						.set("callbacks", callbacksName(callbacks))
+						.set("threads", (uint64_t) threads)
+						.set("skipped", "concurrent calls into one hook are not supported");
+					continue;
+				}
+
+				signature.add(*hook, callbacks);
+				const bench::Sample sample = bench::measure(options, threads, calls);
+				signature.remove(*hook);
+
+				record(report, kind, signature, callbacksName(callbacks), threads, sample, baseline);
+			}
+
+			// virtual hooks stay cached with their callbacks until the cache is cleared
+			if (isVirtual) {
+				manager.unhookVirtual(objectTarget, signature.vtableIndex);
+				manager.clearCache();
+			} else {
+				manager.unhookDetour(signature.function);
+			}
+		}
+	}
+}
+
+namespace bench {
+	void runDispatch(const Options& options, Report& report) {
+		for (const auto& signature : signatures()) {
+			runKind(options, report, "detour", signature);
+			runKind(options, report, "vhook", signature);
+		}
+	}
+}
\ No newline at end of file
@@ -0,0 +1,317 @@
+#include "bench.h"
+
+#include <dynohook/manager.h>
+#include <dynohook/detours/x64_detour.h>
+#include <dynohook/prebuilt_stubs.h>
+#include <dynohook/os.h>
+
+#include <cstring>
+#include <map>
+
+#if DYNO_PLATFORM_WINDOWS
+#include <dynohook/conventions/x64_windows_call.h>
+#define DEFAULT_CALLCONV dyno::x64WindowsCall
+#else
+#include <dynohook/conventions/x64_systemV_call.h>
+#define DEFAULT_CALLCONV dyno::x64SystemVcall
+#endif
+
+using namespace dyno;
+
+// Install and uninstall throughput of detours on generated functions with a realistic mix of prologues,
+// together with the heap allocations every install and uninstall makes.
+
+namespace {
+	constexpr size_t kSlotSize = 64;
+
+	enum class Shape { Frame, RipRelative, Loop, Leaf };
+
+	const char* shapeName(Shape shape) {
+		switch (shape) {
+			case Shape::Frame: return "frame";
+			case Shape::RipRelative: return "riprel";
+			case Shape::Loop: return "loop";
+			case Shape::Leaf: return "leaf";
+		}
+		return "";
+	}
+
+	// push rbp; mov rbp, rsp; sub rsp, 0x20; mov [rbp-4], edi; mov eax, [rbp-4]; add eax, 1; leave; ret
+	constexpr uint8_t kFrame[] = { 0x55, 0x48, 0x89, 0xE5, 0x48, 0x83, 0xEC, 0x20, 0x89, 0x7D, 0xFC, 0x8B, 0x45, 0xFC, 0x83, 0xC0, 0x01, 0xC9, 0xC3 };
+
+	// mov rax, [rip+0x31]; add rax, rdi; imul rax, rax, 3; add rax, 7; ret
+	// the displacement points at a qword stored in the last 8 bytes of the slot
+	constexpr uint8_t kRipRelative[] = { 0x48, 0x8B, 0x05, 0x31, 0x00, 0x00, 0x00, 0x48, 0x01, 0xF8, 0x48, 0x6B, 0xC0, 0x03, 0x48, 0x83, 0xC0, 0x07, 0xC3 };
+
+	// xor eax, eax; test edi, edi; jle ret; add eax, edi; dec edi; jnz -10 (back to the test); nop; ret
+	// the test at offset 2 is inside the prologue of every scheme, the 6 bytes the 5 byte jmp schemes overwrite included
+	constexpr uint8_t kLoop[] = { 0x31, 0xC0, 0x85, 0xFF, 0x7E, 0x08, 0x01, 0xF8, 0xFF, 0xCF, 0x75, 0xF6, 0x66, 0x90, 0xC3 };
+
+	// lea eax, [rdi+1]; ret
+	constexpr uint8_t kLeaf[] = { 0x8D, 0x47, 0x01, 0xC3 };
+
+	/**
+	 * Executable memory filled with generated functions, one per 64 byte slot padded with int3
+	 * like a linker would, so the code cave scheme finds the same kind of padding as in a real binary.
+	 */
+	class CodeArena {
+	public:
+		explicit CodeArena(size_t count) : m_size{count * kSlotSize} {
+#if DYNO_PLATFORM_WINDOWS
+			m_memory = (uint8_t*) VirtualAlloc(nullptr, m_size, MEM_COMMIT | MEM_RESERVE, PAGE_EXECUTE_READWRITE);
+#else
+			void* memory = mmap(nullptr, m_size, PROT_READ | PROT_WRITE | PROT_EXEC, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+			m_memory = memory != MAP_FAILED ? (uint8_t*) memory : nullptr;
+#endif
+			if (!m_memory)
+				return;
+
+			std::memset(m_memory, 0xCC, m_size);
+
+			// fixed seed, every run hooks the same mix in the same order
+			uint32_t state = 0x9E3779B9;
+			for (size_t i = 0; i < count; i++) {
+				state ^= state << 13;
+				state ^= state >> 17;
+				state ^= state << 5;
+
+				const uint32_t roll = state % 100;
+				const Shape shape = roll < 40 ? Shape::Frame : roll < 65 ? Shape::RipRelative : roll < 80 ? Shape::Loop : Shape::Leaf;
+				emit(m_memory + i * kSlotSize, shape);
+				m_shapes[shape]++;
+			}
+		}
+
+		~CodeArena() {
+			if (!m_memory)
+				return;
+#if DYNO_PLATFORM_WINDOWS
+			VirtualFree(m_memory, 0, MEM_RELEASE);
+#else
+			munmap(m_memory, m_size);
+#endif
+		}
+
+		DYNO_NONCOPYABLE(CodeArena);
+
+		bool valid() const {
+			return m_memory != nullptr;
+		}
+
+		void* function(size_t index) const {
+			return m_memory + index * kSlotSize;
+		}
+
+		const std::map<Shape, size_t>& shapes() const {
+			return m_shapes;
+		}
+
+	private:
+		static void emit(uint8_t* slot, Shape shape) {
+			switch (shape) {
+				case Shape::Frame:
+					std::memcpy(slot, kFrame, sizeof(kFrame));
+					break;
+				case Shape::RipRelative: {
+					std::memcpy(slot, kRipRelative, sizeof(kRipRelative));
+					const uint64_t value = 42;
+					std::memcpy(slot + kSlotSize - sizeof(value), &value, sizeof(value));
+					break;
+				}
+				case Shape::Loop:
+					std::memcpy(slot, kLoop, sizeof(kLoop));
+					break;
+				case Shape::Leaf:
+					std::memcpy(slot, kLeaf, sizeof(kLeaf));
+					break;
+			}
+		}
+
+		uint8_t* m_memory{ nullptr };
+		size_t m_size;
+		std::map<Shape, size_t> m_shapes;
+	};
+
+	struct Memory {
+		uint64_t virtualBytes{ 0 };
+		uint64_t residentBytes{ 0 };
+	};
+
+	// only implemented on linux, zero elsewhere
+	Memory processMemory() {
+		Memory memory;
+#if DYNO_PLATFORM_LINUX
+		if (FILE* file = std::fopen("/proc/self/statm", "r")) {
+			unsigned long long size = 0, resident = 0;
+			if (std::fscanf(file, "%llu %llu", &size, &resident) == 2) {
+				const auto pageSize = (uint64_t) sysconf(_SC_PAGESIZE);
+				memory.virtualBytes = size * pageSize;
+				memory.residentBytes = resident * pageSize;
+			}
+			std::fclose(file);
+		}
+#endif
+		return memory;
+	}
+
+	struct Result {
+		size_t hooked{ 0 };
+		size_t failed{ 0 };
+		uint64_t hookNs{ 0 };
+		uint64_t unhookNs{ 0 };
+		uint64_t hookAllocations{ 0 }; // operator new calls of the installing thread, bookkeeping of the suite excluded
+		uint64_t unhookAllocations{ 0 };
+		Memory before;
+		Memory after;
+		std::map<std::string, size_t> chosen;
+	};
+
+	ConvFunc convention = [] { return new DEFAULT_CALLCONV({ DataType::Int32 }, DataType::Int32); };
+
+	// goes through the hook manager, which is what applications use
+	Result installWithManager(const CodeArena& arena, size_t count) {
+		Result result;
+		IHookManager& manager = HookManager::Get();
+		const size_t reportsBefore = manager.getInstallReports().size();
+
+		result.before = processMemory();
+		uint64_t start = bench::nowNs();
+		for (size_t i = 0; i < count; i++) {
+			const uint64_t allocations = bench::allocations();
+			const bool hooked = manager.hookDetour(arena.function(i), convention) != nullptr;
+			result.hookAllocations += bench::allocations() - allocations;
+			if (hooked)
+				result.hooked++;
+			else
+				result.failed++;
+		}
+		result.hookNs = bench::nowNs() - start;
+		result.after = processMemory();
+
+		const auto reports = manager.getInstallReports();
+		for (size_t i = reportsBefore; i < reports.size(); i++) {
+			if (reports[i].success)
+				result.chosen[reports[i].scheme]++;
+		}
+
+		start = bench::nowNs();
+		const uint64_t allocations = bench::allocations();
+		for (size_t i = 0; i < count; i++)
+			manager.unhookDetour(arena.function(i));
+		result.unhookAllocations = bench::allocations() - allocations;
+		result.unhookNs = bench::nowNs() - start;
+		return result;
+	}
+
+	// a single scheme, without the manager bookkeeping
+	Result installWithScheme(const CodeArena& arena, size_t count, x64Detour::detour_scheme_t scheme) {
+		Result result;
+		std::vector<std::unique_ptr<x64Detour>> detours;
+		detours.reserve(count);
+
+		result.before = processMemory();
+		uint64_t start = bench::nowNs();
+		for (size_t i = 0; i < count; i++) {
+			const uint64_t allocations = bench::allocations();
+			auto detour = std::make_unique<x64Detour>((uintptr_t) arena.function(i), convention);
+			detour->setDetourScheme(scheme);
+			const bool hooked = detour->hook();
+			result.hookAllocations += bench::allocations() - allocations;
+			if (hooked) {
+				result.chosen[detour->getInstallReport().scheme]++;
+				detours.push_back(std::move(detour));
+				result.hooked++;
+			} else {
+				result.failed++;
+			}
+		}
+		result.hookNs = bench::nowNs() - start;
+		result.after = processMemory();
+
+		start = bench::nowNs();
+		const uint64_t allocations = bench::allocations();
+		for (auto& detour : detours) {
+			detour->unhook();
+			detour.reset();
+		}
+		result.unhookAllocations = bench::allocations() - allocations;
+		result.unhookNs = bench::nowNs() - start;
+		return result;
+	}
+
+	void record(bench::Report& report, const char* path, const char* scheme, size_t count, const CodeArena& arena, const Result& result) {
+		auto perSecond = [](size_t operations, uint64_t ns) {
+			return ns ? (double) operations * 1e9 / (double) ns : 0.0;
+		};
+		auto perHook = [&](uint64_t before, uint64_t after) {
+			return result.hooked && after > before ? (double) (after - before) / (double) result.hooked : 0.0;
+		};
+		auto perOperation = [](uint64_t total, size_t operations) {
+			return operations ? (double) total / (double) operations : 0.0;
+		};
+
+		auto& record = report.add("install")
+			.set("path", path)
+			.set("scheme", scheme)
+			.set("functions", (uint64_t) count)
+			.set("hooked", (uint64_t) result.hooked)
+			.set("failed", (uint64_t) result.failed)
+			.set("hook_ms", (double) result.hookNs / 1e6)
+			.set("hooks_per_sec", perSecond(result.hooked + result.failed, result.hookNs))
+			.set("unhook_ms", (double) result.unhookNs / 1e6)
+			.set("unhooks_per_sec", perSecond(result.hooked, result.unhookNs))
+			.set("rss_bytes_per_hook", perHook(result.before.residentBytes, result.after.residentBytes))
+			.set("vsz_bytes_per_hook", perHook(result.before.virtualBytes, result.after.virtualBytes))
+			.set("allocs_per_hook", perOperation(result.hookAllocations, result.hooked + result.failed))
+			.set("allocs_per_unhook", perOperation(result.unhookAllocations, result.hooked));
+
+		for (const auto& [shape, shapeCount] : arena.shapes())
+			record.set((std::string("shape_") + shapeName(shape)).c_str(), (uint64_t) shapeCount);
+		for (const auto& [name, chosenCount] : result.chosen)
+			record.set((std::string("chosen_") + name).c_str(), (uint64_t) chosenCount);
+	}
+}
+
+namespace bench {
+	void runInstall(const Options& options, Report& report) {
+		constexpr x64Detour::detour_scheme_t schemes[] = { x64Detour::VALLOC2, x64Detour::INPLACE, x64Detour::CODE_CAVE, x64Detour::INPLACE_SHORT };
+
+		for (size_t count : options.sizes) {
+			if (selected(options, "manager/" + std::to_string(count))) {
+				CodeArena arena(count);
+				if (!arena.valid()) {
+					std::fprintf(stderr, "failed to allocate %zu functions\n", count);
+					return;
+				}
+				record(report, "manager", x64Detour::printDetourScheme(x64Detour::RECOMMENDED), count, arena, installWithManager(arena, count));
+			}
+
+			// the same with bridges put together from the prebuilt stubs instead of the assembler
+			if (selected(options, "prebuilt/" + std::to_string(count))) {
+				CodeArena arena(count);
+				if (!arena.valid()) {
+					std::fprintf(stderr, "failed to allocate %zu functions\n", count);
+					return;
+				}
+				PrebuiltStubs::enable(true);
+				const Result result = installWithManager(arena, count);
+				PrebuiltStubs::enable(false);
+				record(report, "prebuilt", x64Detour::printDetourScheme(x64Detour::RECOMMENDED), count, arena, result);
+			}
+
+			for (auto scheme : schemes) {
+				const char* name = x64Detour::printDetourScheme(scheme);
+				if (!selected(options, std::string(name) + "/" + std::to_string(count)))
+					continue;
+
+				// fresh functions for every run, code caves used by the previous one would be gone otherwise
+				CodeArena arena(count);
+				if (!arena.valid()) {
+					std::fprintf(stderr, "failed to allocate %zu functions\n", count);
+					return;
+				}
+				record(report, "x64Detour", name, count, arena, installWithScheme(arena, count, scheme));
+			}
+		}
+	}
+}
\ No newline at end of file
@@ -0,0 +1,287 @@
+// dynohook_bench [suite...] [--threads N] [--iterations N] [--repetitions N] [--filter text]... [--sizes a,b,c] [--perf] [--out file]
+//
+// Runs the selected suites (all of them by default) and prints one JSON document,
+// so results can be diffed between versions.
+
+#include "bench.h"
+
+#include <dynohook/log.h>
+
+#include <algorithm>
+#include <atomic>
+#include <cmath>
+#include <cstdlib>
+#include <cstring>
+#include <new>
+#include <thread>
+
+namespace {
+	thread_local uint64_t t_allocations = 0;
+}
+
+// counts allocations for the suites, every other form of new and delete forwards to these two
+void* operator new(size_t size) {
+	t_allocations++;
+	if (void* memory = std::malloc(size ? size : 1))
+		return memory;
+	throw std::bad_alloc();
+}
+
+void operator delete(void* memory) noexcept {
+	std::free(memory);
+}
+
+void operator delete(void* memory, size_t) noexcept {
+	std::free(memory);
+}
+
+namespace {
+	struct Suite {
+		const char* name;
+		void (*run)(const bench::Options&, bench::Report&);
+	};
+
+	const Suite suites[] = {
+		{ "dispatch", bench::runDispatch },
+		{ "install", bench::runInstall },
+		{ "disasm", bench::runDisasm },
+	};
+
+	std::string escape(const std::string& value) {
+		std::string out;
+		out.reserve(value.size());
+		for (char c : value) {
+			if (c == '"' || c == '\\')
+				out += '\\';
+			if ((unsigned char) c < 0x20)
+				continue;
+			out += c;
+		}
+		return out;
+	}
+
+	void usage(const char* self) {
+		std::fprintf(stderr, "usage: %s [suite...] [--threads N] [--iterations N] [--repetitions N] [--filter text]... [--sizes a,b,c] [--perf] [--out file]\nsuites:", self);
+		for (const auto& suite : suites)
+			std::fprintf(stderr, " %s", suite.name);
+		std::fprintf(stderr, "\n");
+	}
+}
+
+namespace bench {
+	uint64_t allocations() {
+		return t_allocations;
+	}
+
+	Report::Record& Report::Record::set(const char* key, const std::string& value) {
+		return set(key, value.c_str());
+	}
+
+	Report::Record& Report::Record::set(const char* key, const char* value) {
+		m_json += ",\"" + escape(key) + "\":\"" + escape(value) + "\"";
+		return *this;
+	}
+
+	Report::Record& Report::Record::set(const char* key, double value) {
+		char buffer[64];
+		if (std::isfinite(value))
+			std::snprintf(buffer, sizeof(buffer), "%.3f", value);
+		else
+			std::snprintf(buffer, sizeof(buffer), "null");
+		m_json += ",\"" + escape(key) + "\":" + buffer;
+		return *this;
+	}
+
+	Report::Record& Report::Record::set(const char* key, uint64_t value) {
+		m_json += ",\"" + escape(key) + "\":" + std::to_string(value);
+		return *this;
+	}
+
+	Report::Record& Report::add(const char* suite) {
+		Record& record = m_records.emplace_back();
+		record.m_json = "\"suite\":\"" + escape(suite) + "\"";
+		return record;
+	}
+
+	void Report::print(FILE* out) const {
+		std::fprintf(out, "{\n  \"version\": \"%s\",\n  \"arch\": %d,\n  \"results\": [\n", DYNO_BENCH_VERSION, DYNO_ARCH_X86);
+		for (size_t i = 0; i < m_records.size(); i++)
+			std::fprintf(out, "    {%s}%s\n", m_records[i].m_json.c_str(), i + 1 < m_records.size() ? "," : "");
+		std::fprintf(out, "  ]\n}\n");
+	}
+
+	Sample measure(const Options& options, unsigned threads, const std::function<void(size_t)>& batch) {
+		std::vector<Sample> samples(threads * options.repetitions);
+		std::atomic<unsigned> ready{ 0 };
+
+		std::vector<uint8_t> perfValid(threads, 0);
+
+		auto worker = [&](unsigned index) {
+			// counters are per thread, every worker opens its own
+			dyno::PerfCounters counters;
+			if (options.perf)
+				counters.open();
+			perfValid[index] = 0xFF;
+
+			// warm up caches and branch predictors before timing anything
+			batch(std::max<size_t>(options.iterations / 10, 1));
+
+			ready.fetch_add(1);
+			while (ready.load() < threads)
+				std::this_thread::yield();
+
+			for (size_t i = 0; i < options.repetitions; i++) {
+				const dyno::PerfSample startPerf = counters.read();
+				const uint64_t startNs = nowNs();
+				const uint64_t startTsc = readTsc();
+				batch(options.iterations);
+				const uint64_t endTsc = readTsc();
+				const uint64_t endNs = nowNs();
+				const dyno::PerfSample endPerf = counters.read();
+
+				Sample& sample = samples[index * options.repetitions + i];
+				sample.ns = (double) (endNs - startNs) / (double) options.iterations;
+				sample.cycles = (double) (endTsc - startTsc) / (double) options.iterations;
+
+				const uint8_t valid = startPerf.valid & endPerf.valid;
+				for (size_t j = 0; j < dyno::kPerfEventCount; j++) {
+					if (valid & (1u << j))
+						sample.perf[j] = (double) (endPerf.values[j] - startPerf.values[j]) / (double) options.iterations;
+				}
+				perfValid[index] &= valid;
+			}
+		};
+
+		std::vector<std::thread> pool;
+		for (unsigned i = 1; i < threads; i++)
+			pool.emplace_back(worker, i);
+		worker(0);
+		for (auto& thread : pool)
+			thread.join();
+
+		auto median = [&](auto&& field) {
+			std::vector<double> values;
+			values.reserve(samples.size());
+			for (const auto& sample : samples)
+				values.push_back(field(sample));
+			std::nth_element(values.begin(), values.begin() + (ptrdiff_t) values.size() / 2, values.end());
+			return values[values.size() / 2];
+		};
+
+		Sample result;
+		result.ns = median([](const Sample& sample) { return sample.ns; });
+		result.cycles = median([](const Sample& sample) { return sample.cycles; });
+
+		result.perfValid = 0xFF;
+		for (uint8_t valid : perfValid)
+			result.perfValid &= valid;
+		result.perfValid &= (uint8_t) ((1u << dyno::kPerfEventCount) - 1);
+
+		for (size_t j = 0; j < dyno::kPerfEventCount; j++) {
+			if (result.perfValid & (1u << j))
+				result.perf[j] = median([j](const Sample& sample) { return sample.perf[j]; });
+		}
+		return result;
+	}
+
+	void addPerf(Report::Record& record, const Sample& sample) {
+		for (size_t i = 0; i < dyno::kPerfEventCount; i++) {
+			if (sample.perfValid & (1u << i))
+				record.set((std::string(dyno::PerfCounters::name((dyno::PerfEvent) i)) + "_per_call").c_str(), sample.perf[i]);
+		}
+	}
+
+	std::vector<unsigned> threadCounts(const Options& options) {
+		std::vector<unsigned> counts;
+		for (unsigned threads = 1; threads < options.maxThreads; threads *= 2)
+			counts.push_back(threads);
+		counts.push_back(std::max(options.maxThreads, 1u));
+		return counts;
+	}
+
+	bool selected(const Options& options, const std::string& name) {
+		if (options.filters.empty())
+			return true;
+
+		return std::any_of(options.filters.begin(), options.filters.end(), [&](const std::string& filter) {
+			return name.find(filter) != std::string::npos;
+		});
+	}
+}
+
+int main(int argc, char* argv[]) {
+	bench::Options options;
+	std::vector<const Suite*> selection;
+	const char* outPath = nullptr;
+
+	for (int i = 1; i < argc; i++) {
+		const bool hasValue = i + 1 < argc;
+		if (!std::strcmp(argv[i], "--threads") && hasValue) {
+			options.maxThreads = std::max(1, std::atoi(argv[++i]));
+		} else if (!std::strcmp(argv[i], "--iterations") && hasValue) {
+			options.iterations = std::max<size_t>(1, std::strtoull(argv[++i], nullptr, 10));
+		} else if (!std::strcmp(argv[i], "--repetitions") && hasValue) {
+			options.repetitions = std::max<size_t>(1, std::strtoull(argv[++i], nullptr, 10));
+		} else if (!std::strcmp(argv[i], "--filter") && hasValue) {
+			options.filters.emplace_back(argv[++i]);
+		} else if (!std::strcmp(argv[i], "--sizes") && hasValue) {
+			options.sizes.clear();
+			for (char* size = std::strtok(argv[++i], ","); size; size = std::strtok(nullptr, ","))
+				options.sizes.push_back(std::strtoull(size, nullptr, 10));
+		} else if (!std::strcmp(argv[i], "--perf")) {
+			options.perf = true;
+		} else if (!std::strcmp(argv[i], "--out") && hasValue) {
+			outPath = argv[++i];
+		} else {
+			auto it = std::find_if(std::begin(suites), std::end(suites), [&](const Suite& suite) {
+				return !std::strcmp(suite.name, argv[i]);
+			});
+			if (it == std::end(suites)) {
+				usage(argv[0]);
+				return 1;
+			}
+			selection.push_back(it);
+		}
+	}
+
+	if (selection.empty()) {
+		for (const auto& suite : suites)
+			selection.push_back(&suite);
+	}
+
+	// keep stdout clean for the report
+	auto logger = std::make_shared<dyno::AsyncLogger>(1024, stderr);
+	logger->setLogLevel(dyno::ErrorLevel::WARN);
+	dyno::Log::registerLogger(logger);
+
+	if (options.perf) {
+		dyno::PerfCounters probe;
+		if (!probe.open())
+			std::fprintf(stderr, "no performance counters available, --perf is ignored: %s\n", probe.getError().c_str());
+		else if (!probe.getError().empty())
+			std::fprintf(stderr, "some performance counters are unavailable: %s\n", probe.getError().c_str());
+	}
+
+	bench::Report report;
+	for (const Suite* suite : selection) {
+		std::fprintf(stderr, "running %s\n", suite->name);
+		suite->run(options, report);
+	}
+
+	FILE* out = stdout;
+	if (outPath) {
+		out = std::fopen(outPath, "w");
+		if (!out) {
+			std::fprintf(stderr, "failed to open %s\n", outPath);
+			return 1;
+		}
+	}
+
+	report.print(out);
+
+	if (out != stdout)
+		std::fclose(out);
+
+	logger->flush();
+	return 0;
+}
\ No newline at end of file
@@ -0,0 +1,117 @@
+#pragma once
+
+#include "ihook.h"
+#include "perf_counters.h"
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+
+namespace dyno {
+	/**
+	 * State of one pending call, pushed by the bridge before the pre callbacks and popped by the post stub.
+	 */
+	struct CallFrame {
+		const void* hook;
+		void* stackPtr; // stack pointer the return address was taken from
+		void* retAddr;
+		uint64_t startNs; // 0 when latency tracking was off at the time
+		PerfSample perfStart; // valid is 0 when perf tracking was off at the time
+		uint8_t* savedArgs; // copies taken by the calling convention, owned by the stack
+		uint8_t* savedReturn;
+		size_t bytesMark; // byte area offset at push time, restored on pop
+		ReturnAction action;
+		bool skipped; // left out by a sampled hook, neither the pre nor the post callbacks run
+	};
+
+	class CallStack;
+
+	/**
+	 * Returns the call stack of the running execution context, nullptr to fall back to the one of the thread.
+	 * Runtimes with stackful coroutines which migrate between threads keep a CallStack in every fiber and
+	 * return the one of the running fiber, so a call suspended inside the original function finds its frame
+	 * again when it resumes on another thread.
+	 * Only the frames move with the fiber, the registers of a call are still saved at one address per hook.
+	 * The fiber may be suspended inside the original function, but not while callbacks of the hook run.
+	 */
+	typedef CallStack* (*ContextProvider)();
+
+	/**
+	 * Pending calls of every hook entered by one execution context, in call order.
+	 * Frames and saved argument copies live in fixed size chunks which are kept until the stack is destroyed,
+	 * so the hot path never touches the heap, and which come from the hot arena in fork mode.
+	 */
+	class CallStack {
+	public:
+		CallStack() = default;
+		~CallStack();
+		DYNO_NONCOPYABLE(CallStack);
+
+		/**
+		 * @brief Returns a new frame of the given hook on top, nullptr when the maximum depth is reached.
+		 * Only hook and bytesMark are initialized.
+		 */
+		CallFrame* push(const void* hook);
+
+		/**
+		 * @brief Returns the topmost frame of the given hook which was pushed for the given stack pointer,
+		 * nullptr if it has none. The frame of a returning call is on top unless calls above it never returned.
+		 */
+		CallFrame* find(const void* hook, void* stackPtr);
+
+		/**
+		 * @brief Returns the number of pending frames of the given hook.
+		 */
+		size_t count(const void* hook);
+
+		/**
+		 * @brief Pops the frame of the given hook which was pushed for the given stack pointer, together with
+		 * every frame above it. Those were left behind by calls which never returned through the post stub.
+		 * @return false if there is no such frame.
+		 */
+		bool pop(const void* hook, void* stackPtr, CallFrame& out);
+
+		/**
+		 * @brief Reserves 16 byte aligned scratch memory which is released together with the topmost frame.
+		 * @return nullptr if size exceeds kBytesPerChunk or the byte area is exhausted.
+		 */
+		uint8_t* allocate(size_t size);
+
+		size_t depth() const {
+			return m_depth;
+		}
+
+		bool empty() const {
+			return m_depth == 0;
+		}
+
+		/**
+		 * @brief Returns the stack of the running execution context, see setProvider().
+		 */
+		static CallStack& current();
+
+		/**
+		 * @brief Replaces the default per thread stacks for every hook without a provider of its own.
+		 * The provider is called several times per hooked call and has to be cheap and lock free.
+		 */
+		static void setProvider(ContextProvider provider);
+
+		static constexpr size_t kFramesPerChunk = 256;
+		static constexpr size_t kMaxChunks = 64;
+		static constexpr size_t kBytesPerChunk = 16 * 1024;
+		static constexpr size_t kMaxByteChunks = 64;
+
+	private:
+		CallFrame& at(size_t index) {
+			return m_chunks[index / kFramesPerChunk][index % kFramesPerChunk];
+		}
+
+		CallFrame* m_chunks[kMaxChunks]{};
+		size_t m_depth{ 0 };
+
+		uint8_t* m_byteChunks[kMaxByteChunks]{};
+		size_t m_bytesTop{ 0 };
+
+		static std::atomic<ContextProvider> s_provider;
+	};
+}
\ No newline at end of file
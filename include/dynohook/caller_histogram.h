@@ -0,0 +1,43 @@
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <utility>
+#include <vector>
+
+namespace dyno {
+	/**
+	 * Fixed size open addressing table of return address to call count, filled by the bridge of one hook.
+	 * Recording is lock free and never allocates. Call sites which find no free slot within kMaxProbes
+	 * are only counted in getDropped(). Valid when zero filled, see HookStats.
+	 */
+	class CallerHistogram {
+	public:
+		/**
+		 * @brief Counts one call returning to retAddr.
+		 */
+		void record(uintptr_t retAddr);
+
+		/**
+		 * @brief Returns the recorded call sites with their counts, in table order.
+		 */
+		std::vector<std::pair<uintptr_t, uint64_t>> getCallers() const;
+
+		uint64_t getDropped() const {
+			return m_dropped.load(std::memory_order_relaxed);
+		}
+
+		static constexpr size_t kSlots = 256; // power of two
+		static constexpr size_t kMaxProbes = 16;
+
+	private:
+		struct Slot {
+			std::atomic<uintptr_t> address{ 0 };
+			std::atomic<uint64_t> count{ 0 };
+		};
+
+		Slot m_slots[kSlots];
+		std::atomic<uint64_t> m_dropped{ 0 };
+	};
+}
\ No newline at end of file
@@ -83,6 +83,22 @@ namespace dyno {
 		 */
 		virtual void onArgumentPtrChanged(size_t index, const Registers& registers, void* argumentPtr) = 0;
 
+		/**
+		 * @brief Writes the addresses of the first count arguments to ptrs at once.
+		 * The default asks getArgumentPtr() for each of them, conventions override it to walk the stack only once.
+		 * @param registers A snapshot of all saved registers.
+		 * @param ptrs At least count entries.
+		 * @return The number of addresses written, at most the number of arguments.
+		 */
+		virtual size_t getArgumentPtrs(const Registers& registers, void** ptrs, size_t count);
+
+		/**
+		 * @brief Calls onArgumentPtrChanged() for the first count arguments.
+		 * @param registers A snapshot of all saved registers.
+		 * @param ptrs The addresses returned by getArgumentPtrs().
+		 */
+		virtual void onArgumentPtrsChanged(const Registers& registers, void* const* ptrs, size_t count);
+
 		/**
 		 * @brief Returns a pointer to the return value.
 		 * @param registers A snapshot of all saved registers.
@@ -100,14 +116,16 @@ namespace dyno {
 		/**
 		 * @brief Save the return value in a seperate buffer, so we can restore it after calling the original function.
 		 * @param registers A snapshot of all saved registers.
+		 * @param buffer At least getReturn().size bytes, owned by the call stack of the pending call.
 		 */
-		virtual void saveReturnValue(const Registers& registers);
+		virtual void saveReturnValue(const Registers& registers, uint8_t* buffer);
 
 		/**
 		 * @brief
 		 * @param registers A snapshot of all saved registers.
+		 * @param buffer The buffer previously passed to saveReturnValue().
 		 */
-		virtual void restoreReturnValue(const Registers& registers);
+		virtual void restoreReturnValue(const Registers& registers, uint8_t* buffer);
 
 		/**
 		 * @brief Save the value of arguments in a seperate buffer for the post callback.
@@ -115,14 +133,23 @@ namespace dyno {
 		 * and overwritten during function execution if the value isn't needed anymore
 		 * at some point. This leads to different values in the post hook.
 		 * @param registers A snapshot of all saved registers.
+		 * @param buffer At least getArgStackSize() + getArgRegisterSize() bytes, owned by the call stack of the pending call.
 		 */
-		virtual void saveCallArguments(const Registers& registers);
+		virtual void saveCallArguments(const Registers& registers, uint8_t* buffer);
 
 		/**
 		 * @brief Restore the value of arguments from a seperate buffer for the call.
 		 * @param registers A snapshot of all saved registers.
+		 * @param buffer The buffer previously passed to saveCallArguments().
 		 */
-		virtual void restoreCallArguments(const Registers& registers);
+		virtual void restoreCallArguments(const Registers& registers, const uint8_t* buffer);
+
+		/**
+		 * @brief Like restoreCallArguments(), followed by one onArgumentPtrsChanged() for all of them.
+		 * @param registers A snapshot of all saved registers.
+		 * @param buffer Laid out like saveCallArguments() writes it.
+		 */
+		virtual void writeCallArguments(const Registers& registers, const uint8_t* buffer);
 
 		/**
 		 * @brief Returns the number of bytes that should be added to the stack to clean up.
@@ -163,17 +190,20 @@ namespace dyno {
 	protected:
 		void init();
 
+		/**
+		 * @brief Walks the arguments once for getArgumentPtrs(), register arguments point into their register and
+		 * the others follow each other from getStackArgumentPtr() on.
+		 * @param homedRegisters the first homedRegisters arguments have a stack slot of the alignment size
+		 * even when they are passed in a register, like in the shadow space of the Microsoft x64 convention.
+		 */
+		size_t walkArgumentPtrs(const Registers& registers, void** ptrs, size_t count, size_t homedRegisters = 0);
+
 	protected:
 		std::vector<DataObject> m_arguments;
 		DataObject m_return;
 		size_t m_alignment;
 		size_t m_stackSize;
 		size_t m_registerSize;
-
-		// Save the return in case we call the original function and want to override the return again.
-		std::vector<std::unique_ptr<uint8_t[]>> m_savedReturnBuffers;
-		// Save call arguments in case the function reuses the space and overwrites the values for the post hook.
-		std::vector<std::unique_ptr<uint8_t[]>> m_savedCallArguments;
 	};
 
 	/**
@@ -34,6 +34,7 @@ namespace dyno {
 		void** getStackArgumentPtr(const Registers &registers) override;
 
 		void* getArgumentPtr(size_t index, const Registers& registers) override;
+		size_t getArgumentPtrs(const Registers& registers, void** ptrs, size_t count) override;
 		void onArgumentPtrChanged(size_t index, const Registers& registers, void* argumentPtr) override;
 
 		void* getReturnPtr(const Registers& registers) override;
@@ -1,5 +1,6 @@
 #pragma once
 
+#include <dynohook/detours/install_report.h>
 #include <dynohook/disassembler.h>
 #include <dynohook/mem_accessor.h>
 #include <dynohook/mem_protector.h>
@@ -39,6 +40,52 @@ namespace dyno {
 			return m_trampoline;
 		}
 
+		uintptr_t getFnAddress() const {
+			return m_fnAddress;
+		}
+
+		/**
+		 * Returns the instructions written by hook() and rehook(), including the nop padding,
+		 * at the addresses they were written to.
+		 */
+		insts_t getPatchInsts() const;
+
+		/**
+		 * Returns the timings and decisions of the last hook() call.
+		 */
+		const InstallReport& getInstallReport() const {
+			return m_installReport;
+		}
+
+		/**
+		 * Makes hook() patch the prologue to jump to the bridge of dispatcher instead of a bridge of its own,
+		 * and that bridge continue in the trampoline, so the function keeps a single bridge and a single set
+		 * of callbacks. unhook() lets the bridge continue in the restored function again. Call before hook().
+		 */
+		void setDispatcher(std::shared_ptr<Hook> dispatcher) {
+			m_dispatcher = std::move(dispatcher);
+		}
+
+		/**
+		 * Returns the hook whose bridge and callbacks serve this detour, nullptr if it's the detour itself.
+		 */
+		const std::shared_ptr<Hook>& getDispatcher() const {
+			return m_dispatcher;
+		}
+
+		/**
+		 * Makes hook() patch every ret site of the function to run the post callbacks in a stub which then
+		 * executes the ret itself, instead of redirecting the return address to the post stub, so call and ret
+		 * keep pairing up in the return predictor. Only small functions which can be analysed completely qualify,
+		 * see patchExitSites(), the others fall back to the redirection. Call before hook().
+		 */
+		void setExitSitePatching(bool state) {
+			m_exitSitePatching = state;
+		}
+
+		static constexpr size_t kMaxExitScan = 256;
+		static constexpr size_t kMaxExitSites = 4;
+
 	protected:
 		uintptr_t m_fnAddress;
 		ZydisDisassembler m_disasm;
@@ -57,6 +104,60 @@ namespace dyno {
 		uint16_t m_nopSize{ 0 };
 		uint32_t m_hookSize{ 0 };
 
+		InstallReport m_installReport;
+
+		// owner of the bridge the prologue jumps to, nullptr for the own one
+		std::shared_ptr<Hook> m_dispatcher;
+
+		struct ExitSite {
+			insts_t originalInsts; // the ret and the instructions moved with it into the stub
+			insts_t patchInsts; // jmp to the stub and nop padding
+			std::vector<uint8_t> prefix; // bytes of the instructions in front of the ret
+			uint16_t retImm{ 0 };
+			uint16_t size{ 0 }; // bytes of originalInsts
+			uintptr_t stub{ 0 };
+		};
+
+		bool m_exitSitePatching{ false };
+		std::vector<ExitSite> m_exitSites;
+
+		/**
+		 * Finds the ret sites of the function, behind prologueEnd, and makes each of them jump to an exit stub of
+		 * the dispatching hook, see Hook::createExitStub(). A site needs room for a rel32 jmp: the padding behind
+		 * the ret, then the instructions in front of it which aren't ip relative or branch targets.
+		 * Gives up on functions larger than kMaxExitScan, with more than kMaxExitSites rets, with indirect jmps or
+		 * jmps leaving the function, and on sites without room, leaving the function untouched.
+		 * @return the number of patched sites, 0 if it gave up.
+		 */
+		size_t patchExitSites(uintptr_t prologueEnd);
+
+		/**
+		 * Writes the original ret sites back and lets the bridge redirect the return address again.
+		 */
+		void restoreExitSites();
+
+		/**
+		 * Returns the jmp written at a ret site, empty on failure. A rel32 jmp straight to the stub by default.
+		 */
+		virtual insts_t makeExitJmp(uintptr_t address, uintptr_t stub);
+
+		void registerCode() override;
+
+		/**
+		 * Creates the bridge, or takes the one of the dispatcher, and points it at the trampoline if there is one already.
+		 */
+		bool attachBridge();
+
+		Hook& getDispatchHook() {
+			return m_dispatcher ? *m_dispatcher : *this;
+		}
+
+		/**
+		 * Trampolines come from the code arena of the fork guard, which falls back to the heap while fork mode is off.
+		 */
+		static uintptr_t allocateTrampoline(uint16_t size);
+		static void freeTrampoline(uintptr_t trampoline);
+
 		/**
 		 * Walks the given vector of instructions and sets roundedSz to the lowest size possible that doesn't split any instructions and is greater than minSz.
 		 * If end of function is encountered before this condition an empty optional is returned. Returns instructions in the range start to adjusted end
@@ -82,6 +183,20 @@ namespace dyno {
 			uintptr_t& roundProlSz
 		);
 
+		/**
+		 * Finds the prologue to overwrite at m_fnAddress, like calcNearestSz() followed by expandProlSelfJmps().
+		 * Given the shapes of a scan of the function, see ZydisDisassembler::scan(), the sizes are planned from them
+		 * and known prologues are copied from the PrologueCache. Otherwise insts is disassembled if it's still empty,
+		 * and the prologue is added to the cache. Sets the failure of the install report when it returns false.
+		 */
+		bool findPrologue(const std::vector<uint8_t>& scanBytes,
+			const std::vector<InstShape>& shapes,
+			insts_t& insts,
+			uintptr_t& minProlSz,
+			uintptr_t& roundProlSz,
+			insts_t& prologue
+		);
+
 		/**
 		 * Insert nops from [Base, Base+size).
 		 * Generates as many nop instructions as necessary to fill the give size.
@@ -0,0 +1,80 @@
+#pragma once
+
+#include <chrono>
+#include <cstdint>
+
+namespace dyno {
+	/**
+	 * Time spent in each phase of Detour::hook() together with the decisions it took,
+	 * so slow or failing installs can be inspected without parsing the log.
+	 */
+	struct InstallReport {
+		uintptr_t fnAddress{ 0 }; // address the detour was created for
+		uintptr_t resolvedAddress{ 0 }; // address actually patched, after following jmps
+
+		uint64_t disassemblyNs{ 0 };
+		uint64_t followJmpNs{ 0 };
+		uint64_t schemeSelectionNs{ 0 };
+		uint64_t bridgeNs{ 0 };
+		uint64_t relocationNs{ 0 };
+		uint64_t translationNs{ 0 };
+		uint64_t patchNs{ 0 };
+		uint64_t totalNs{ 0 };
+
+		const char* scheme{ "" }; // x64 detour scheme name, empty on x86 which always uses a rel32 jmp
+		uint16_t prologueSize{ 0 };
+		uint16_t trampolineSize{ 0 };
+		uint16_t translatedInsts{ 0 };
+		bool prologueCached{ false }; // prologue copied from the PrologueCache instead of disassembled
+		uint8_t exitSites{ 0 }; // ret sites running the post callbacks, 0 if calls return through the post stub
+
+		bool success{ false };
+		const char* failure{ "" }; // phase in which hook() gave up, empty on success
+	};
+
+	/**
+	 * Sum of all install reports collected by the hook manager.
+	 */
+	struct InstallTotals {
+		uint64_t installs{ 0 };
+		uint64_t failures{ 0 };
+		uint64_t prologueCacheHits{ 0 };
+
+		uint64_t disassemblyNs{ 0 };
+		uint64_t followJmpNs{ 0 };
+		uint64_t schemeSelectionNs{ 0 };
+		uint64_t bridgeNs{ 0 };
+		uint64_t relocationNs{ 0 };
+		uint64_t translationNs{ 0 };
+		uint64_t patchNs{ 0 };
+		uint64_t totalNs{ 0 };
+	};
+
+	/**
+	 * Adds the time elapsed between construction and destruction to the given counter.
+	 */
+	class PhaseTimer {
+	public:
+		explicit PhaseTimer(uint64_t& out) : m_out{out}, m_start{std::chrono::steady_clock::now()} {}
+		~PhaseTimer() {
+			stop();
+		}
+
+		// records the elapsed time early, the destructor won't add it a second time
+		void stop() {
+			if (m_stopped)
+				return;
+
+			m_out += (uint64_t) std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - m_start).count();
+			m_stopped = true;
+		}
+
+		PhaseTimer(const PhaseTimer&) = delete;
+		PhaseTimer& operator=(const PhaseTimer&) = delete;
+
+	private:
+		uint64_t& m_out;
+		std::chrono::steady_clock::time_point m_start;
+		bool m_stopped{ false };
+	};
+}
\ No newline at end of file
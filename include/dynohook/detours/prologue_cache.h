@@ -0,0 +1,59 @@
+#pragma once
+
+#include <dynohook/disassembler.h>
+#include <dynohook/instruction.h>
+
+#include <atomic>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+
+namespace dyno {
+	/**
+	 * Decoded prologues shared by every detour, keyed by the prologue bytes with the ip relative
+	 * displacements and branch immediates masked out.
+	 *
+	 * Compilers emit the same few prologues over and over, so once a shape was disassembled, detours of
+	 * functions which start the same way only scan their code and copy the cached instructions, see
+	 * Detour::findPrologue(). The prologue size is still planned per function from the scan, since jmps
+	 * behind the prologue may force a larger one.
+	 */
+	class PrologueCache {
+	public:
+		static PrologueCache& get();
+
+		/**
+		 * @brief Builds the key of the first count shapes of a scan.
+		 */
+		static std::string makeKey(Mode mode, const std::vector<uint8_t>& bytes, const std::vector<InstShape>& shapes, size_t count);
+
+		/**
+		 * @brief Copies the cached instructions of the key, at the addresses of the function they were decoded from.
+		 * @return false if the shape is unknown.
+		 */
+		bool find(const std::string& key, insts_t& prologue);
+
+		/**
+		 * @brief Remembers a decoded prologue, ignored once kMaxEntries shapes are known.
+		 */
+		void add(const std::string& key, const insts_t& prologue);
+
+		void clear();
+
+		uint64_t getHits() const {
+			return m_hits.load(std::memory_order_relaxed);
+		}
+
+		uint64_t getMisses() const {
+			return m_misses.load(std::memory_order_relaxed);
+		}
+
+		static constexpr size_t kMaxEntries = 4096;
+
+	private:
+		std::mutex m_mutex;
+		std::unordered_map<std::string, insts_t> m_entries;
+		std::atomic<uint64_t> m_hits{ 0 };
+		std::atomic<uint64_t> m_misses{ 0 };
+	};
+}
\ No newline at end of file
@@ -0,0 +1,120 @@
+#pragma once
+
+#include <dynohook/helpers.h>
+
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace dyno {
+	class Detour;
+
+	struct WatchdogStats {
+		uint64_t sweeps{ 0 };
+		uint64_t sitesChecked{ 0 };
+		uint64_t mismatches{ 0 };
+		uint64_t repairs{ 0 };
+		uint64_t failedRepairs{ 0 };
+		uint64_t throttled{ 0 };
+		uint64_t lastSweepNs{ 0 };
+	};
+
+	/**
+	 * Periodically verifies that the bytes written by hooked detours are still in place and
+	 * calls rehook() on the ones which were overwritten (e.g. by an anti-cheat, a hot-patcher
+	 * or another hooking library).
+	 * The expected bytes are kept in a compact table of fixed size patch sites so a sweep over
+	 * thousands of detours stays a linear walk with one vector compare per site.
+	 */
+	class Watchdog {
+	public:
+		Watchdog() = default;
+		~Watchdog();
+		DYNO_NONCOPYABLE(Watchdog);
+
+		/**
+		 * @brief Starts the low priority background thread.
+		 * @param interval time to sleep between two sweeps.
+		 * @param maxRepairsPerSweep upper bound of rehook() calls issued by a single sweep.
+		 * @return false if the watchdog is already running.
+		 */
+		bool start(std::chrono::milliseconds interval, uint32_t maxRepairsPerSweep = 16);
+
+		/**
+		 * @brief Stops and joins the background thread. Registered detours are kept.
+		 */
+		void stop();
+
+		bool isRunning() const;
+
+		/**
+		 * @brief Snapshots the patch bytes of a hooked detour into the site table.
+		 * Must be called after hook(), detours which are not hooked are ignored.
+		 */
+		void add(const std::shared_ptr<Detour>& detour);
+
+		/**
+		 * @brief Removes the detour from the site table. Blocks while a sweep is in progress,
+		 * so it is safe to unhook the detour once this returns.
+		 */
+		void remove(const Detour* detour);
+
+		void clear();
+
+		/**
+		 * @brief Runs a single verification sweep on the calling thread.
+		 * @return number of detours which were repaired.
+		 */
+		size_t sweep();
+
+		WatchdogStats getStats() const;
+
+	private:
+		// largest span verified with a single compare, longer patches are split into several sites
+		static constexpr size_t kSiteSize = 32;
+
+		struct alignas(16) SiteBytes {
+			std::array<uint8_t, kSiteSize> data;
+		};
+
+		struct Owner {
+			std::shared_ptr<Detour> detour;
+			uint32_t strikes{ 0 }; // consecutive sweeps which had to repair this detour
+			uint64_t skipUntil{ 0 }; // sweep number until which the detour is left alone
+		};
+
+		void run();
+		void addSites(uint32_t owner, uintptr_t address, const uint8_t* bytes, size_t size);
+
+		static bool matches(uintptr_t address, const SiteBytes& expected, uint8_t size);
+
+		// site table, one entry per patch site (struct of arrays to keep the sweep cache friendly)
+		std::vector<uintptr_t> m_siteAddress;
+		std::vector<uint8_t> m_siteSize;
+		std::vector<uint32_t> m_siteOwner;
+		std::vector<SiteBytes> m_siteBytes;
+		std::vector<Owner> m_owners;
+		mutable std::mutex m_mutex;
+
+		std::thread m_thread;
+		std::condition_variable m_cv;
+		std::mutex m_cvMutex;
+		std::chrono::milliseconds m_interval{ 1000 };
+		uint32_t m_maxRepairs{ 16 };
+		bool m_stop{ false };
+
+		std::atomic<uint64_t> m_sweeps{ 0 };
+		std::atomic<uint64_t> m_sitesChecked{ 0 };
+		std::atomic<uint64_t> m_mismatches{ 0 };
+		std::atomic<uint64_t> m_repairs{ 0 };
+		std::atomic<uint64_t> m_failedRepairs{ 0 };
+		std::atomic<uint64_t> m_throttled{ 0 };
+		std::atomic<uint64_t> m_lastSweepNs{ 0 };
+	};
+}
\ No newline at end of file
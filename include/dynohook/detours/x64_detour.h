@@ -52,5 +52,12 @@ namespace dyno {
 		bool makeInplaceTrampoline(uintptr_t base_address, const std::function<void(asmjit::x86::Assembler&)>& builder);
 
 		bool allocateJumpToBridge();
+
+		// page near the function with absolute jmps to the exit stubs, which are out of rel32 range
+		uintptr_t m_exitThunks{ 0 };
+		uint16_t m_exitThunksSize{ 0 };
+
+		insts_t makeExitJmp(uintptr_t address, uintptr_t stub) override;
+		void freeExitThunks();
 	};
 }
\ No newline at end of file
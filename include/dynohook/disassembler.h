@@ -14,12 +14,59 @@ extern "C" {
 namespace dyno {
 	typedef std::unordered_map<uintptr_t, insts_t> branch_map_t;
 
+	/**
+	 * Layout of one instruction found by ZydisDisassembler::scan(), without operand strings.
+	 */
+	struct InstShape {
+		uint16_t offset; // from the start of the scanned range
+		uint8_t length;
+		uint8_t relOffset; // ip relative displacement or branch immediate, relSize is 0 if there is none
+		uint8_t relSize;
+		bool branching;
+		bool funcEnd; // same as ZydisDisassembler::isFuncEnd()
+		bool pad; // same as ZydisDisassembler::isPadBytes()
+		uintptr_t destination; // of relative branches, 0 otherwise
+	};
+
 	class ZydisDisassembler {
 	public:
 		explicit ZydisDisassembler(Mode mode);
 		virtual ~ZydisDisassembler();
 
-		insts_t disassemble(uintptr_t firstInstruction, uintptr_t start, uintptr_t end, const MemAccessor& accessor);
+		/**
+		 * Decodes [start, end) up to the end of the function. The branches of the range are added to the branch map
+		 * unless trackBranches is false, which is meant for generated code and diagnostics.
+		 */
+		insts_t disassemble(uintptr_t firstInstruction, uintptr_t start, uintptr_t end, const MemAccessor& accessor, bool trackBranches = true);
+
+		/**
+		 * Same as above for code which was already read, e.g. by scan(), start is the address of the first byte.
+		 */
+		insts_t disassemble(uintptr_t start, const std::vector<uint8_t>& buf, const MemAccessor& accessor, bool trackBranches = true);
+
+		/**
+		 * Same as above for size bytes at buf, which only have to stay valid during the call.
+		 */
+		insts_t disassemble(uintptr_t start, const uint8_t* buf, size_t size, const MemAccessor& accessor, bool trackBranches = true);
+
+		/**
+		 * Decodes the same instructions as disassemble() would, but only their layout, which is a lot cheaper.
+		 * Returns false if the shapes aren't enough to tell where the branches go: the first instruction branches,
+		 * or a branch takes its destination from memory. bytes keeps what was read either way, empty if nothing could be.
+		 */
+		bool scan(uintptr_t start, uintptr_t end, const MemAccessor& accessor, std::vector<uint8_t>& bytes, std::vector<InstShape>& shapes);
+
+		/**
+		 * Decodes the whole function at start, past inner rets as long as a branch seen so far goes beyond them,
+		 * followed by the nop and int3 padding behind its last ret or jmp. Returns an empty vector if the end isn't
+		 * found within maxSize bytes, or if code behind padding is reached, which may already be the next function.
+		 */
+		insts_t disassembleFunction(uintptr_t start, size_t maxSize, const MemAccessor& accessor);
+
+		/**
+		 * Formats the operands of an instruction from its bytes, Instruction::getFullName() of decoded instructions uses it.
+		 */
+		static std::string formatOperands(const Instruction& instruction);
 
 		static bool isConditionalJump(const Instruction& instruction);
 
@@ -36,6 +83,10 @@ namespace dyno {
 			return m_branchMap;
 		}
 
+		void clearBranchMap() {
+			m_branchMap.clear();
+		}
+
 		Mode getMode() const {
 			return m_mode;
 		}
@@ -52,7 +103,7 @@ namespace dyno {
 		Mode m_mode;
 
 		/* key = address of instruction pointed at (dest of jump). Value = set of unique instruction branching to dest
-		   Must only hold entries from the last segment disassembled. I.E clear every new call to disassemble
+		   Must only hold entries of the function being hooked, so it's cleared before every window of it is decoded
 		*/
 		branch_map_t m_branchMap;
 	};
@@ -0,0 +1,112 @@
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <mutex>
+#include <new>
+#include <utility>
+
+namespace dyno {
+	/**
+	 * Fork friendly mode for pre-fork servers.
+	 *
+	 * Once enabled, the state every call writes (register snapshots, call frames, counters) is carved
+	 * from dedicated hot pages instead of the heap, and trampolines from dedicated code pages.
+	 * Right before fork() the generated code of every hook is sealed read + execute, and every child
+	 * replaces the hot pages with fresh zero pages which the kernel only backs once they are touched.
+	 * The parent gets its previous protections back right after fork(), sealed code stays sealed
+	 * in the children except while an InstallScope writes into it.
+	 * Children therefore keep sharing the code and the install metadata with the parent, and only pay
+	 * for the hot pages they actually use. Counters restart from zero in every child.
+	 *
+	 * Hooks created before enable() keep their heap storage. Only implemented on linux.
+	 */
+	class ForkGuard {
+	public:
+		/**
+		 * @brief Installs the pthread_atfork handlers, the hooks created from now on use the arenas.
+		 * @return false if fork mode isn't supported on this platform.
+		 */
+		static bool enable();
+
+		static bool isEnabled() {
+			return s_enabled.load(std::memory_order_relaxed);
+		}
+
+		/**
+		 * @brief Allocates hot per-call state, cache line aligned. Falls back to the heap while fork mode is off.
+		 */
+		static void* allocateHot(size_t size);
+		static void freeHot(void* ptr);
+
+		template<class T, class... Args>
+		static T* create(Args&&... args) {
+			static_assert(alignof(T) <= kHotAlignment);
+			return new (allocateHot(sizeof(T))) T(std::forward<Args>(args)...);
+		}
+
+		template<class T>
+		static void destroy(T* ptr) {
+			if (!ptr)
+				return;
+			ptr->~T();
+			freeHot(ptr);
+		}
+
+		/**
+		 * @brief Allocates executable memory for trampolines, which never shares a page with data.
+		 * Falls back to the heap while fork mode is off, like trampolines always did.
+		 * @return nullptr if no page could be mapped.
+		 */
+		static void* allocateCode(size_t size);
+		static void freeCode(void* ptr);
+
+		/**
+		 * @brief Adds a region of generated code which is sealed before every fork().
+		 * Sealed code must be unprotected with a MemProtector before writing to it, like any other code.
+		 */
+		static void addCode(const void* owner, uintptr_t address, size_t size);
+
+		/**
+		 * @brief Drops every region of the owner and makes its pages writable again, so the memory can be released.
+		 */
+		static void removeCode(const void* owner);
+
+		/**
+		 * @brief Drops the region of the owner which starts at address.
+		 */
+		static void removeCode(const void* owner, uintptr_t address);
+
+		/**
+		 * @brief Seals every registered region right away, done automatically before fork().
+		 */
+		static void seal();
+
+		/**
+		 * @brief Restores the protections the code had before it was sealed, done automatically in the parent after fork().
+		 */
+		static void unseal();
+
+		/**
+		 * @brief Keeps fork() from sealing the code while a hook writes into it.
+		 * Code which is already sealed is unsealed for the scope and sealed again at its end.
+		 */
+		class InstallScope {
+		public:
+			InstallScope();
+			~InstallScope();
+			InstallScope(const InstallScope&) = delete;
+			InstallScope& operator=(const InstallScope&) = delete;
+
+		private:
+			bool m_locked;
+			bool m_resealed{ false };
+		};
+
+		static constexpr size_t kHotAlignment = 64;
+
+	private:
+		static std::atomic<bool> s_enabled;
+	};
+}
\ No newline at end of file
@@ -0,0 +1,118 @@
+#pragma once
+
+#include <dynohook/helpers.h>
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace dyno {
+	class Hook;
+
+	struct GovernorBudget {
+		double cpuFraction{ 0.02 }; // of the machine the hooks may use together, 0.02 is 2%
+		unsigned cpus{ 0 }; // cores the fraction refers to, 0 for all of them
+		uint32_t sampleEvery{ 16 }; // callbacks run on one in sampleEvery calls of a sampled hook
+		uint32_t dispatchCycles{ 300 }; // estimated cost of the bridge and the dispatcher per call, in TSC cycles
+		uint32_t holdIntervals{ 10 }; // evaluations a degraded hook stays degraded before it may be restored
+		double restoreBelow{ 0.5 }; // fraction of the budget the projected total has to stay below for a restore
+	};
+
+	struct GovernorStats {
+		uint64_t evaluations{ 0 };
+		uint64_t degradations{ 0 };
+		uint64_t restorations{ 0 };
+		uint64_t lastCostCycles{ 0 }; // estimated cost of every hook during the last interval
+		uint64_t lastBudgetCycles{ 0 };
+	};
+
+	/**
+	 * Keeps the estimated overhead of the registered hooks within a share of the CPU.
+	 * The cost of a hook is its call count times the dispatch overhead plus the average cycles of its handlers,
+	 * which come from handler profiling, turned on for every governed hook which doesn't have it yet.
+	 * When the total exceeds the budget, the hooks above their equal share are degraded one step per evaluation,
+	 * the most expensive first: to DispatchMode::Sampled and then to DispatchMode::PassThrough. Once a hook was held
+	 * for holdIntervals evaluations it's restored one step at a time, as long as the total projected from its last
+	 * known call rate stays below restoreBelow of the budget. Every transition is logged.
+	 * Hooks are held weakly, an entry is released once its hook is destroyed.
+	 */
+	class Governor {
+	public:
+		Governor() = default;
+		~Governor();
+		DYNO_NONCOPYABLE(Governor);
+
+		/**
+		 * @brief Starts the background thread which evaluates the hooks once per interval.
+		 * @return false if the governor is already running.
+		 */
+		bool start(const GovernorBudget& budget, std::chrono::milliseconds interval);
+
+		/**
+		 * @brief Stops the background thread and restores the full dispatch mode of every hook.
+		 */
+		void stop();
+
+		bool isRunning() const;
+
+		/**
+		 * @brief Registers a hook, enables its handler profiling while the governor runs.
+		 * @param address function the hook was created for, only used in the log.
+		 */
+		void add(const std::shared_ptr<Hook>& hook, uintptr_t address);
+
+		/**
+		 * @brief Releases every hook, restoring its full dispatch mode and its handler profiling.
+		 */
+		void clear();
+
+		/**
+		 * @brief Runs a single evaluation on the calling thread, with the budget given to start() or the default one.
+		 * The first evaluation of a hook only takes its counters as the baseline.
+		 */
+		void evaluate();
+
+		GovernorStats getStats() const;
+
+	private:
+		// handler profiling of the hooks which had it off
+		static constexpr uint32_t kProfileEvery = 64;
+
+		struct Source {
+			std::weak_ptr<Hook> hook;
+			const Hook* key; // only compared, never dereferenced
+			uintptr_t address;
+			uint32_t profileEvery; // handler profiling before the governor turned it on
+			uint64_t calls; // hook calls at the previous evaluation
+			bool baseline; // calls holds a value
+			uint32_t hold; // evaluations left before a restore is considered
+			double callRate; // calls per TSC cycle when the hook last reached the dispatcher
+		};
+
+		void run();
+		void acquire(Source& source, Hook& hook);
+		void release(Source& source);
+
+		std::vector<Source> m_sources;
+		GovernorBudget m_budget;
+		uint64_t m_lastTsc{ 0 };
+		mutable std::mutex m_mutex;
+
+		std::thread m_thread;
+		std::condition_variable m_cv;
+		std::mutex m_cvMutex;
+		std::chrono::milliseconds m_interval{ 1000 };
+		bool m_stop{ false };
+
+		std::atomic<uint64_t> m_evaluations{ 0 };
+		std::atomic<uint64_t> m_degradations{ 0 };
+		std::atomic<uint64_t> m_restorations{ 0 };
+		std::atomic<uint64_t> m_lastCost{ 0 };
+		std::atomic<uint64_t> m_lastBudget{ 0 };
+	};
+}
\ No newline at end of file
@@ -3,9 +3,23 @@
 #include "mem_accessor.h"
 #include "ihook.h"
 #include "platform.h"
+#include "stats.h"
+#include "call_stack.h"
+#include "caller_histogram.h"
+#include "inline_handler.h"
+#include "prebuilt_stubs.h"
 #include <asmjit/asmjit.h>
 
 namespace dyno {
+	/**
+	 * How much of every call a hook handles, lowered by the Governor while the hook costs more than its share.
+	 */
+	enum class DispatchMode : uint8_t {
+		Full, // every call runs the callbacks
+		Sampled, // one in sampleEvery calls runs the callbacks, the others are only counted
+		PassThrough // the bridge jumps straight to the original function, nothing runs and nothing is counted
+	};
+
 	/**
 	 * Creates and manages hooks at the beginning of a function.
 	 * This hooking method requires knowledge of parameters and calling convention of the target function.
@@ -13,10 +27,10 @@ namespace dyno {
 	class Hook : public MemAccessor, public IHook {
 	public:
 		explicit Hook(const ConvFunc& convention);
-		~Hook() override = default;
+		~Hook() override;
 		DYNO_NONCOPYABLE(Hook)
 
-		bool addCallback(CallbackType type, CallbackHandler handler) override;
+		bool addCallback(CallbackType type, CallbackHandler handler, CallbackFlag flags = CallbackFlag::All) override;
 		bool removeCallback(CallbackType type, CallbackHandler handler) override;
 		bool isCallbackRegistered(CallbackType type, CallbackHandler handler) const override;
 		bool areCallbacksRegistered() const override;
@@ -40,10 +54,130 @@ namespace dyno {
 			return m_fnBridge;
 		}
 
+		/**
+		 * @brief Makes the bridge continue at target after the pre callbacks, with a single aligned store,
+		 * so calls which are entering the bridge meanwhile take either the old or the new target.
+		 * Used by other entry mechanisms of the same function which share this bridge, see Detour::setDispatcher().
+		 * @return false if the bridge wasn't created yet.
+		 */
+		bool setContinuation(uintptr_t target);
+
+		/**
+		 * @brief Generates the code a ret site of the function jumps to when the post callbacks run at its exits,
+		 * see Detour::setExitSitePatching(). It executes prefix, the instructions moved out of the site, runs the
+		 * post callbacks of the returning call and executes ret with the given immediate.
+		 * @return the address of the stub, kept until the hook is destroyed, 0 on failure.
+		 */
+		virtual uintptr_t createExitStub(const std::vector<uint8_t>& prefix, uint16_t retImm) = 0;
+
+		/**
+		 * @brief Frees a stub of createExitStub() which no ret site jumps to.
+		 */
+		void releaseExitStub(uintptr_t stub);
+
+		/**
+		 * @brief Stops the bridge from redirecting the return address to the post stub while the ret sites
+		 * of the function are patched. Calls superceded by a pre callback never reach them and are still redirected.
+		 */
+		void setExitPatched(bool state) {
+			m_exitPatched.store(state, std::memory_order_relaxed);
+		}
+
+		const HookStats& getStats() const {
+			return *m_stats;
+		}
+
+		void setLatencyTracking(bool state) {
+			m_trackLatency.store(state, std::memory_order_relaxed);
+		}
+
+		/**
+		 * @brief Samples the hardware counters of the calling thread around every call, see HookStats::perf.
+		 * @return false if no counter is available on this system.
+		 */
+		bool setPerfTracking(bool state);
+
+		/**
+		 * @brief Counts the invocations of every callback handler and reads the TSC around one in sampleEvery
+		 * dispatches of the calling thread, see getHandlerProfiles(). 0 turns profiling off, 1 times every call.
+		 * The next dispatch of the calling thread is timed.
+		 */
+		void setHandlerProfiling(uint32_t sampleEvery);
+
+		uint32_t getHandlerProfiling() const {
+			return m_profileEvery.load(std::memory_order_relaxed);
+		}
+
+		/**
+		 * @brief Returns the counters of every registered handler, without symbols.
+		 * Counters of a removed handler are no longer reported.
+		 */
+		std::vector<HandlerProfile> getHandlerProfiles() const;
+
+		/**
+		 * @brief Counts the calls per return address in a CallerHistogram, allocated on first use.
+		 * Turning it off keeps the recorded counts.
+		 */
+		void setCallerTracking(bool state);
+
+		/**
+		 * @brief Returns the recorded call sites, without symbols. Empty if caller tracking was never on.
+		 */
+		std::vector<CallerProfile> getCallerProfiles() const;
+
+		/**
+		 * @brief Adds code which the bridge runs before it saves any register, for the hottest hooks where even the call
+		 * of the callback dispatcher is too much. Handlers are emitted in the order they were added, each one sees the
+		 * registers and the stack as they are at bridge entry, see ArgLocations. They may clobber the flags, and r10
+		 * and r11 on x64, everything else including the stack pointer has to be restored before jumping to a label.
+		 * Calls which leave through original or supercede record nothing: no frame, no stats and no post callbacks.
+		 * @return false if the bridge was generated already, handlers have to be added before hook().
+		 */
+		bool addInlineHandler(InlineHandler handler);
+
+		/**
+		 * @brief Trades callbacks for overhead, see DispatchMode. Inline handlers are skipped in pass-through too,
+		 * calls which are already inside keep the mode they entered with.
+		 * @param sampleEvery the calling thread runs the callbacks on one in sampleEvery calls in DispatchMode::Sampled,
+		 * starting with its next call.
+		 */
+		void setDispatchMode(DispatchMode mode, uint32_t sampleEvery = 16);
+
+		DispatchMode getDispatchMode() const {
+			return m_dispatchMode.load(std::memory_order_relaxed);
+		}
+
+		size_t getRecursionDepth() override;
+
+		/**
+		 * @brief Keeps the pending calls of this hook in the stacks returned by provider instead of the
+		 * default ones, see ContextProvider. nullptr restores the default. Must not change while calls are pending.
+		 * The registers of a call are still saved per hook, the callbacks must not suspend the fiber while they run.
+		 */
+		void setContextProvider(ContextProvider provider) {
+			m_contextProvider.store(provider, std::memory_order_relaxed);
+		}
+
 	protected:
 		virtual bool createBridge() = 0;
 		virtual bool createPostCallback() = 0;
 
+		/**
+		 * @brief Maps the bridge and the post stub from the prebuilt stubs instead of generating them.
+		 * @return false if the pages couldn't be mapped, the caller doesn't fall back to the assembler.
+		 */
+		bool createPrebuiltBridge();
+
+		/**
+		 * @brief Whether createBridge() uses the prebuilt stubs, see PrebuiltStubs::enable().
+		 */
+		bool usesPrebuiltStubs() const;
+
+		/**
+		 * @brief Hands the generated code to the fork guard, so it's sealed before fork() in fork mode.
+		 */
+		virtual void registerCode();
+
 		ICallingConvention& getCallingConvention() override {
 			return *m_callingConvention;
 		}
@@ -55,17 +189,22 @@ namespace dyno {
 
 		virtual void writeModifyReturnAddress(Assembler& a) = 0;
 		virtual void writeCallHandler(Assembler& a, CallbackType type) const = 0;
-		virtual int32_t writeSaveScratchRegisters(Assembler& a) const = 0;
-		virtual void writeRestoreScratchRegisters(Assembler& a) const = 0;
 		virtual void writeSaveRegisters(Assembler& a, bool post) const = 0;
 		virtual void writeRestoreRegisters(Assembler& a, bool post) const = 0;
 		virtual void writeRegToMem(Assembler& a, const Register& reg, [[maybe_unused]] bool post) const = 0;
 		virtual void writeMemToReg(Assembler& a, const Register& reg, [[maybe_unused]] bool post) const = 0;
 
+		/**
+		 * @brief Emits the inline handlers, see addInlineHandler(). Jumps to original and supercede lead to the
+		 * continuation of the bridge and to its ret.
+		 */
+		void writeInlineHandlers(Assembler& a, const asmjit::Label& original, const asmjit::Label& supercede);
+
 DYNO_OPTS_OFF
 		DYNO_NOINLINE ReturnAction DYNO_CDECL callbackHandler(CallbackType type);
 		DYNO_NOINLINE void* DYNO_CDECL getReturnAddress(void* stackPtr);
 		DYNO_NOINLINE void DYNO_CDECL setReturnAddress(void* retAddr, void* stackPtr);
+		DYNO_NOINLINE void DYNO_CDECL exitHandler(void* stackPtr);
 DYNO_OPTS_ON
 
 	protected:
@@ -75,22 +214,63 @@ DYNO_OPTS_ON
 		uintptr_t m_fnBridge{ 0 };
 		uintptr_t m_newRetAddr{ 0 };
 		size_t m_fnBridgeSize{ 0 };
+		uintptr_t m_continuation{ 0 }; // slot holding the address the bridge jumps to after the pre callbacks
 		size_t m_newRetAddrSize{ 0 };
 
+		// pages of the bridge and the post stub when they come from the prebuilt stubs
+		PrebuiltStubs::Code m_prebuilt;
+
 		// interface if the calling convention
 		std::unique_ptr<ICallingConvention> m_callingConvention;
 
-		// register storage
+		// register storage, the values live in the hot arena in fork mode
 		Registers m_registers;
 
-		// save the last return action of the pre callbackHander for use in the post handler.
-		std::vector<ReturnAction> m_lastPreReturnAction;
+		CallStack& getCallStack() const;
+		void beginCall(CallFrame& frame, ReturnAction action);
+		void endCall(const CallFrame& frame);
+		void saveCallState(CallStack& stack, CallFrame& frame);
+		ReturnAction dispatchProfiled(CallbackType type, const std::vector<CallbackHandler>& callbacks, uint32_t sampleEvery);
+
+		// where the pending calls live, nullptr for CallStack::current()
+		std::atomic<ContextProvider> m_contextProvider{ nullptr };
+
+		// counters exported to the stats segment, allocated from the hot arena in fork mode
+		HookStats* m_stats;
+
+		// timestamps and counters are only read while someone is interested in them
+		std::atomic<bool> m_trackLatency{ false };
+		std::atomic<bool> m_trackPerf{ false };
+		std::atomic<uint32_t> m_profileEvery{ 0 };
+		std::atomic<bool> m_trackCallers{ false };
 
-		// individual return's stack for stack pointers
-		std::unordered_map<void*, std::vector<void*>> m_retAddr;
+		// post callbacks run in the exit stubs, the return address is left alone
+		std::atomic<bool> m_exitPatched{ false };
+
+		// lowered by the governor, the bridge tests m_passThrough before anything else
+		std::atomic<DispatchMode> m_dispatchMode{ DispatchMode::Full };
+		std::atomic<uint32_t> m_sampleEvery{ 1 };
+		std::atomic<uint8_t> m_passThrough{ 0 };
+
+		// call sites seen by the bridge, allocated from the hot arena in fork mode and kept until destruction
+		std::atomic<CallerHistogram*> m_callers{ nullptr };
+
+		// emitted into the bridge when it's generated
+		std::vector<InlineHandler> m_inlineHandlers;
 
 		// callbacks list
 		std::unordered_map<CallbackType, std::vector<CallbackHandler>> m_handlers;
+		// counters of the handler at the same index, allocated from the hot arena in fork mode
+		std::unordered_map<CallbackType, std::vector<HandlerStats*>> m_handlerStats;
+		// counters of removed handlers, a dispatch running meanwhile may still hold them, freed on destruction
+		std::vector<HandlerStats*> m_retiredStats;
+		// declared needs of the handler at the same index
+		std::unordered_map<CallbackType, std::vector<CallbackFlag>> m_handlerFlags;
+
+		// copies taken for the post callbacks, only if a handler declared to need them
+		bool m_saveArgs{ false };
+		bool m_saveReturn{ false };
+		void updateSavedState();
 
 		bool m_hooked{ false };
 	};
@@ -2,7 +2,10 @@
 
 #include "convention.h"
 #include "registers.h"
+#include <cassert>
 #include <functional>
+#include <tuple>
+#include <utility>
 
 namespace dyno {
 	enum class HookMode : uint8_t {
@@ -26,8 +29,85 @@ namespace dyno {
 		Supercede // skip real function; use my return value
 	};
 
+	/**
+	 * What a callback handler does with the call, the dispatcher skips the copies no handler needs.
+	 * Only ReadArgs and WriteReturn have a copy behind them. WriteArgs and ReadReturn are reserved,
+	 * they describe the handler but don't change what the dispatcher does.
+	 */
+	enum class CallbackFlag : uint8_t {
+		None = 0,
+		ReadArgs = 1 << 0, // post handlers see the arguments the original function was called with
+		WriteArgs = 1 << 1, // reserved, pre handlers write the registers and stack slots directly
+		ReadReturn = 1 << 2, // reserved, post handlers read the return registers directly
+		WriteReturn = 1 << 3, // pre handlers returning Override or Supercede set the return value
+		All = ReadArgs | WriteArgs | ReadReturn | WriteReturn
+	};
+
+	inline CallbackFlag operator|(CallbackFlag lhs, CallbackFlag rhs) {
+		return static_cast<CallbackFlag>(static_cast<uint8_t>(lhs) | static_cast<uint8_t>(rhs));
+	}
+
+	inline bool operator&(CallbackFlag lhs, CallbackFlag rhs) {
+		return static_cast<uint8_t>(lhs) & static_cast<uint8_t>(rhs);
+	}
+
 	class IHook;
 	typedef ReturnAction (*CallbackHandler)(CallbackType, IHook&);
+
+	/**
+	 * Addresses of the arguments of the running call, looked up in one pass, see IHook::getArgs().
+	 * Only valid inside the callback which created it.
+	 */
+	class ArgsView {
+	public:
+		template<class T>
+		T get(size_t index) const {
+			assert(index < m_count);
+			return *(T*) m_ptrs[index];
+		}
+
+		/**
+		 * @brief Writes an argument, pass the view to IHook::applyArgs() once all changes are made.
+		 */
+		template<class T>
+		void set(size_t index, T value) const {
+			assert(index < m_count);
+			*(T*) m_ptrs[index] = value;
+		}
+
+		/**
+		 * @brief Reads the leading arguments at once, e.g. auto [fd, buf, len] = args.as<int, void*, size_t>();
+		 */
+		template<class... Ts>
+		std::tuple<Ts...> as() const {
+			assert(sizeof...(Ts) <= m_count);
+			return read<Ts...>(std::index_sequence_for<Ts...>{});
+		}
+
+		void* operator[](size_t index) const {
+			assert(index < m_count);
+			return m_ptrs[index];
+		}
+
+		size_t size() const {
+			return m_count;
+		}
+
+		// arguments past the capacity are only reachable through IHook::getArgument()
+		static constexpr size_t kCapacity = 16;
+
+	private:
+		template<class... Ts, size_t... Is>
+		std::tuple<Ts...> read(std::index_sequence<Is...>) const {
+			return { *(Ts*) m_ptrs[Is]... };
+		}
+
+		void* m_ptrs[kCapacity];
+		size_t m_count{ 0 };
+
+		friend class IHook;
+	};
+
 	using ConvFunc = std::function<ICallingConvention*()>;
 
 	/**
@@ -41,9 +121,11 @@ namespace dyno {
 		 * @brief Adds a callback handler to the hook.
 		 * @param type The callback type.
 		 * @param handler The callback handler that should be added.
+		 * @param flags What the handler does with the call. The arguments are only copied for post handlers
+		 * if one of them reads them, and the return value of an Override or Supercede only if a pre handler writes it.
 		 * @return True on success, false otherwise.
 		 */
-		virtual bool addCallback(CallbackType type, CallbackHandler handler) = 0;
+		virtual bool addCallback(CallbackType type, CallbackHandler handler, CallbackFlag flags = CallbackFlag::All) = 0;
 
 		/**
 		 * @brief Removes a callback handler to the hook.
@@ -79,6 +161,49 @@ namespace dyno {
 			getCallingConvention().onArgumentPtrChanged(index, getRegisters(), argumentPtr);
 		}
 
+		/**
+		 * @brief Looks up every argument at once, cheaper than several getArgument() calls.
+		 */
+		ArgsView getArgs() {
+			ArgsView args;
+			args.m_count = getCallingConvention().getArgumentPtrs(getRegisters(), args.m_ptrs, ArgsView::kCapacity);
+			return args;
+		}
+
+		/**
+		 * @brief Tells the calling convention about the arguments written through the view, in one pass.
+		 */
+		void applyArgs(const ArgsView& args) {
+			getCallingConvention().onArgumentPtrsChanged(getRegisters(), args.m_ptrs, args.m_count);
+		}
+
+		/**
+		 * @brief Copies every argument to out, back to back with the sizes of the calling convention.
+		 * @return The number of bytes written, 0 if outSize is too small.
+		 */
+		size_t getArguments(void* out, size_t outSize) {
+			ICallingConvention& convention = getCallingConvention();
+			const size_t size = convention.getArgStackSize() + convention.getArgRegisterSize();
+			if (outSize < size)
+				return 0;
+
+			convention.saveCallArguments(getRegisters(), (uint8_t*) out);
+			return size;
+		}
+
+		/**
+		 * @brief Overwrites every argument from a buffer laid out like getArguments() writes it.
+		 * @return false if inSize is too small.
+		 */
+		bool setArguments(const void* in, size_t inSize) {
+			ICallingConvention& convention = getCallingConvention();
+			if (inSize < convention.getArgStackSize() + convention.getArgRegisterSize())
+				return false;
+
+			convention.writeCallArguments(getRegisters(), (const uint8_t*) in);
+			return true;
+		}
+
 		template<class T>
 		T getReturn() {
 			return *(T*) getCallingConvention().getReturnPtr(getRegisters());
@@ -99,6 +224,12 @@ namespace dyno {
 		virtual const uintptr_t& getAddress() const = 0;
 		virtual HookMode getMode() const = 0;
 
+		/**
+		 * @brief Returns the number of pending calls of this hook in the running execution context,
+		 * including the one whose callback is asking, 0 outside of a callback.
+		 */
+		virtual size_t getRecursionDepth() = 0;
+
 	protected:
 		virtual ICallingConvention& getCallingConvention() = 0;
 		virtual Registers& getRegisters() = 0;
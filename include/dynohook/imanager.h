@@ -1,9 +1,18 @@
 #pragma once
 
 #include "ihook.h"
+#include "call_stack.h"
+#include "stats.h"
+#include "detours/install_report.h"
+#include "detours/watchdog.h"
+#include "stats_exporter.h"
+#include "governor.h"
 
+#include <chrono>
 #include <memory>
+#include <vector>
 #include <mutex>
+#include <string>
 
 namespace dyno {
 	class IHookManager {
@@ -37,6 +46,17 @@ namespace dyno {
 		 */
 		virtual std::shared_ptr<IHook> hookVirtual(void* pClass, void* pFunc, const ConvFunc& convention) = 0;
 
+		/**
+		 * @brief Creates a function hook on a function pointer outside of a vtable, like an entry of a C ops struct.
+		 * The slot is swapped atomically to the bridge of the function it points to, which is shared with
+		 * the other hooks of that function. Nothing is disassembled or relocated.
+		 * If the slot was already hooked, the existing Hook instance will be returned.
+		 * @param slot address of the function pointer.
+		 * @param convention
+		 * @return NULL or the Hook instance.
+		 */
+		virtual std::shared_ptr<IHook> hookSlot(void** slot, const ConvFunc& convention) = 0;
+
 		/**
 		 * @brief Removes all callbacks and restores the original function.
 		 * @param pFunc
@@ -60,6 +80,13 @@ namespace dyno {
 		 */
 		virtual bool unhookVirtual(void* pClass, void* pFunc) = 0;
 
+		/**
+		 * @brief Restores the original function pointer of the slot.
+		 * @param slot
+		 * @return true if the slot was hooked previously and is unhooked now. False otherwhise.
+		 */
+		virtual bool unhookSlot(void** slot) = 0;
+
 		/**
 		 * @brief Finds the hook for a given function.
 		 * @param pFunc
@@ -82,6 +109,13 @@ namespace dyno {
 		 */
 		virtual std::shared_ptr<IHook> findVirtual(void* pClass, void* pFunc) const = 0;
 
+		/**
+		 * @brief Finds the hook for a given function pointer slot.
+		 * @param slot
+		 * @return NULL or the found Hook instance.
+		 */
+		virtual std::shared_ptr<IHook> findSlot(void** slot) const = 0;
+
 		/**
 		 * @brief Removes all callbacks and restores all functions.
 		 */
@@ -97,5 +131,111 @@ namespace dyno {
 		 * @brief Unhooks previously hooked virtual functions which not in use anymore.
 		 */
 		virtual void clearCache() = 0;
+
+		/**
+		 * @brief Starts a low priority background thread which verifies the patched bytes of every detour
+		 * and calls rehook() on the ones that were overwritten by a third party.
+		 * @param interval time between two verification sweeps.
+		 * @param maxRepairsPerSweep upper bound of detours repaired by a single sweep.
+		 * @return false if the watchdog is already running.
+		 */
+		virtual bool startWatchdog(std::chrono::milliseconds interval, uint32_t maxRepairsPerSweep = 16) = 0;
+
+		/**
+		 * @brief Stops the watchdog thread started by startWatchdog().
+		 */
+		virtual void stopWatchdog() = 0;
+
+		/**
+		 * @brief Returns the counters of the detour watchdog.
+		 */
+		virtual WatchdogStats getWatchdogStats() const = 0;
+
+		/**
+		 * @brief Returns the install report of every detour created by hookDetour(), including the failed ones.
+		 * Sort by InstallReport::totalNs to find the targets which dominate startup.
+		 */
+		virtual std::vector<InstallReport> getInstallReports() const = 0;
+
+		/**
+		 * @brief Returns the per phase sum of all install reports.
+		 */
+		virtual InstallTotals getInstallTotals() const = 0;
+
+		/**
+		 * @brief Publishes the counters of every hook into a shared memory segment which can be
+		 * watched by another process, e.g. with the dynohook_top tool.
+		 * @param name POSIX shared memory name like "/dynohook", empty to create an anonymous memfd.
+		 * @param interval time between two updates of the segment.
+		 * @param capacity maximum number of hooks in the segment.
+		 * @return false if the segment couldn't be created or the export is already running.
+		 */
+		virtual bool startStatsExport(const std::string& name, std::chrono::milliseconds interval, size_t capacity = 4096) = 0;
+
+		/**
+		 * @brief Stops the export started by startStatsExport() and removes the segment.
+		 */
+		virtual void stopStatsExport() = 0;
+
+		/**
+		 * @brief Returns the path of the exported segment, empty if the export isn't running.
+		 */
+		virtual std::string getStatsExportPath() const = 0;
+
+		/**
+		 * @brief Starts a background thread which keeps the estimated overhead of every hook within the budget,
+		 * switching the expensive ones to sampled callbacks or to pass-through and back as the load changes. See Governor.
+		 * @param interval time between two evaluations.
+		 * @return false if the governor is already running.
+		 */
+		virtual bool startGovernor(const GovernorBudget& budget, std::chrono::milliseconds interval) = 0;
+
+		/**
+		 * @brief Stops the governor started by startGovernor(), every hook goes back to full dispatch.
+		 */
+		virtual void stopGovernor() = 0;
+
+		/**
+		 * @brief Returns the counters of the overhead governor.
+		 */
+		virtual GovernorStats getGovernorStats() const = 0;
+
+		/**
+		 * @brief Keeps the state written by every call on dedicated pages which are dropped in forked children,
+		 * and seals the generated code before fork(), so pre-fork workers keep sharing the rest. See ForkGuard.
+		 * Only hooks created afterwards benefit, call it before the first hook.
+		 * @return false if fork mode isn't supported on this platform.
+		 */
+		virtual bool enableForkMode() = 0;
+
+		/**
+		 * @brief Keeps the pending calls of every hook in the stacks returned by provider, e.g. one per fiber,
+		 * instead of one per thread. nullptr restores the per thread stacks. See ContextProvider.
+		 * The registers of a call are still saved per hook, the callbacks must not suspend the fiber while they run.
+		 */
+		virtual void setContextProvider(ContextProvider provider) = 0;
+
+		/**
+		 * @brief Counts the invocations of every callback handler of every hook, including the ones created later,
+		 * and times one in sampleEvery dispatches with the TSC. 0 turns profiling off. See getHandlerProfiles().
+		 */
+		virtual void setHandlerProfiling(uint32_t sampleEvery) = 0;
+
+		/**
+		 * @brief Returns the counters of every handler registered on a hook, with the handler symbol if known.
+		 * Sort by HandlerProfile::cycles scaled to all calls to find the handlers which dominate the hooked calls.
+		 */
+		virtual std::vector<HandlerProfile> getHandlerProfiles() const = 0;
+
+		/**
+		 * @brief Counts the calls of every hook, including the ones created later, per return address.
+		 * The tables of the hooks keep their counts when it's turned off. See CallerHistogram.
+		 */
+		virtual void setCallerTracking(bool state) = 0;
+
+		/**
+		 * @brief Returns the call sites recorded for every hook, with the symbol of the calling function if known.
+		 */
+		virtual std::vector<CallerProfile> getCallerProfiles() const = 0;
 	};
 }
\ No newline at end of file
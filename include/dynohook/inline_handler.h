@@ -0,0 +1,35 @@
+#pragma once
+
+#include "registers.h"
+#include <asmjit/asmjit.h>
+#include <functional>
+#include <vector>
+
+namespace dyno {
+	/**
+	 * Where one argument of the hooked call is while the inline handlers run.
+	 */
+	struct ArgLocation {
+		RegisterType reg; // NONE if the argument was passed on the stack
+		int32_t offset; // of stack arguments, from the stack pointer at bridge entry, which points at the return address
+		uint16_t size;
+	};
+
+	/**
+	 * What an inline handler is told about the call, see Hook::addInlineHandler().
+	 */
+	struct ArgLocations {
+		std::vector<ArgLocation> args;
+		RegisterType returnReg; // where the caller expects the return value
+		uint16_t popSize; // bytes popped by the callee on return, besides the return address
+
+		asmjit::Label next; // continue with the next inline handler, then the callbacks and the original function
+		asmjit::Label original; // skip the callbacks and continue in the original function
+		asmjit::Label supercede; // return to the caller, skipping the original function, with the value in returnReg
+	};
+
+	/**
+	 * Emits instructions into the bridge, which must end by jumping to one of the labels of locations.
+	 */
+	typedef std::function<void(asmjit::x86::Assembler& a, const ArgLocations& locations)> InlineHandler;
+}
\ No newline at end of file
@@ -1,5 +1,6 @@
 #pragma once
 
+#include <algorithm>
 #include <cstdint>
 #include <vector>
 #include <string>
@@ -7,6 +8,7 @@
 #include <iomanip>
 #include <sstream>
 #include <cassert>
+#include <initializer_list>
 
 namespace dyno {
 	enum class Mode : bool {
@@ -14,6 +16,60 @@ namespace dyno {
 		x64
 	};
 
+	/**
+	 * Vector with inline storage for up to N trivially copyable elements. Instructions are copied
+	 * around a lot during an install, their fields shouldn't cost an allocation each.
+	 */
+	template<typename T, size_t N>
+	class InlineVector {
+	public:
+		InlineVector() = default;
+
+		explicit InlineVector(size_t count) : m_size{(uint8_t) count} {
+			assert(count <= N);
+		}
+
+		InlineVector(const T* data, size_t count) : m_size{(uint8_t) count} {
+			assert(count <= N);
+			std::copy(data, data + count, m_data);
+		}
+
+		InlineVector(std::initializer_list<T> list) : InlineVector(list.begin(), list.size()) {}
+
+		InlineVector(const std::vector<T>& vector) : InlineVector(vector.data(), vector.size()) {}
+
+		void push_back(const T& value) {
+			assert(m_size < N);
+			m_data[m_size++] = value;
+		}
+
+		T* data() { return m_data; }
+		const T* data() const { return m_data; }
+
+		size_t size() const { return m_size; }
+		bool empty() const { return m_size == 0; }
+
+		T& operator[](size_t index) { return m_data[index]; }
+		const T& operator[](size_t index) const { return m_data[index]; }
+
+		const T& at(size_t index) const {
+			assert(index < m_size);
+			return m_data[index];
+		}
+
+		const T& front() const { return m_data[0]; }
+		const T& back() const { return m_data[m_size - 1]; }
+
+		T* begin() { return m_data; }
+		T* end() { return m_data + m_size; }
+		const T* begin() const { return m_data; }
+		const T* end() const { return m_data + m_size; }
+
+	private:
+		T m_data[N]{};
+		uint8_t m_size{ 0 };
+	};
+
 	class MemAccessor;
 	class Instruction {
 	public:
@@ -28,18 +84,31 @@ namespace dyno {
 			Immediate,
 		};
 
+		// longest encoding is 15 bytes, the 14 byte absolute jmp is the longest one made up
+		typedef InlineVector<uint8_t, 16> Bytes;
+		typedef InlineVector<OperandType, 8> Operands;
+
 		Instruction(const MemAccessor* accessor,
 					uintptr_t address,
 					Displacement displacement,
 					uint8_t displacementOffset,
 					bool isRelative,
 					bool isIndirect,
-					std::vector<uint8_t>&& bytes,
+					Bytes bytes,
 					std::string&& mnemonic,
 					std::string&& opStr,
 					Mode mode
 				);
 
+		/**Decoded instruction, its operand string is only formatted from the bytes when getFullName() asks for it**/
+		Instruction(const MemAccessor* accessor,
+					uintptr_t address,
+					const uint8_t* bytes,
+					uint8_t size,
+					const char* mnemonic,
+					Mode mode
+				);
+
 		uintptr_t getAbsoluteDestination() const {
 			return m_displacement.Absolute;
 		}
@@ -66,6 +135,11 @@ namespace dyno {
 			m_address = address;
 		}
 
+		/**Set the accessor used to read the destination of indirect branches**/
+		void setAccessor(const MemAccessor* accessor) {
+			m_accessor = accessor;
+		}
+
 		/**Get the displacement from current address**/
 		Displacement getDisplacement() const {
 			return m_displacement;
@@ -118,7 +192,7 @@ namespace dyno {
 			return m_isIndirect;
 		}
 
-		const std::vector<uint8_t>& getBytes() const {
+		const Bytes& getBytes() const {
 			return m_bytes;
 		}
 
@@ -128,8 +202,10 @@ namespace dyno {
 		}
 
 		/**Get symbol name and parameters**/
-		std::string getFullName() const {
-			return m_mnemonic + " " + m_opStr;
+		std::string getFullName() const;
+
+		Mode getMode() const {
+			return m_mode;
 		}
 
 		/** Displacement size in bytes **/
@@ -198,10 +274,10 @@ namespace dyno {
 		}
 
 		void addOperandType(OperandType type){
-			m_operands.emplace_back(type);
+			m_operands.push_back(type);
 		}
 
-		const std::vector<OperandType>& getOperandTypes() const {
+		const Operands& getOperandTypes() const {
 			return m_operands;
 		}
 
@@ -226,10 +302,11 @@ namespace dyno {
 		uint8_t       m_dispSize;        // Size of the displacement, in bytes
 
 		Mode m_mode;
+		bool m_formatLazily;             // m_opStr is empty, getFullName() formats the bytes instead
 		uint32_t m_uid;
 
-		std::vector<uint8_t> m_bytes;    // All the raw bytes of this instruction
-		std::vector<OperandType> m_operands; // Types of all instruction operands
+		Bytes m_bytes;                   // All the raw bytes of this instruction
+		Operands m_operands;             // Types of all visible instruction operands
 		std::string m_mnemonic;
 		std::string m_opStr;
 
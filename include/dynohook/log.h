@@ -1,9 +1,16 @@
 #pragma once
 
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
 #include <cstdint>
+#include <cstdio>
 #include <string>
 #include <memory>
+#include <mutex>
 #include <vector>
+#include <thread>
+#include <concepts>
 
 namespace dyno {
 	enum class ErrorLevel : uint8_t {
@@ -19,12 +26,32 @@ namespace dyno {
 		virtual ~Logger() = default;
 	
 		virtual void log(const std::string& msg, ErrorLevel level) = 0;
+
+		/**
+		 * Allows a logger to reject a level before the message is formatted.
+		 */
+		virtual bool isEnabled(ErrorLevel level) const {
+			return level != ErrorLevel::NONE;
+		}
 	};
 
 	class Log {
 	public:
 		static void registerLogger(std::shared_ptr<Logger> logger);
 		static void log(const std::string& msg, ErrorLevel level);
+
+		/**
+		 * Only invokes the formatter if a logger is registered and accepts the level.
+		 */
+		template<typename F> requires std::invocable<F>
+		static void log(ErrorLevel level, F&& format) {
+			if (isEnabled(level))
+				m_logger->log(format(), level);
+		}
+
+		static bool isEnabled(ErrorLevel level) {
+			return m_logger && m_logger->isEnabled(level);
+		}
 		
 	private:
 		static inline std::shared_ptr<Logger> m_logger = nullptr;
@@ -36,6 +63,7 @@ namespace dyno {
 		~ErrorLogger() override = default;
 	
 		void log(const std::string& msg, ErrorLevel level) override;
+		bool isEnabled(ErrorLevel level) const override;
 
 		void push(const std::string& msg, ErrorLevel level);
 		std::string pop();
@@ -48,15 +76,99 @@ namespace dyno {
 		std::vector<std::string> m_log;
 		ErrorLevel m_level = ErrorLevel::INFO;
 	};
+
+	/**
+	 * Logger which never blocks the caller and never grows: messages are formatted into a bounded
+	 * lock-free ring of fixed size records and written out in batches by a background thread.
+	 * When the ring is full the message is dropped and counted instead.
+	 */
+	class AsyncLogger : public Logger {
+	public:
+		/**
+		 * @param capacity number of records in the ring, rounded up to a power of two.
+		 * @param out stream the background thread writes to.
+		 * @param flushInterval how long the background thread sleeps when the ring is empty, flush() and the destructor wake it.
+		 * @param start false to queue messages in the ring until start() is called.
+		 */
+		explicit AsyncLogger(size_t capacity = 1024, std::FILE* out = stdout, std::chrono::milliseconds flushInterval = std::chrono::milliseconds(10), bool start = true);
+		~AsyncLogger() override;
+
+		AsyncLogger(const AsyncLogger&) = delete;
+		AsyncLogger& operator=(const AsyncLogger&) = delete;
+
+		void log(const std::string& msg, ErrorLevel level) override;
+		bool isEnabled(ErrorLevel level) const override;
+
+		void setLogLevel(ErrorLevel level);
+
+		/**
+		 * Starts the background thread of a logger created with start false, does nothing if it runs already.
+		 */
+		void start();
+
+		/**
+		 * Blocks until every message queued before the call was written out, the logger has to be started.
+		 */
+		void flush();
+
+		uint64_t getWrittenCount() const;
+		uint64_t getDroppedCount() const;
+		uint64_t getTruncatedCount() const;
+
+	private:
+		// records are preformatted, longer messages are cut and counted as truncated
+		static constexpr size_t kRecordSize = 256;
+
+		struct Record {
+			std::atomic<size_t> sequence;
+			uint16_t length;
+			char text[kRecordSize];
+		};
+
+		void run();
+		size_t drain();
+		void wake(bool stop);
+
+		std::unique_ptr<Record[]> m_records;
+		size_t m_mask;
+		alignas(64) std::atomic<size_t> m_head{ 0 };
+		alignas(64) size_t m_tail{ 0 }; // only touched by the background thread
+		std::atomic<size_t> m_flushed{ 0 };
+
+		std::FILE* m_out;
+		std::chrono::milliseconds m_flushInterval;
+		std::atomic<ErrorLevel> m_level{ ErrorLevel::INFO };
+		std::mutex m_wakeMutex;
+		std::condition_variable m_wake;
+		bool m_wakeRequested{ false }; // guarded by m_wakeMutex
+		bool m_stop{ false }; // guarded by m_wakeMutex
+		std::thread m_thread;
+
+		std::atomic<uint64_t> m_written{ 0 };
+		std::atomic<uint64_t> m_dropped{ 0 };
+		std::atomic<uint64_t> m_truncated{ 0 };
+	};
 }
 
+// levels below this one are compiled out entirely (INFO, WARN or ERR)
+#ifndef DYNO_LOG_MIN_LEVEL
+#define DYNO_LOG_MIN_LEVEL INFO
+#endif
+
+// the message expression is only evaluated if the level is enabled, so call sites may build expensive dumps
 #if DYNO_LOGGING
-#define DYNO_LOG(lvl, msg) dyno::Log::log(msg, dyno::ErrorLevel::lvl)
-#define DYNO_LOG_INFO(msg) dyno::Log::log(msg, dyno::ErrorLevel::INFO)
-#define DYNO_LOG_WARN(msg) dyno::Log::log(msg, dyno::ErrorLevel::WARN)
-#define DYNO_LOG_ERR(msg)  dyno::Log::log(msg, dyno::ErrorLevel::ERR)
+#define DYNO_LOG(lvl, msg) \
+	do { \
+		if constexpr (dyno::ErrorLevel::lvl >= dyno::ErrorLevel::DYNO_LOG_MIN_LEVEL) { \
+			if (dyno::Log::isEnabled(dyno::ErrorLevel::lvl)) \
+				dyno::Log::log(msg, dyno::ErrorLevel::lvl); \
+		} \
+	} while (0)
+#define DYNO_LOG_INFO(msg) DYNO_LOG(INFO, msg)
+#define DYNO_LOG_WARN(msg) DYNO_LOG(WARN, msg)
+#define DYNO_LOG_ERR(msg)  DYNO_LOG(ERR, msg)
 #else
-#define DYNO_LOG(msg)
+#define DYNO_LOG(lvl, msg)
 #define DYNO_LOG_INFO(msg)
 #define DYNO_LOG_WARN(msg)
 #define DYNO_LOG_ERR(msg)
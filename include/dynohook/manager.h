@@ -3,6 +3,7 @@
 #include "imanager.h"
 #include "convention.h"
 #include "virtuals/vtable.h"
+#include "virtuals/func_slot.h"
 #include "detours/nat_detour.h"
 
 #include <asmjit/asmjit.h>
@@ -20,23 +21,68 @@ namespace dyno {
 		std::shared_ptr<IHook> hookDetour(void* pFunc, const ConvFunc& convention) override;
 		std::shared_ptr<IHook> hookVirtual(void* pClass, int index, const ConvFunc& convention) override;
 		std::shared_ptr<IHook> hookVirtual(void* pClass, void* pFunc, const ConvFunc& convention) override;
+		std::shared_ptr<IHook> hookSlot(void** slot, const ConvFunc& convention) override;
 		bool unhookDetour(void* pFunc) override;
 		bool unhookVirtual(void* pClass, int index) override;
 		bool unhookVirtual(void* pClass, void* pFunc) override;
+		bool unhookSlot(void** slot) override;
 		std::shared_ptr<IHook> findDetour(void* pFunc) const override;
 		std::shared_ptr<IHook> findVirtual(void* pClass, int index) const override;
 		std::shared_ptr<IHook> findVirtual(void* pClass, void* pFunc) const override;
+		std::shared_ptr<IHook> findSlot(void** slot) const override;
 
 		void unhookAll() override;
 		void unhookAllVirtual(void* pClass) override;
 		void clearCache() override;
 
+		bool startWatchdog(std::chrono::milliseconds interval, uint32_t maxRepairsPerSweep = 16) override;
+		void stopWatchdog() override;
+		WatchdogStats getWatchdogStats() const override;
+
+		std::vector<InstallReport> getInstallReports() const override;
+		InstallTotals getInstallTotals() const override;
+
+		bool startStatsExport(const std::string& name, std::chrono::milliseconds interval, size_t capacity = 4096) override;
+		void stopStatsExport() override;
+		std::string getStatsExportPath() const override;
+
+		bool startGovernor(const GovernorBudget& budget, std::chrono::milliseconds interval) override;
+		void stopGovernor() override;
+		GovernorStats getGovernorStats() const override;
+
+		bool enableForkMode() override;
+		void setContextProvider(ContextProvider provider) override;
+
+		void setHandlerProfiling(uint32_t sampleEvery) override;
+		std::vector<HandlerProfile> getHandlerProfiles() const override;
+
+		void setCallerTracking(bool state) override;
+		std::vector<CallerProfile> getCallerProfiles() const override;
+
 		static IHookManager& Get();
 
+	private:
+		void addInstallReport(const InstallReport& report);
+		static std::shared_ptr<Hook> getDispatchHook(const std::shared_ptr<NatDetour>& detour) {
+			return detour->getDispatcher() ? detour->getDispatcher() : detour;
+		}
+
+		void trackHook(const std::shared_ptr<Hook>& hook, uintptr_t address, const InstallReport* report = nullptr);
+
 	public:
-		std::shared_ptr<VHookCache> m_cache; // used as global storage to avoid creating same hooks
+		std::shared_ptr<VHookCache> m_cache; // the hook of every function, shared by its detour and vtable slots
 		std::unordered_map<void*, std::unique_ptr<VTable>> m_vtables;
+		std::unordered_map<void**, std::unique_ptr<FuncSlot>> m_slots;
 		std::unordered_map<void*, std::shared_ptr<NatDetour>> m_detours;
-		std::mutex m_mutex;
+		Watchdog m_watchdog; // declared after m_detours so its thread is joined before they are destroyed
+		StatsExporter m_statsExporter;
+		Governor m_governor;
+		std::vector<InstallReport> m_installReports;
+		InstallTotals m_installTotals;
+		std::unordered_map<const Hook*, std::weak_ptr<Hook>> m_tracked; // hooks the defaults below were applied to
+		size_t m_trackedSweep{ 64 }; // size at which the destroyed hooks are dropped from m_tracked
+		uint32_t m_profileEvery{ 0 };
+		bool m_trackCallers{ false };
+		mutable std::mutex m_mutex;
 	};
 }
\ No newline at end of file
@@ -39,6 +39,11 @@ namespace dyno {
 
 		virtual ProtFlag mem_protect(uintptr_t dest, size_t size, ProtFlag newProtection, bool& status) const;
 
+		/**
+		 * Returns the current protection of the page holding address, ProtFlag::UNSET if it couldn't be queried.
+		 */
+		virtual ProtFlag mem_query(uintptr_t address) const;
+
 	public:
 		void writeEncoding(const insts_t& instructions);
 
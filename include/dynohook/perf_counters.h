@@ -0,0 +1,85 @@
+#pragma once
+
+#include <dynohook/helpers.h>
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+namespace dyno {
+	enum class PerfEvent : uint8_t {
+		Instructions,
+		BranchMisses,
+		ITlbMisses,
+		MachineClears // raw event, only known on intel
+	};
+
+	constexpr size_t kPerfEventCount = 4;
+
+	struct PerfSample {
+		std::array<uint64_t, kPerfEventCount> values{};
+		uint8_t valid{ 0 }; // bit per PerfEvent
+
+		bool has(PerfEvent event) const {
+			return valid & (1u << (uint8_t) event);
+		}
+	};
+
+	/**
+	 * Hardware counters of the calling thread, user space only, read through perf_event_open.
+	 * Every event the kernel refuses (missing PMU in a VM or container, perf_event_paranoid, unknown CPU)
+	 * is left out instead of failing, PerfSample::valid tells which ones were counted.
+	 * Only implemented on linux, open() fails elsewhere.
+	 */
+	class PerfCounters {
+	public:
+		PerfCounters() = default;
+		~PerfCounters();
+		DYNO_NONCOPYABLE(PerfCounters);
+
+		/**
+		 * @brief Opens and starts the counters for the calling thread.
+		 * @return false if none of the events could be opened.
+		 */
+		bool open();
+		void close();
+
+		bool isOpen() const {
+			return m_available != 0;
+		}
+
+		/**
+		 * @brief Returns the current counter values, deltas of two samples give the cost of the code in between.
+		 * Must be called from the thread which opened the counters.
+		 */
+		PerfSample read() const;
+
+		/**
+		 * @brief Why events are missing after open(), empty if every event is counted.
+		 */
+		const std::string& getError() const {
+			return m_error;
+		}
+
+		static const char* name(PerfEvent event);
+
+		/**
+		 * @brief Counters of the calling thread, opened on first use.
+		 */
+		static PerfCounters& forThisThread();
+
+		/**
+		 * @brief Opens the counters once on the calling thread to find out whether any event is usable.
+		 */
+		static bool isSupported();
+
+	private:
+		std::array<int, kPerfEventCount> m_fds{ -1, -1, -1, -1 };
+		std::array<PerfEvent, kPerfEventCount> m_order{}; // event of each value in a group read
+		size_t m_count{ 0 };
+		int m_leader{ -1 };
+		uint8_t m_available{ 0 };
+		std::string m_error;
+	};
+}
\ No newline at end of file
@@ -0,0 +1,71 @@
+#pragma once
+
+#include "registers.h"
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+
+namespace dyno {
+	/**
+	 * Puts the bridge and the post stub of a hook together from preassembled instruction snippets instead of
+	 * generating them with the assembler. The snippets are constexpr tables with a hole for their address operand,
+	 * so the code of a hook is only copied into pages of its own and patched with the addresses of its registers
+	 * and of the hook itself, the pages are made read + execute afterwards. The continuation slot lives on a read + write
+	 * page of its own behind them, so the code never becomes writable again. Neither the assembler nor the JIT runtime
+	 * is involved, so it also works where writable memory must not stay executable.
+	 * Covers the general purpose registers of the architecture and the XMM registers, which are all the registers
+	 * the built-in conventions use for scalar signatures, except the x87 return of x86 floats.
+	 * Hooks with inline handlers or other registers keep using the assembler.
+	 */
+	class PrebuiltStubs {
+	public:
+		struct Targets {
+			uintptr_t hook;
+			uintptr_t passThrough; // byte the bridge tests before anything else
+			uintptr_t callbackHandler;
+			uintptr_t setReturnAddress;
+			uintptr_t getReturnAddress;
+			uintptr_t continuation; // initial content of the continuation slot
+		};
+
+		// the pages of a hook, the post stub first, the bridge behind it and the data page with the slot last
+		struct Code {
+			uintptr_t address{ 0 };
+			size_t size{ 0 };
+			uintptr_t bridge{ 0 };
+			size_t bridgeSize{ 0 };
+			uintptr_t continuation{ 0 }; // slot holding the address the bridge continues at, never executable
+			uintptr_t postStub{ 0 };
+			size_t postStubSize{ 0 };
+		};
+
+		/**
+		 * @brief Makes hooks generated afterwards use the prebuilt stubs whenever they support their registers.
+		 */
+		static void enable(bool state) {
+			s_enabled.store(state, std::memory_order_relaxed);
+		}
+
+		static bool isEnabled() {
+			return s_enabled.load(std::memory_order_relaxed);
+		}
+
+		static bool supports(const Registers& registers);
+
+		/**
+		 * @brief Maps the code of a hook. The bridge does what the assembled one does without inline handlers,
+		 * the post stub what Hook::createPostCallback() generates.
+		 * @return false if the pages couldn't be mapped or protected.
+		 */
+		static bool create(const Registers& registers, const Targets& targets, uint16_t popSize, Code& code);
+
+		/**
+		 * @brief Unmaps the pages of create().
+		 */
+		static void release(Code& code);
+
+	private:
+		static std::atomic<bool> s_enabled;
+	};
+}
\ No newline at end of file
@@ -0,0 +1,31 @@
+#pragma once
+
+#include <asmjit/asmjit.h>
+
+#include <cstdint>
+
+namespace dyno {
+	/**
+	 * asmjit code holder borrowed from a pool of the calling thread for one code generation.
+	 * Holders are only reset softly when they are given back, their zones keep the blocks they grew,
+	 * so once a thread installed a few hooks generating code no longer allocates anything but the
+	 * section buffer. Borrowing nests, the bridge creates its post stub while it is still being assembled.
+	 */
+	class ScratchCode {
+	public:
+		explicit ScratchCode(const asmjit::JitRuntime& runtime, uint64_t baseAddress = asmjit::Globals::kNoBaseAddress);
+		~ScratchCode();
+		DYNO_NONCOPYABLE(ScratchCode);
+
+		asmjit::CodeHolder& operator*() const {
+			return *m_code;
+		}
+
+		asmjit::CodeHolder* operator->() const {
+			return m_code;
+		}
+
+	private:
+		asmjit::CodeHolder* m_code;
+	};
+}
\ No newline at end of file
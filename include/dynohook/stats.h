@@ -0,0 +1,64 @@
+#pragma once
+
+#include "ihook.h"
+#include "perf_counters.h"
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+namespace dyno {
+	// bucket i counts calls whose pre to post time was below 2^i ns, the last bucket collects everything slower
+	constexpr size_t kLatencyBuckets = 32;
+
+	/**
+	 * Counters updated by the callback dispatcher every time the bridge enters it.
+	 * All updates are relaxed, readers only get a consistent view per counter.
+	 * Every field must be valid when zero filled, forked children start over from zeroed pages in fork mode.
+	 */
+	struct HookStats {
+		std::atomic<uint64_t> calls{ 0 };
+		std::atomic<uint64_t> overrides{ 0 };
+		std::atomic<uint64_t> supercedes{ 0 };
+		std::atomic<uint64_t> latency[kLatencyBuckets]{};
+
+		// hardware counter deltas between the pre and post callback, summed over perfCalls calls
+		std::atomic<uint64_t> perf[kPerfEventCount]{};
+		std::atomic<uint64_t> perfCalls{ 0 };
+	};
+
+	/**
+	 * Counters of one callback handler, only updated while handler profiling is on.
+	 * calls counts every invocation, cycles is summed over the sampledCalls ones only.
+	 */
+	struct HandlerStats {
+		std::atomic<uint64_t> calls{ 0 };
+		std::atomic<uint64_t> sampledCalls{ 0 };
+		std::atomic<uint64_t> cycles{ 0 };
+	};
+
+	/**
+	 * Snapshot of the HandlerStats of one handler registered on one hook.
+	 * The estimated total cost is cycles * calls / sampledCalls.
+	 */
+	struct HandlerProfile {
+		uintptr_t function; // address the hook was created for
+		CallbackType type;
+		uintptr_t handler;
+		std::string symbol; // resolved with dladdr, empty if unknown
+		uint64_t calls;
+		uint64_t sampledCalls;
+		uint64_t cycles; // TSC cycles, or nanoseconds where no cycle counter is available
+	};
+
+	/**
+	 * Calls which returned to one call site of a hooked function, see CallerHistogram.
+	 */
+	struct CallerProfile {
+		uintptr_t function; // address the hook was created for
+		uintptr_t caller; // return address, 0 for the calls of sites which didn't fit the table
+		std::string symbol; // resolved with dladdr, empty if unknown
+		uint64_t calls;
+	};
+}
\ No newline at end of file
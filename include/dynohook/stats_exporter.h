@@ -0,0 +1,98 @@
+#pragma once
+
+#include <dynohook/helpers.h>
+#include <dynohook/stats_layout.h>
+#include <dynohook/detours/install_report.h>
+
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace dyno {
+	class Hook;
+
+	/**
+	 * Publishes the counters of registered hooks into a shared memory segment (see stats_layout.h),
+	 * so a sidecar process can watch them without the host exposing any API of its own.
+	 * Hooks are held weakly, an entry is released once its hook is destroyed.
+	 * Only implemented on linux, start() fails on other platforms.
+	 */
+	class StatsExporter {
+	public:
+		StatsExporter() = default;
+		~StatsExporter();
+		DYNO_NONCOPYABLE(StatsExporter);
+
+		/**
+		 * @brief Creates the segment and starts the background thread which keeps it up to date.
+		 * @param name POSIX shared memory name like "/dynohook", empty to create an anonymous memfd.
+		 * @param interval time between two publishes.
+		 * @param capacity maximum number of hooks in the segment.
+		 * @return false if the segment couldn't be created or the exporter is already running.
+		 */
+		bool start(const std::string& name, std::chrono::milliseconds interval, size_t capacity = 4096);
+
+		/**
+		 * @brief Stops the background thread and unlinks the segment.
+		 */
+		void stop();
+
+		bool isRunning() const;
+
+		/**
+		 * @brief Registers a hook for export, enables its latency tracking while the exporter runs.
+		 * @param address function the hook was created for.
+		 * @param report install metadata of detours, may be null.
+		 */
+		void add(const std::shared_ptr<Hook>& hook, uintptr_t address, const InstallReport* report = nullptr);
+
+		void clear();
+
+		/**
+		 * @brief Copies the counters of every live hook into the segment on the calling thread.
+		 */
+		void publish();
+
+		/**
+		 * @brief Returns the path readers should open, "/dev/shm/<name>" or "/proc/<pid>/fd/<fd>".
+		 */
+		std::string getPath() const;
+
+	private:
+		struct Source {
+			std::weak_ptr<Hook> hook;
+			const Hook* key; // only compared, never dereferenced
+			uintptr_t address;
+			int64_t slot; // entry index in the segment, -1 until published
+			char scheme[shm::kSchemeSize];
+			uint16_t prologueSize;
+			uint16_t trampolineSize;
+			uint64_t installNs;
+		};
+
+		void run();
+		bool map(const std::string& name, size_t capacity);
+		void unmap();
+		shm::Entry* entry(size_t slot) const;
+
+		std::vector<Source> m_sources;
+		std::vector<uint32_t> m_freeSlots;
+		mutable std::mutex m_mutex;
+
+		shm::Header* m_header{ nullptr };
+		size_t m_size{ 0 };
+		int m_fd{ -1 };
+		std::string m_name;
+
+		std::thread m_thread;
+		std::condition_variable m_cv;
+		std::mutex m_cvMutex;
+		std::chrono::milliseconds m_interval{ 1000 };
+		bool m_stop{ false };
+	};
+}
\ No newline at end of file
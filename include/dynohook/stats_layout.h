@@ -0,0 +1,99 @@
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+
+/**
+ * Layout of the shared memory segment written by StatsExporter.
+ * This header is standalone on purpose so out of process readers (see tools/dynohook_top.cpp)
+ * can map the segment without linking against dynohook.
+ *
+ * The segment is one Header followed by Header::capacity entries of Header::entrySize bytes.
+ * Every entry is guarded by its own sequence lock: the writer makes the sequence odd, updates
+ * the fields and makes it even again, a reader retries while the sequence is odd or changed.
+ */
+namespace dyno::shm {
+	constexpr uint32_t kMagic = 0x4B484E44; // "DNHK"
+	constexpr uint32_t kVersion = 1;
+	constexpr size_t kLatencyBuckets = 32;
+	constexpr size_t kSchemeSize = 16;
+
+	struct Header {
+		uint32_t magic;
+		uint32_t version;
+		uint32_t headerSize;
+		uint32_t entrySize;
+		uint32_t capacity;
+		std::atomic<uint32_t> count; // entries in use, including released ones (address == 0)
+		uint64_t pid;
+		std::atomic<uint64_t> updateNs; // steady clock of the writer at the last publish
+		std::atomic<uint64_t> generation; // incremented after every publish
+	};
+
+	struct alignas(64) Entry {
+		std::atomic<uint32_t> sequence;
+		uint8_t mode; // dyno::HookMode
+		uint8_t reserved[3];
+		uint64_t address; // 0 once the hook is gone
+
+		uint64_t calls;
+		uint64_t overrides;
+		uint64_t supercedes;
+		uint64_t latency[kLatencyBuckets]; // bucket i: pre to post time below 2^i ns
+
+		// install metadata, only known for detours
+		char scheme[kSchemeSize];
+		uint16_t prologueSize;
+		uint16_t trampolineSize;
+		uint32_t reserved2;
+		uint64_t installNs;
+	};
+
+	// plain copy of an entry taken by readEntry()
+	struct Snapshot {
+		uint8_t mode;
+		uint64_t address;
+		uint64_t calls;
+		uint64_t overrides;
+		uint64_t supercedes;
+		uint64_t latency[kLatencyBuckets];
+		char scheme[kSchemeSize];
+		uint16_t prologueSize;
+		uint16_t trampolineSize;
+		uint64_t installNs;
+	};
+
+	static_assert(std::atomic<uint32_t>::is_always_lock_free && std::atomic<uint64_t>::is_always_lock_free,
+		"shared memory counters have to be lock free to be usable across processes");
+
+	/**
+	 * @brief Copies an entry out of the segment, retrying while the writer is updating it.
+	 * @return false if the writer kept the entry busy for all attempts.
+	 */
+	inline bool readEntry(const Entry& entry, Snapshot& out, int attempts = 64) {
+		for (int i = 0; i < attempts; i++) {
+			const uint32_t before = entry.sequence.load(std::memory_order_acquire);
+			if (before & 1)
+				continue;
+
+			out.mode = entry.mode;
+			out.address = entry.address;
+			out.calls = entry.calls;
+			out.overrides = entry.overrides;
+			out.supercedes = entry.supercedes;
+			for (size_t j = 0; j < kLatencyBuckets; j++)
+				out.latency[j] = entry.latency[j];
+			for (size_t j = 0; j < kSchemeSize; j++)
+				out.scheme[j] = entry.scheme[j];
+			out.prologueSize = entry.prologueSize;
+			out.trampolineSize = entry.trampolineSize;
+			out.installNs = entry.installNs;
+
+			std::atomic_thread_fence(std::memory_order_acquire);
+			if (entry.sequence.load(std::memory_order_relaxed) == before)
+				return true;
+		}
+		return false;
+	}
+}
\ No newline at end of file
@@ -0,0 +1,41 @@
+#pragma once
+
+#include <dynohook/virtuals/vtable.h>
+
+namespace dyno {
+	/**
+	 * Hook of a single function pointer which is not part of a C++ vtable, like an entry of a C ops struct,
+	 * a callback registry or a dispatch array. The slot is swapped to the bridge of the shared hook of the function
+	 * it points to, the function itself is never patched.
+	 */
+	class FuncSlot final : public MemAccessor {
+	public:
+		FuncSlot(void** slot, std::shared_ptr<VHookCache> cache);
+		~FuncSlot() override;
+		DYNO_NONCOPYABLE(FuncSlot);
+
+		/**
+		 * @brief Swaps the slot to the bridge with a single compare and swap.
+		 * @return nullptr if the slot is empty or was changed by someone else meanwhile.
+		 */
+		std::shared_ptr<Hook> hook(const ConvFunc& convention);
+
+		/**
+		 * @brief Swaps the original function back, unless someone else replaced the bridge in the meantime.
+		 */
+		bool unhook();
+
+		std::shared_ptr<Hook> find() const {
+			return m_hook;
+		}
+
+	private:
+		bool exchange(void* expected, void* desired);
+
+		void** m_slot;
+		void* m_original{ nullptr };
+
+		std::shared_ptr<VHookCache> m_hookCache;
+		std::shared_ptr<Hook> m_hook;
+	};
+}
\ No newline at end of file
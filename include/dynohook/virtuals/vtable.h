@@ -33,16 +33,42 @@ namespace dyno {
 
 		std::shared_ptr<VHookCache> m_hookCache;
 
-		std::unordered_map<int16_t, std::shared_ptr<VHook>> m_hooked;
+		std::unordered_map<int16_t, std::shared_ptr<Hook>> m_hooked;
 	};
 
+	/**
+	 * The hook of every function which is entered through a bridge, keyed by function address.
+	 * Detours register themselves too, so a vtable slot of a detoured function points at the bridge of the detour
+	 * instead of stacking a VHook on top of it, see Detour::setDispatcher() for the other way around.
+	 */
 	class VHookCache {
 	public:
-		std::shared_ptr<VHook> get(void* pFunc, const ConvFunc& convention);
+		/**
+		 * @brief Returns the hook of the function, a new VHook if there is none yet.
+		 */
+		std::shared_ptr<Hook> get(void* pFunc, const ConvFunc& convention);
+
+		/**
+		 * @brief Returns the hook of the function, nullptr if there is none.
+		 */
+		std::shared_ptr<Hook> find(void* pFunc) const;
+
+		/**
+		 * @brief Registers the hook of a function which has none yet.
+		 */
+		void add(void* pFunc, std::shared_ptr<Hook> hook);
+
+		/**
+		 * @brief Drops the hook of the function if nothing but the cache holds it anymore.
+		 */
+		void release(void* pFunc);
+
 		void clear();
 		void cleanup();
 
+		std::vector<std::pair<void*, std::shared_ptr<Hook>>> getHooks() const;
+
 	private:
-		std::unordered_map<void*, std::shared_ptr<VHook>> m_hooked;
+		std::unordered_map<void*, std::shared_ptr<Hook>> m_hooked;
 	};
 }
\ No newline at end of file
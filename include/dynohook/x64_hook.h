@@ -8,13 +8,13 @@ namespace dyno {
 		explicit x64Hook(const ConvFunc& convention);
 		~x64Hook() override = default;
 
+		uintptr_t createExitStub(const std::vector<uint8_t>& prefix, uint16_t retImm) override;
+
 	protected:
 		bool createBridge() override;
 		bool createPostCallback() override;
 		void writeModifyReturnAddress(Assembler& a) override;
 		void writeCallHandler(Assembler& a, CallbackType type) const override;
-		int32_t writeSaveScratchRegisters(Assembler& a) const override;
-		void writeRestoreScratchRegisters(Assembler& a) const override;
 		void writeSaveRegisters(Assembler& a, bool post) const override;
 		void writeRestoreRegisters(Assembler& a, bool post) const override;
 		void writeRegToMem(Assembler& a, const Register& reg, bool post) const override;
@@ -8,19 +8,16 @@ namespace dyno {
 		explicit x86Hook(const ConvFunc& convention);
 		~x86Hook() override = default;
 
+		uintptr_t createExitStub(const std::vector<uint8_t>& prefix, uint16_t retImm) override;
+
 	protected:
 		bool createBridge() override;
 		bool createPostCallback() override;
 		void writeModifyReturnAddress(Assembler& a) override;
 		void writeCallHandler(Assembler& a, CallbackType type) const override;
-		int32_t writeSaveScratchRegisters(Assembler& a) const override;
-		void writeRestoreScratchRegisters(Assembler& a) const override;
 		void writeSaveRegisters(Assembler& a, bool post) const override;
 		void writeRestoreRegisters(Assembler& a, bool post) const override;
 		void writeRegToMem(Assembler& a, const Register& reg, bool post) const override;
 		void writeMemToReg(Assembler& a, const Register& reg, bool post) const override;
-
-	private:
-		Registers m_scratchRegisters;
 	};
 }
\ No newline at end of file
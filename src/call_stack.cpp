@@ -0,0 +1,95 @@
+#include <dynohook/call_stack.h>
+#include <dynohook/fork_guard.h>
+
+using namespace dyno;
+
+std::atomic<ContextProvider> CallStack::s_provider{ nullptr };
+
+CallStack::~CallStack() {
+	for (CallFrame* chunk : m_chunks)
+		ForkGuard::freeHot(chunk);
+	for (uint8_t* chunk : m_byteChunks)
+		ForkGuard::freeHot(chunk);
+}
+
+CallFrame* CallStack::push(const void* hook) {
+	const size_t chunk = m_depth / kFramesPerChunk;
+	if (chunk >= kMaxChunks)
+		return nullptr;
+
+	if (!m_chunks[chunk])
+		m_chunks[chunk] = (CallFrame*) ForkGuard::allocateHot(sizeof(CallFrame) * kFramesPerChunk);
+
+	CallFrame& frame = at(m_depth++);
+	frame.hook = hook;
+	frame.bytesMark = m_bytesTop;
+	return &frame;
+}
+
+CallFrame* CallStack::find(const void* hook, void* stackPtr) {
+	for (size_t i = m_depth; i > 0; i--) {
+		CallFrame& frame = at(i - 1);
+		if (frame.hook == hook && frame.stackPtr == stackPtr)
+			return &frame;
+	}
+	return nullptr;
+}
+
+size_t CallStack::count(const void* hook) {
+	size_t count = 0;
+	for (size_t i = 0; i < m_depth; i++) {
+		if (at(i).hook == hook)
+			count++;
+	}
+	return count;
+}
+
+bool CallStack::pop(const void* hook, void* stackPtr, CallFrame& out) {
+	for (size_t i = m_depth; i > 0; i--) {
+		CallFrame& frame = at(i - 1);
+		if (frame.hook == hook && frame.stackPtr == stackPtr) {
+			out = frame;
+			m_depth = i - 1;
+			m_bytesTop = frame.bytesMark;
+			return true;
+		}
+	}
+	return false;
+}
+
+uint8_t* CallStack::allocate(size_t size) {
+	size = (size + 15) & ~size_t(15);
+	if (size > kBytesPerChunk)
+		return nullptr;
+
+	// allocations never straddle two chunks
+	size_t offset = m_bytesTop % kBytesPerChunk;
+	if (offset + size > kBytesPerChunk) {
+		m_bytesTop += kBytesPerChunk - offset;
+		offset = 0;
+	}
+
+	const size_t chunk = m_bytesTop / kBytesPerChunk;
+	if (chunk >= kMaxByteChunks)
+		return nullptr;
+
+	if (!m_byteChunks[chunk])
+		m_byteChunks[chunk] = (uint8_t*) ForkGuard::allocateHot(kBytesPerChunk);
+
+	m_bytesTop += size;
+	return m_byteChunks[chunk] + offset;
+}
+
+CallStack& CallStack::current() {
+	if (ContextProvider provider = s_provider.load(std::memory_order_relaxed)) {
+		if (CallStack* stack = provider())
+			return *stack;
+	}
+
+	thread_local CallStack stack;
+	return stack;
+}
+
+void CallStack::setProvider(ContextProvider provider) {
+	s_provider.store(provider, std::memory_order_relaxed);
+}
\ No newline at end of file
@@ -0,0 +1,38 @@
+#include <dynohook/caller_histogram.h>
+
+using namespace dyno;
+
+void CallerHistogram::record(uintptr_t retAddr) {
+	if (!retAddr)
+		return;
+
+	// fibonacci hashing, return addresses of one module mostly differ in the low bits
+	size_t index = (size_t) (((uint64_t) retAddr * 0x9E3779B97F4A7C15ull) >> 32) & (kSlots - 1);
+
+	for (size_t probe = 0; probe < kMaxProbes; probe++) {
+		Slot& slot = m_slots[(index + probe) & (kSlots - 1)];
+
+		uintptr_t address = slot.address.load(std::memory_order_relaxed);
+		if (address == 0 && slot.address.compare_exchange_strong(address, retAddr, std::memory_order_relaxed))
+			address = retAddr;
+
+		if (address == retAddr) {
+			slot.count.fetch_add(1, std::memory_order_relaxed);
+			return;
+		}
+	}
+
+	m_dropped.fetch_add(1, std::memory_order_relaxed);
+}
+
+std::vector<std::pair<uintptr_t, uint64_t>> CallerHistogram::getCallers() const {
+	std::vector<std::pair<uintptr_t, uint64_t>> callers;
+	for (const Slot& slot : m_slots) {
+		const uintptr_t address = slot.address.load(std::memory_order_relaxed);
+		const uint64_t count = slot.count.load(std::memory_order_relaxed);
+		// a slot can be claimed before its first count lands
+		if (address != 0 && count != 0)
+			callers.emplace_back(address, count);
+	}
+	return callers;
+}
\ No newline at end of file
@@ -1,5 +1,6 @@
 #include <dynohook/convention.h>
 
+#include <algorithm>
 #include <cstring>
 
 using namespace dyno;
@@ -30,38 +31,102 @@ void ICallingConvention::init() {
 		m_return.size = static_cast<uint16_t>(getDataTypeSize(m_return.type, m_alignment));
 }
 
-void ICallingConvention::saveReturnValue(const Registers& registers) {
-	std::unique_ptr<uint8_t[]> savedReturnValue = std::make_unique<uint8_t[]>(m_return.size);
-	std::memcpy(savedReturnValue.get(), getReturnPtr(registers), m_return.size);
-	m_savedReturnBuffers.push_back(std::move(savedReturnValue));
+namespace {
+	// addresses of all arguments of one call, on the stack for the usual argument counts
+	class ArgumentPtrs {
+	public:
+		ArgumentPtrs(ICallingConvention& convention, const Registers& registers, size_t count) : m_ptrs{m_inline} {
+			if (count > kInline) {
+				m_heap = std::make_unique<void*[]>(count);
+				m_ptrs = m_heap.get();
+			}
+			convention.getArgumentPtrs(registers, m_ptrs, count);
+		}
+
+		void* operator[](size_t index) const {
+			return m_ptrs[index];
+		}
+
+		void* const* data() const {
+			return m_ptrs;
+		}
+
+	private:
+		static constexpr size_t kInline = 16;
+
+		void* m_inline[kInline];
+		std::unique_ptr<void*[]> m_heap;
+		void** m_ptrs;
+	};
+}
+
+size_t ICallingConvention::getArgumentPtrs(const Registers& registers, void** ptrs, size_t count) {
+	count = std::min(count, m_arguments.size());
+	for (size_t i = 0; i < count; i++)
+		ptrs[i] = getArgumentPtr(i, registers);
+	return count;
+}
+
+size_t ICallingConvention::walkArgumentPtrs(const Registers& registers, void** ptrs, size_t count, size_t homedRegisters) {
+	count = std::min(count, m_arguments.size());
+
+	uintptr_t stack = (uintptr_t) getStackArgumentPtr(registers);
+	for (size_t i = 0; i < count; i++) {
+		const auto& [type, reg, size] = m_arguments[i];
+		if (reg != NONE) {
+			ptrs[i] = *registers[reg];
+			if (i < homedRegisters)
+				stack += m_alignment;
+		} else {
+			ptrs[i] = (void*) stack;
+			stack += size;
+		}
+	}
+
+	return count;
 }
 
-void ICallingConvention::restoreReturnValue(const Registers& registers) {
-	uint8_t* savedReturnValue = m_savedReturnBuffers.back().get();
-	std::memcpy(getReturnPtr(registers), savedReturnValue, m_return.size);
-	onReturnPtrChanged(registers, savedReturnValue);
-	m_savedReturnBuffers.pop_back();
+void ICallingConvention::onArgumentPtrsChanged(const Registers& registers, void* const* ptrs, size_t count) {
+	for (size_t i = 0; i < count; i++)
+		onArgumentPtrChanged(i, registers, ptrs[i]);
+}
+
+void ICallingConvention::saveReturnValue(const Registers& registers, uint8_t* buffer) {
+	std::memcpy(buffer, getReturnPtr(registers), m_return.size);
+}
+
+void ICallingConvention::restoreReturnValue(const Registers& registers, uint8_t* buffer) {
+	std::memcpy(getReturnPtr(registers), buffer, m_return.size);
+	onReturnPtrChanged(registers, buffer);
+}
+
+void ICallingConvention::saveCallArguments(const Registers& registers, uint8_t* buffer) {
+	ArgumentPtrs ptrs(*this, registers, m_arguments.size());
+	size_t offset = 0;
+	for (size_t i = 0; i < m_arguments.size(); i++) {
+		size_t size = m_arguments[i].size;
+		std::memcpy(buffer + offset, ptrs[i], size);
+		offset += size;
+	}
 }
 
-void ICallingConvention::saveCallArguments(const Registers& registers) {
-	size_t argTotalSize = getArgStackSize() + getArgRegisterSize();
-	std::unique_ptr<uint8_t[]> savedCallArguments = std::make_unique<uint8_t[]>(argTotalSize);
+void ICallingConvention::restoreCallArguments(const Registers& registers, const uint8_t* buffer) {
+	ArgumentPtrs ptrs(*this, registers, m_arguments.size());
 	size_t offset = 0;
 	for (size_t i = 0; i < m_arguments.size(); i++) {
 		size_t size = m_arguments[i].size;
-		std::memcpy(savedCallArguments.get() + offset, getArgumentPtr(i, registers), size);
+		std::memcpy(ptrs[i], buffer + offset, size);
 		offset += size;
 	}
-	m_savedCallArguments.push_back(std::move(savedCallArguments));
 }
 
-void ICallingConvention::restoreCallArguments(const Registers& registers) {
-	uint8_t* savedCallArguments = m_savedCallArguments.back().get();
+void ICallingConvention::writeCallArguments(const Registers& registers, const uint8_t* buffer) {
+	ArgumentPtrs ptrs(*this, registers, m_arguments.size());
 	size_t offset = 0;
 	for (size_t i = 0; i < m_arguments.size(); i++) {
 		size_t size = m_arguments[i].size;
-		std::memcpy(getArgumentPtr(i, registers), (savedCallArguments + offset), size);
+		std::memcpy(ptrs[i], buffer + offset, size);
 		offset += size;
 	}
-	m_savedCallArguments.pop_back();
+	onArgumentPtrsChanged(registers, ptrs.data(), m_arguments.size());
 }
@@ -91,6 +91,10 @@ void* x64SystemVcall::getArgumentPtr(size_t index, const Registers& registers) {
 	return (void*) (registers[RSP].getValue<uintptr_t>() + offset);
 }
 
+size_t x64SystemVcall::getArgumentPtrs(const Registers& registers, void** ptrs, size_t count) {
+	return walkArgumentPtrs(registers, ptrs, count);
+}
+
 void x64SystemVcall::onArgumentPtrChanged(size_t index, const Registers& registers, void* argumentPtr) {
 	DYNO_UNUSED(index);
 	DYNO_UNUSED(registers);
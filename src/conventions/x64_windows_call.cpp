@@ -1,5 +1,7 @@
 #include <dynohook/conventions/x64_windows_call.h>
 
+#include <algorithm>
+
 using namespace dyno;
 
 x64WindowsCall::x64WindowsCall(std::vector<DataObject> arguments, DataObject returnType, size_t alignment) :
@@ -72,6 +74,11 @@ void* x64WindowsCall::getArgumentPtr(size_t index, const Registers& registers) {
 	return (void*) (registers[RSP].getValue<uintptr_t>() + offset);
 }
 
+size_t x64WindowsCall::getArgumentPtrs(const Registers& registers, void** ptrs, size_t count) {
+	// the four register arguments keep their slot in the shadow space
+	return walkArgumentPtrs(registers, ptrs, count, 4);
+}
+
 void x64WindowsCall::onArgumentPtrChanged(size_t index, const Registers& registers, void* argumentPtr) {
 	DYNO_UNUSED(index);
 	DYNO_UNUSED(registers);
@@ -72,6 +72,10 @@ void* x86MsCdecl::getArgumentPtr(size_t index, const Registers& registers) {
 	return (void*) (registers[ESP].getValue<uintptr_t>() + offset);
 }
 
+size_t x86MsCdecl::getArgumentPtrs(const Registers& registers, void** ptrs, size_t count) {
+	return walkArgumentPtrs(registers, ptrs, count);
+}
+
 void x86MsCdecl::onArgumentPtrChanged(size_t index, const Registers& registers, void* argumentPtr) {
 	DYNO_UNUSED(index);
 	DYNO_UNUSED(registers);
@@ -1,4 +1,6 @@
 #include <dynohook/detours/detour.h>
+#include <dynohook/detours/prologue_cache.h>
+#include <dynohook/fork_guard.h>
 #include <dynohook/log.h>
 
 #include <cmath>
@@ -33,13 +35,13 @@ std::optional<insts_t> Detour::calcNearestSz(
 		uintptr_t& prolOvrwEndOffset
 ) {
 	uintptr_t prolLen = 0;
-	insts_t instructionsInRange;
+	size_t count = 0;
 
 	// count instructions until at least length needed or func end
 	bool endHit = false;
 	for (const auto& inst: functionInsts) {
 		prolLen += inst.size();
-		instructionsInRange.push_back(inst);
+		count++;
 
 		// only safe to overwrite pad bytes once end is hit
 		if (endHit && !ZydisDisassembler::isPadBytes(inst))
@@ -54,7 +56,7 @@ std::optional<insts_t> Detour::calcNearestSz(
 
 	prolOvrwEndOffset = prolLen;
 	if (prolLen >= prolOvrwStartOffset) {
-		return instructionsInRange;
+		return insts_t(functionInsts.begin(), functionInsts.begin() + (ptrdiff_t) count);
 	}
 
 	return std::nullopt;
@@ -91,6 +93,9 @@ bool Detour::followJmp(insts_t& functionInsts, uint8_t curDepth) { // NOLINT(mis
 	}
 
 	uintptr_t dest = functionInsts.front().getDestination();
+
+	// the jmp we just followed may point into the window of the next function, it must not expand its prologue
+	m_disasm.clearBranchMap();
 	functionInsts = m_disasm.disassemble(dest, dest, dest + 100, *this);
 	return followJmp(functionInsts, curDepth + 1); // recurse
 }
@@ -100,15 +105,12 @@ bool Detour::expandProlSelfJmps(insts_t& prol, const insts_t& func, uintptr_t& m
 	const uintptr_t prolStart = prol.front().getAddress();
 	const branch_map_t& branchMap = m_disasm.getBranchMap();
 	for (size_t i = 0; i < prol.size(); i++) {
-		auto inst = prol.at(i);
-
 		// is there a jump pointing at the current instruction?
-		if (branchMap.find(inst.getAddress()) == branchMap.end())
+		const auto srcs = branchMap.find(prol[i].getAddress());
+		if (srcs == branchMap.end())
 			continue;
 
-		insts_t srcs = branchMap.at(inst.getAddress());
-
-		for (const auto& src : srcs) {
+		for (const auto& src : srcs->second) {
 			const uintptr_t srcEndAddr = src.getAddress() + src.size();
 			if (srcEndAddr > maxAddr)
 				maxAddr = srcEndAddr;
@@ -121,12 +123,162 @@ bool Detour::expandProlSelfJmps(insts_t& prol, const insts_t& func, uintptr_t& m
 		if (!prolOpt) {
 			return false;
 		}
-		prol = *prolOpt; // False flag: LocalValueEscapesScope
+		prol = std::move(*prolOpt);
 	}
 
 	return true;
 }
 
+namespace {
+	// calcNearestSz() on the shapes of a scan, returns the number of instructions
+	std::optional<size_t> calcNearestShapes(const std::vector<InstShape>& shapes, uintptr_t minSz, uintptr_t& roundedSz) {
+		uintptr_t prolLen = 0;
+		size_t count = 0;
+
+		bool endHit = false;
+		for (const auto& shape : shapes) {
+			prolLen += shape.length;
+			count++;
+
+			if (endHit && !shape.pad)
+				break;
+
+			if (shape.funcEnd)
+				endHit = true;
+
+			if (prolLen >= minSz)
+				break;
+		}
+
+		roundedSz = prolLen;
+		if (prolLen >= minSz)
+			return count;
+
+		return std::nullopt;
+	}
+
+	// expandProlSelfJmps() on the shapes of a scan, sizes are offsets from start
+	bool expandShapes(const std::vector<InstShape>& shapes, uintptr_t start, size_t& count, uintptr_t& minSz, uintptr_t& roundedSz) {
+		uintptr_t maxEnd = 0;
+		for (size_t i = 0; i < count; i++) {
+			const uintptr_t address = start + shapes[i].offset;
+
+			bool pointedAt = false;
+			for (const auto& src : shapes) {
+				if (src.branching && src.destination == address) {
+					maxEnd = std::max<uintptr_t>(maxEnd, src.offset + src.length);
+					pointedAt = true;
+				}
+			}
+
+			if (!pointedAt)
+				continue;
+
+			minSz = maxEnd;
+
+			const auto countOpt = calcNearestShapes(shapes, minSz, roundedSz);
+			if (!countOpt)
+				return false;
+			count = *countOpt;
+		}
+
+		return true;
+	}
+}
+
+bool Detour::findPrologue(
+		const std::vector<uint8_t>& scanBytes,
+		const std::vector<InstShape>& shapes,
+		insts_t& insts,
+		uintptr_t& minProlSz,
+		uintptr_t& roundProlSz,
+		insts_t& prologue
+) {
+	std::string key;
+	uintptr_t shapeMinSz = minProlSz;
+	uintptr_t shapeRoundSz = minProlSz;
+	size_t count = 0;
+
+	if (!shapes.empty()) {
+		PhaseTimer timer(m_installReport.relocationNs);
+		auto countOpt = calcNearestShapes(shapes, shapeMinSz, shapeRoundSz);
+		if (countOpt && expandShapes(shapes, m_fnAddress, *countOpt, shapeMinSz, shapeRoundSz)) {
+			count = *countOpt;
+			key = PrologueCache::makeKey(getArchType(), scanBytes, shapes, count);
+		}
+	}
+
+	if (!key.empty() && PrologueCache::get().find(key, prologue)) {
+		PhaseTimer timer(m_installReport.relocationNs);
+		assert(prologue.size() == count);
+
+		const uintptr_t base = prologue.front().getAddress();
+		bool decoded = true;
+		for (size_t i = 0; i < count && decoded; i++) {
+			Instruction& inst = prologue[i];
+			const uintptr_t address = m_fnAddress + (inst.getAddress() - base);
+
+			if (shapes[i].relSize == 0) {
+				inst.setAddress(address);
+				inst.setAccessor(this);
+				continue;
+			}
+
+			// operands pointing somewhere differ between functions of the same shape, decode those again
+			insts_t single = m_disasm.disassemble(address, scanBytes.data() + shapes[i].offset, shapes[i].length, *this, false);
+			decoded = single.size() == 1;
+			if (decoded)
+				inst = std::move(single.front());
+		}
+
+		if (decoded) {
+			minProlSz = shapeMinSz;
+			roundProlSz = shapeRoundSz;
+			m_installReport.prologueCached = true;
+			return true;
+		}
+
+		prologue.clear();
+	}
+
+	if (insts.empty()) {
+		PhaseTimer timer(m_installReport.disassemblyNs);
+		insts = m_disasm.disassemble(m_fnAddress, scanBytes, *this);
+		DYNO_LOG_INFO("Original function:\n" + instsToStr(insts) + "\n");
+	}
+
+	if (insts.empty()) {
+		DYNO_LOG_ERR("Disassembler unable to decode any valid instructions");
+		m_installReport.failure = "disassembly";
+		return false;
+	}
+
+	PhaseTimer timer(m_installReport.relocationNs);
+
+	// find the prologue section we will overwrite with jmp + zero or more nops
+	auto prologueOpt = calcNearestSz(insts, minProlSz, roundProlSz);
+	if (!prologueOpt) {
+		DYNO_LOG_ERR("Function too small to hook safely!");
+		m_installReport.failure = "prologue";
+		return false;
+	}
+
+	assert(roundProlSz >= minProlSz);
+	prologue = *prologueOpt;
+
+	if (!expandProlSelfJmps(prologue, insts, minProlSz, roundProlSz)) {
+		DYNO_LOG_ERR("Function needs a prologue jmp table but it's too small to insert one");
+		m_installReport.failure = "prologue";
+		return false;
+	}
+
+	// the next function of this shape trusts the plan of the scan, so only cache it where both agree
+	if (!key.empty() && prologue.size() == count && minProlSz == shapeMinSz && roundProlSz == shapeRoundSz)
+		PrologueCache::get().add(key, prologue);
+
+	return true;
+}
+
 void Detour::buildRelocationList(
 		insts_t& prologue,
 		uintptr_t roundProlSz,
@@ -192,11 +344,22 @@ bool Detour::unhook() {
 		return false;
 	}
 
-	MemProtector prot(m_fnAddress, calcInstsSz(m_originalInsts), ProtFlag::R | ProtFlag::W | ProtFlag::X, *this);
-	writeEncoding(m_originalInsts);
+	ForkGuard::InstallScope scope;
+
+	{
+		MemProtector prot(m_fnAddress, calcInstsSz(m_originalInsts), ProtFlag::R | ProtFlag::W | ProtFlag::X, *this);
+		writeEncoding(m_originalInsts);
+	}
+
+	restoreExitSites();
+
+	// vtable slots may still enter the bridge, from now on it leads to the restored function instead of the trampoline
+	getDispatchHook().setContinuation(m_fnAddress);
+
+	ForkGuard::removeCode(this);
 
 	if (m_trampoline != 0) {
-		delete[](uint8_t*) m_trampoline;
+		freeTrampoline(m_trampoline);
 		m_trampoline = 0;
 	}
 
@@ -204,6 +367,183 @@ bool Detour::unhook() {
 	return true;
 }
 
+bool Detour::attachBridge() {
+	if (m_dispatcher) {
+		m_fnBridge = m_dispatcher->getBridge();
+		if (!m_fnBridge) {
+			DYNO_LOG_ERR("Dispatcher has no bridge");
+			return false;
+		}
+	} else if (!createBridge()) {
+		return false;
+	}
+
+	if (m_trampoline)
+		getDispatchHook().setContinuation(m_trampoline);
+	return true;
+}
+
+size_t Detour::patchExitSites(uintptr_t prologueEnd) {
+	const insts_t func = m_disasm.disassembleFunction(m_fnAddress, kMaxExitScan, *this);
+	if (func.empty()) {
+		DYNO_LOG_INFO("Exit sites: end of function not found, post callbacks use the return address");
+		return 0;
+	}
+
+	const uintptr_t funcEnd = func.back().getAddress() + func.back().size();
+
+	std::vector<uintptr_t> targets;
+	std::vector<size_t> rets;
+	for (size_t i = 0; i < func.size(); i++) {
+		const Instruction& inst = func[i];
+		if (inst.getMnemonic() == "ret") {
+			rets.push_back(i);
+			continue;
+		}
+
+		if (!inst.isBranching() || inst.isCalling())
+			continue;
+
+		// jmp tables and tail jmps leave the function without passing a ret site
+		if (inst.isIndirect() || !inst.hasDisplacement() || !inst.isDisplacementRelative()) {
+			DYNO_LOG_INFO("Exit sites: indirect jmp at " + int_to_hex(inst.getAddress()) + ", post callbacks use the return address");
+			return 0;
+		}
+
+		const uintptr_t destination = inst.getDestination();
+		if (destination < m_fnAddress || destination >= funcEnd) {
+			DYNO_LOG_INFO("Exit sites: jmp out of the function at " + int_to_hex(inst.getAddress()) + ", post callbacks use the return address");
+			return 0;
+		}
+
+		targets.push_back(destination);
+	}
+
+	if (rets.empty() || rets.size() > kMaxExitSites) {
+		DYNO_LOG_INFO("Exit sites: " + std::to_string(rets.size()) + " rets, post callbacks use the return address");
+		return 0;
+	}
+
+	const auto isTarget = [&](const Instruction& inst) {
+		return std::find(targets.begin(), targets.end(), inst.getAddress()) != targets.end();
+	};
+
+	const auto isPadding = [](const Instruction& inst) {
+		return ZydisDisassembler::isPadBytes(inst) || (inst.size() == 1 && inst.getBytes()[0] == 0xCC);
+	};
+
+	// plan every site before touching any of them
+	constexpr size_t jmpSize = 5;
+	std::vector<ExitSite> sites;
+	size_t previousLast = 0;
+	for (const size_t ret : rets) {
+		size_t first = ret;
+		size_t last = ret;
+		size_t size = func[ret].size();
+
+		// padding behind a ret is never executed, unless something jumps there
+		while (size < jmpSize && last + 1 < func.size() && isPadding(func[last + 1]) && !isTarget(func[last + 1])) {
+			size += func[++last].size();
+		}
+
+		// otherwise the instructions in front of it move into the stub, no branch may land between them
+		while (size < jmpSize) {
+			if (first == 0 || isTarget(func[first]))
+				break;
+
+			const Instruction& previous = func[first - 1];
+			if (previous.isBranching() || previous.getMnemonic() == "ret" || (previous.hasDisplacement() && previous.isDisplacementRelative()))
+				break;
+
+			size += previous.size();
+			first--;
+		}
+
+		if (size < jmpSize || func[first].getAddress() < prologueEnd || (!sites.empty() && first <= previousLast)) {
+			DYNO_LOG_INFO("Exit sites: no room at the ret at " + int_to_hex(func[ret].getAddress()) + ", post callbacks use the return address");
+			return 0;
+		}
+
+		ExitSite site;
+		site.originalInsts.assign(func.begin() + (ptrdiff_t) first, func.begin() + (ptrdiff_t) last + 1);
+		for (size_t i = first; i < ret; i++) {
+			const auto& bytes = func[i].getBytes();
+			site.prefix.insert(site.prefix.end(), bytes.begin(), bytes.end());
+		}
+		site.retImm = func[ret].hasImmediate() ? (uint16_t) func[ret].getImmediate() : 0;
+		site.size = (uint16_t) size;
+
+		sites.push_back(std::move(site));
+		previousLast = last;
+	}
+
+	// every site has room, only now the stubs are generated
+	Hook& dispatchHook = getDispatchHook();
+	for (size_t i = 0; i < sites.size(); i++) {
+		ExitSite& site = sites[i];
+		const uintptr_t address = site.originalInsts.front().getAddress();
+
+		site.stub = dispatchHook.createExitStub(site.prefix, site.retImm);
+		if (site.stub)
+			site.patchInsts = makeExitJmp(address, site.stub);
+
+		if (site.patchInsts.empty()) {
+			// nothing jumps to the stubs made so far
+			for (size_t j = 0; j <= i; j++)
+				dispatchHook.releaseExitStub(sites[j].stub);
+			return 0;
+		}
+
+		const uint16_t jmpEnd = calcInstsSz(site.patchInsts);
+		const auto nops = make_nops(address + jmpEnd, (uint16_t) (site.size - jmpEnd));
+		site.patchInsts.insert(site.patchInsts.end(), nops.begin(), nops.end());
+	}
+
+	// no call is redirected from now on, calls redirected before skip the post callbacks in the stubs
+	getDispatchHook().setExitPatched(true);
+
+	for (const auto& site : sites) {
+		MemProtector prot(site.originalInsts.front().getAddress(), calcInstsSz(site.originalInsts), ProtFlag::RWX, *this);
+		writeEncoding(site.patchInsts);
+	}
+
+	m_exitSites = std::move(sites);
+	DYNO_LOG_INFO("Exit sites: " + std::to_string(m_exitSites.size()) + " patched");
+	return m_exitSites.size();
+}
+
+void Detour::restoreExitSites() {
+	if (m_exitSites.empty())
+		return;
+
+	// calls still inside the function return without their post callbacks, their frames are dropped by later returns
+	getDispatchHook().setExitPatched(false);
+
+	for (const auto& site : m_exitSites) {
+		MemProtector prot(site.originalInsts.front().getAddress(), calcInstsSz(site.originalInsts), ProtFlag::R | ProtFlag::W | ProtFlag::X, *this);
+		writeEncoding(site.originalInsts);
+	}
+
+	m_exitSites.clear();
+}
+
+insts_t Detour::makeExitJmp(uintptr_t address, uintptr_t stub) {
+	return makex86Jmp(address, stub);
+}
+
+void Detour::registerCode() {
+	NatHook::registerCode();
+	ForkGuard::addCode(this, m_trampoline, m_trampolineSz);
+}
+
+uintptr_t Detour::allocateTrampoline(uint16_t size) {
+	return (uintptr_t) ForkGuard::allocateCode(size);
+}
+
+void Detour::freeTrampoline(uintptr_t trampoline) {
+	ForkGuard::freeCode((void*) trampoline);
+}
+
 bool Detour::rehook() {
 	MemProtector prot(m_fnAddress, m_hookSize, ProtFlag::RWX, *this);
 	writeEncoding(m_hookInsts);
@@ -220,6 +560,13 @@ bool Detour::rehook() {
 	return true;
 }
 
+insts_t Detour::getPatchInsts() const {
+	insts_t insts = m_hookInsts;
+	const auto nops = make_nops(m_fnAddress + m_nopProlOffset, m_nopSize);
+	insts.insert(insts.end(), nops.begin(), nops.end());
+	return insts;
+}
+
 insts_t Detour::make_nops(uintptr_t address, uint16_t size) const {
 	if (size < 1) {
 		return {};
@@ -227,8 +574,8 @@ insts_t Detour::make_nops(uintptr_t address, uint16_t size) const {
 
 	const uint8_t max_nop_size = 9;
 
-	const auto make_nop_inst = [&](std::vector<uint8_t>&& bytes) {
-		return Instruction(this, address, {0}, 0, false, false, std::move(bytes), "nop", "", getArchType());
+	const auto make_nop_inst = [&](Instruction::Bytes bytes) {
+		return Instruction(this, address, {0}, 0, false, false, bytes, "nop", "", getArchType());
 	};
 
 	// lambda updates the address for each created instruction
@@ -0,0 +1,58 @@
+#include <dynohook/detours/prologue_cache.h>
+
+#include <algorithm>
+
+using namespace dyno;
+
+PrologueCache& PrologueCache::get() {
+	static PrologueCache s_cache;
+	return s_cache;
+}
+
+std::string PrologueCache::makeKey(Mode mode, const std::vector<uint8_t>& bytes, const std::vector<InstShape>& shapes, size_t count) {
+	std::string key;
+	key.push_back((char) mode);
+
+	for (size_t i = 0; i < count; i++) {
+		const InstShape& shape = shapes[i];
+		const size_t begin = key.size();
+		key.append((const char*) bytes.data() + shape.offset, shape.length);
+
+		// the displacement decides where the operand points, not how the instruction decodes
+		std::fill_n(key.begin() + (std::ptrdiff_t) (begin + shape.relOffset), shape.relSize, '\0');
+	}
+
+	return key;
+}
+
+bool PrologueCache::find(const std::string& key, insts_t& prologue) {
+	std::lock_guard<std::mutex> lock(m_mutex);
+	auto it = m_entries.find(key);
+	if (it == m_entries.end()) {
+		m_misses.fetch_add(1, std::memory_order_relaxed);
+		return false;
+	}
+
+	m_hits.fetch_add(1, std::memory_order_relaxed);
+	prologue = it->second;
+	return true;
+}
+
+void PrologueCache::add(const std::string& key, const insts_t& prologue) {
+	std::lock_guard<std::mutex> lock(m_mutex);
+	if (m_entries.size() >= kMaxEntries)
+		return;
+
+	auto [it, inserted] = m_entries.emplace(key, prologue);
+	if (!inserted)
+		return;
+
+	// entries outlive the detour which decoded them
+	for (auto& inst : it->second)
+		inst.setAccessor(nullptr);
+}
+
+void PrologueCache::clear() {
+	std::lock_guard<std::mutex> lock(m_mutex);
+	m_entries.clear();
+}
\ No newline at end of file
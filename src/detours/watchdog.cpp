@@ -0,0 +1,250 @@
+#include <dynohook/detours/watchdog.h>
+#include <dynohook/detours/detour.h>
+#include <dynohook/os.h>
+
+#if DYNO_PLATFORM_LINUX
+#include <pthread.h>
+#include <sched.h>
+#include <sys/resource.h>
+#endif
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#include <emmintrin.h>
+#define DYNO_WATCHDOG_SSE2 1
+#endif
+
+using namespace dyno;
+
+namespace {
+	// smallest page size of every supported platform, a load which does not cross it cannot fault
+	constexpr uintptr_t kMinPageSize = 0x1000;
+
+	void lowerThreadPriority() {
+#if DYNO_PLATFORM_WINDOWS
+		SetThreadPriority(GetCurrentThread(), THREAD_PRIORITY_LOWEST);
+#elif DYNO_PLATFORM_LINUX
+		sched_param param{};
+		if (pthread_setschedparam(pthread_self(), SCHED_IDLE, &param) != 0)
+			setpriority(PRIO_PROCESS, 0, 19); // only affects the calling thread on linux
+#endif
+	}
+}
+
+Watchdog::~Watchdog() {
+	stop();
+}
+
+bool Watchdog::start(std::chrono::milliseconds interval, uint32_t maxRepairsPerSweep) {
+	if (m_thread.joinable()) {
+		DYNO_LOG_WARN("Watchdog is already running");
+		return false;
+	}
+
+	m_interval = interval;
+	m_maxRepairs = maxRepairsPerSweep;
+	m_stop = false;
+	m_thread = std::thread(&Watchdog::run, this);
+	return true;
+}
+
+void Watchdog::stop() {
+	if (!m_thread.joinable())
+		return;
+
+	{
+		std::lock_guard<std::mutex> lock(m_cvMutex);
+		m_stop = true;
+	}
+	m_cv.notify_all();
+	m_thread.join();
+}
+
+bool Watchdog::isRunning() const {
+	return m_thread.joinable();
+}
+
+void Watchdog::run() {
+	lowerThreadPriority();
+
+	std::unique_lock<std::mutex> lock(m_cvMutex);
+	while (!m_cv.wait_for(lock, m_interval, [this] { return m_stop; })) {
+		lock.unlock();
+		sweep();
+		lock.lock();
+	}
+}
+
+void Watchdog::add(const std::shared_ptr<Detour>& detour) {
+	if (!detour || !detour->isHooked())
+		return;
+
+	insts_t insts = detour->getPatchInsts();
+
+	std::lock_guard<std::mutex> lock(m_mutex);
+
+	auto owner = (uint32_t) m_owners.size();
+	m_owners.push_back({detour});
+
+	// merge adjacent instructions into contiguous runs so each run costs as few compares as possible
+	std::vector<uint8_t> run;
+	uintptr_t runStart = 0;
+	for (const auto& inst : insts) {
+		if (!run.empty() && inst.getAddress() != runStart + run.size()) {
+			addSites(owner, runStart, run.data(), run.size());
+			run.clear();
+		}
+
+		if (run.empty())
+			runStart = inst.getAddress();
+
+		const auto& bytes = inst.getBytes();
+		run.insert(run.end(), bytes.begin(), bytes.begin() + inst.size());
+	}
+
+	if (!run.empty())
+		addSites(owner, runStart, run.data(), run.size());
+}
+
+void Watchdog::addSites(uint32_t owner, uintptr_t address, const uint8_t* bytes, size_t size) {
+	while (size > 0) {
+		const size_t chunk = std::min(size, kSiteSize);
+
+		SiteBytes expected{};
+		std::memcpy(expected.data.data(), bytes, chunk);
+
+		m_siteAddress.push_back(address);
+		m_siteSize.push_back((uint8_t) chunk);
+		m_siteOwner.push_back(owner);
+		m_siteBytes.push_back(expected);
+
+		address += chunk;
+		bytes += chunk;
+		size -= chunk;
+	}
+}
+
+void Watchdog::remove(const Detour* detour) {
+	std::lock_guard<std::mutex> lock(m_mutex);
+
+	auto it = std::find_if(m_owners.begin(), m_owners.end(), [detour](const Owner& owner) {
+		return owner.detour.get() == detour;
+	});
+	if (it == m_owners.end())
+		return;
+
+	const auto removed = (uint32_t) std::distance(m_owners.begin(), it);
+	m_owners.erase(it);
+
+	size_t out = 0;
+	for (size_t i = 0; i < m_siteAddress.size(); i++) {
+		uint32_t owner = m_siteOwner[i];
+		if (owner == removed)
+			continue;
+
+		m_siteAddress[out] = m_siteAddress[i];
+		m_siteSize[out] = m_siteSize[i];
+		m_siteOwner[out] = owner > removed ? owner - 1 : owner;
+		m_siteBytes[out] = m_siteBytes[i];
+		out++;
+	}
+
+	m_siteAddress.resize(out);
+	m_siteSize.resize(out);
+	m_siteOwner.resize(out);
+	m_siteBytes.resize(out);
+}
+
+void Watchdog::clear() {
+	std::lock_guard<std::mutex> lock(m_mutex);
+
+	m_siteAddress.clear();
+	m_siteSize.clear();
+	m_siteOwner.clear();
+	m_siteBytes.clear();
+	m_owners.clear();
+}
+
+bool Watchdog::matches(uintptr_t address, const SiteBytes& expected, uint8_t size) {
+#if DYNO_WATCHDOG_SSE2
+	// the site is padded to 32 bytes, only take the vector path when the padding can't touch the next page
+	if ((address & (kMinPageSize - 1)) <= kMinPageSize - kSiteSize) {
+		const auto* actual = (const __m128i*) address;
+		const auto* wanted = (const __m128i*) expected.data.data();
+		uint32_t equal = (uint32_t) _mm_movemask_epi8(_mm_cmpeq_epi8(_mm_loadu_si128(actual), _mm_load_si128(wanted)));
+		equal |= (uint32_t) _mm_movemask_epi8(_mm_cmpeq_epi8(_mm_loadu_si128(actual + 1), _mm_load_si128(wanted + 1))) << 16;
+
+		const uint32_t mask = size >= 32 ? 0xFFFFFFFF : (1u << size) - 1;
+		return (equal & mask) == mask;
+	}
+#endif
+	return std::memcmp((const void*) address, expected.data.data(), size) == 0;
+}
+
+size_t Watchdog::sweep() {
+	const auto start = std::chrono::steady_clock::now();
+
+	std::lock_guard<std::mutex> lock(m_mutex);
+
+	const uint64_t sweepNo = m_sweeps.fetch_add(1, std::memory_order_relaxed) + 1;
+
+	// collect the mismatching owners first, a detour spanning several sites is repaired only once
+	std::vector<uint32_t> damaged;
+	for (size_t i = 0; i < m_siteAddress.size(); i++) {
+		if (matches(m_siteAddress[i], m_siteBytes[i], m_siteSize[i]))
+			continue;
+
+		uint32_t owner = m_siteOwner[i];
+		if (damaged.empty() || damaged.back() != owner)
+			damaged.push_back(owner);
+	}
+	m_sitesChecked.fetch_add(m_siteAddress.size(), std::memory_order_relaxed);
+	m_mismatches.fetch_add(damaged.size(), std::memory_order_relaxed);
+
+	std::vector<bool> damagedSet(m_owners.size(), false);
+	for (uint32_t owner : damaged)
+		damagedSet[owner] = true;
+
+	size_t repaired = 0;
+	for (uint32_t i = 0; i < m_owners.size(); i++) {
+		Owner& owner = m_owners[i];
+		if (!damagedSet[i]) {
+			owner.strikes = 0;
+			continue;
+		}
+
+		// someone keeps reverting this hook, back off exponentially instead of fighting over the bytes
+		if (sweepNo < owner.skipUntil || repaired >= m_maxRepairs) {
+			m_throttled.fetch_add(1, std::memory_order_relaxed);
+			continue;
+		}
+
+		if (owner.detour->rehook()) {
+			repaired++;
+			m_repairs.fetch_add(1, std::memory_order_relaxed);
+			DYNO_LOG_WARN("Watchdog restored overwritten hook at " + int_to_hex(owner.detour->getFnAddress()));
+		} else {
+			m_failedRepairs.fetch_add(1, std::memory_order_relaxed);
+			DYNO_LOG_ERR("Watchdog failed to restore overwritten hook");
+		}
+
+		owner.strikes++;
+		if (owner.strikes > 1)
+			owner.skipUntil = sweepNo + (1ull << std::min<uint32_t>(owner.strikes, 10));
+	}
+
+	const auto elapsed = std::chrono::steady_clock::now() - start;
+	m_lastSweepNs.store((uint64_t) std::chrono::duration_cast<std::chrono::nanoseconds>(elapsed).count(), std::memory_order_relaxed);
+	return repaired;
+}
+
+WatchdogStats Watchdog::getStats() const {
+	WatchdogStats stats;
+	stats.sweeps = m_sweeps.load(std::memory_order_relaxed);
+	stats.sitesChecked = m_sitesChecked.load(std::memory_order_relaxed);
+	stats.mismatches = m_mismatches.load(std::memory_order_relaxed);
+	stats.repairs = m_repairs.load(std::memory_order_relaxed);
+	stats.failedRepairs = m_failedRepairs.load(std::memory_order_relaxed);
+	stats.throttled = m_throttled.load(std::memory_order_relaxed);
+	stats.lastSweepNs = m_lastSweepNs.load(std::memory_order_relaxed);
+	return stats;
+}
\ No newline at end of file
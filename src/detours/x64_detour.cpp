@@ -1,6 +1,8 @@
 #include <dynohook/core.h>
 #include <dynohook/log.h>
 #include <dynohook/detours/x64_detour.h>
+#include <dynohook/fork_guard.h>
+#include <dynohook/scratch_code.h>
 
 #include <asmtk/asmtk.h>
 #include <Zydis/Register.h>
@@ -24,6 +26,7 @@ x64Detour::~x64Detour() {
 		m_allocator.deallocate(*m_valloc2_region);
 		m_valloc2_region = {};
 	}
+	freeExitThunks();
 }
 
 Mode x64Detour::getArchType() const {
@@ -203,8 +206,8 @@ bool x64Detour::makeInplaceTrampoline(
 	uintptr_t base_address,
 	const std::function<void(asmjit::x86::Assembler&)>& builder
 ) {
-	CodeHolder code;
-	code.init(m_asmjit_rt.environment(), m_asmjit_rt.cpuFeatures(), base_address);
+	ScratchCode scratch(m_asmjit_rt, base_address);
+	CodeHolder& code = *scratch;
 	x86::Assembler a(&code);
 
 	builder(a);
@@ -218,7 +221,7 @@ bool x64Detour::makeInplaceTrampoline(
 	}
 
 	const auto trampoline_end = trampoline_address + code.codeSize();
-	m_hookInsts = m_disasm.disassemble(trampoline_address, trampoline_address, trampoline_end, *this);
+	m_hookInsts = m_disasm.disassemble(trampoline_address, trampoline_address, trampoline_end, *this, false);
 	// Fix the addresses
 	auto current_address = base_address;
 	for (auto& inst: m_hookInsts) {
@@ -230,11 +233,16 @@ bool x64Detour::makeInplaceTrampoline(
 
 bool x64Detour::allocateJumpToBridge() {
 	// Create the bridge function
-	if (!createBridge()) {
-		DYNO_LOG_ERR("Failed to create bridge");
-		return false;
+	{
+		PhaseTimer timer(m_installReport.bridgeNs);
+		if (!attachBridge()) {
+			DYNO_LOG_ERR("Failed to create bridge");
+			return false;
+		}
 	}
 
+	PhaseTimer timer(m_installReport.schemeSelectionNs);
+
 	// Insert valloc description
 	if (m_detourScheme & detour_scheme_t::VALLOC2 && boundedAllocSupported()) {
 		auto max = AlignDownwards(calc_2gb_above(m_fnAddress), getPageSize());
@@ -318,33 +326,57 @@ bool x64Detour::allocateJumpToBridge() {
 }
 
 bool x64Detour::hook() {
-	DYNO_LOG_INFO("m_fnAddress: " + int_to_hex(m_fnAddress) + "\n");
+	m_installReport = {};
+	m_installReport.fnAddress = m_fnAddress;
+	PhaseTimer totalTimer(m_installReport.totalNs);
 
-	insts_t insts = m_disasm.disassemble(m_fnAddress, m_fnAddress, m_fnAddress + 100, *this);
-	DYNO_LOG_INFO("Original function:\n" + instsToStr(insts) + "\n");
+	// fork() must not seal the bridge or the trampoline halfway through
+	ForkGuard::InstallScope scope;
 
-	if (insts.empty()) {
-		DYNO_LOG_ERR("Disassembler unable to decode any valid instructions");
-		return false;
+	DYNO_LOG_INFO("m_fnAddress: " + int_to_hex(m_fnAddress) + "\n");
+
+	// functions which don't start with a jmp are only scanned, the prologue cache may know their shape
+	std::vector<uint8_t> scanBytes;
+	std::vector<InstShape> shapes;
+	insts_t insts;
+	{
+		PhaseTimer timer(m_installReport.disassemblyNs);
+		m_disasm.clearBranchMap();
+		if (!m_disasm.scan(m_fnAddress, m_fnAddress + 100, *this, scanBytes, shapes))
+			insts = m_disasm.disassemble(m_fnAddress, scanBytes, *this);
 	}
 
-	if (!followJmp(insts)) {
-		DYNO_LOG_ERR("Prologue jmp resolution failed");
-		return false;
+	if (shapes.empty()) {
+		DYNO_LOG_INFO("Original function:\n" + instsToStr(insts) + "\n");
+
+		if (insts.empty()) {
+			DYNO_LOG_ERR("Disassembler unable to decode any valid instructions");
+			m_installReport.failure = "disassembly";
+			return false;
+		}
+
+		{
+			PhaseTimer timer(m_installReport.followJmpNs);
+			if (!followJmp(insts)) {
+				DYNO_LOG_ERR("Prologue jmp resolution failed");
+				m_installReport.failure = "followJmp";
+				return false;
+			}
+		}
+
+		// update given fn address to resolved one
+		m_fnAddress = insts.front().getAddress();
 	}
 
-	// update given fn address to resolved one
-	m_fnAddress = insts.front().getAddress();
+	m_installReport.resolvedAddress = m_fnAddress;
 
 	if (!allocateJumpToBridge()) {
+		m_installReport.failure = m_fnBridge ? "scheme selection" : "bridge";
 		return false;
 	}
 
-	{
-		std::stringstream ss;
-		ss << printDetourScheme(m_chosenScheme);
-		DYNO_LOG_INFO("Chosen detour scheme: " + ss.str() + "\n");
-	}
+	m_installReport.scheme = printDetourScheme(m_chosenScheme);
+	DYNO_LOG_INFO("Chosen detour scheme: "s + m_installReport.scheme + "\n");
 
 	// min size of patches that may split instructions
 	// For valloc & code cave, we insert the jump, hence we take only size of the 1st instruction.
@@ -356,35 +388,34 @@ bool x64Detour::hook() {
 	uintptr_t roundProlSz = minProlSz;  // nearest size to min that doesn't split any instructions
 
 	// find the prologue section we will overwrite with jmp + zero or more nops
-	auto prologueOpt = calcNearestSz(insts, minProlSz, roundProlSz);
-	if (!prologueOpt) {
-		DYNO_LOG_ERR("Function too small to hook safely!");
+	insts_t prologue;
+	if (!findPrologue(scanBytes, shapes, insts, minProlSz, roundProlSz, prologue))
 		return false;
-	}
-
-	assert(roundProlSz >= minProlSz);
-	auto prologue = *prologueOpt;
 
-	if (!expandProlSelfJmps(prologue, insts, minProlSz, roundProlSz)) {
-		DYNO_LOG_ERR("Function needs a prologue jmp table but it's too small to insert one");
-		return false;
-	}
+	// findPrologue() timed the planning, relocation covers the trampoline, translations are subtracted afterwards
+	PhaseTimer relocationTimer(m_installReport.relocationNs);
 
 	m_originalInsts = prologue;
+	m_installReport.prologueSize = (uint16_t) roundProlSz;
 
 	DYNO_LOG_INFO("Prologue to overwrite:\n" + instsToStr(prologue) + "\n");
 
 	// copy all the prologue stuff to trampoline
 	insts_t jmpTblOpt;
 	if (!makeTrampoline(prologue, jmpTblOpt)) {
+		m_installReport.failure = "trampoline";
 		return false;
 	}
 
+	relocationTimer.stop();
+	m_installReport.relocationNs -= m_installReport.translationNs;
+	m_installReport.trampolineSize = m_trampolineSz;
+
 	DYNO_LOG_INFO("m_trampoline: " + int_to_hex(m_trampoline) + "\n");
 	DYNO_LOG_INFO("m_trampolineSz: " + int_to_hex(m_trampolineSz) + "\n");
 
-	auto tramp_instructions = m_disasm.disassemble(m_trampoline, m_trampoline, m_trampoline + m_trampolineSz, *this);
-	DYNO_LOG_INFO("Trampoline:\n" + instsToStr(tramp_instructions) + "\n");
+	// only decoded when the message is logged
+	DYNO_LOG_INFO("Trampoline:\n" + instsToStr(m_disasm.disassemble(m_trampoline, m_trampoline, m_trampoline + m_trampolineSz, *this, false)) + "\n");
 	if (!jmpTblOpt.empty()) {
 		DYNO_LOG_INFO("Trampoline Jmp Tbl:\n" + instsToStr(jmpTblOpt) + "\n");
 	}
@@ -392,18 +423,29 @@ bool x64Detour::hook() {
 	m_hookSize = (uint32_t) roundProlSz;
 	m_nopProlOffset = (uint16_t) minProlSz;
 
-	DYNO_LOG_INFO("Hook instructions: \n" + instsToStr(m_hookInsts) + "\n");
-	MemProtector prot(m_fnAddress, m_hookSize, ProtFlag::RWX, *this);
-	writeEncoding(m_hookInsts);
+	{
+		PhaseTimer timer(m_installReport.patchNs);
 
-	DYNO_LOG_INFO("Hook size: " + std::to_string(m_hookSize) + "\n");
-	DYNO_LOG_INFO("Prologue offset: " + std::to_string(m_nopProlOffset) + "\n");
+		// the ret sites go first, before the prologue sends calls to the bridge
+		if (m_exitSitePatching)
+			m_installReport.exitSites = (uint8_t) patchExitSites(m_fnAddress + roundProlSz);
 
-	// Nop the space between jmp and end of prologue
-	assert(m_hookSize >= m_nopProlOffset);
-	m_nopSize = (uint16_t) (m_hookSize - m_nopProlOffset);
-	const auto nops = make_nops(m_fnAddress + m_nopProlOffset, m_nopSize);
-	writeEncoding(nops);
+		DYNO_LOG_INFO("Hook instructions: \n" + instsToStr(m_hookInsts) + "\n");
+		MemProtector prot(m_fnAddress, m_hookSize, ProtFlag::RWX, *this);
+		writeEncoding(m_hookInsts);
+
+		DYNO_LOG_INFO("Hook size: " + std::to_string(m_hookSize) + "\n");
+		DYNO_LOG_INFO("Prologue offset: " + std::to_string(m_nopProlOffset) + "\n");
+
+		// Nop the space between jmp and end of prologue
+		assert(m_hookSize >= m_nopProlOffset);
+		m_nopSize = (uint16_t) (m_hookSize - m_nopProlOffset);
+		const auto nops = make_nops(m_fnAddress + m_nopProlOffset, m_nopSize);
+		writeEncoding(nops);
+	}
+
+	registerCode();
+	m_installReport.success = true;
 
 	m_hooked = true;
 	return true;
@@ -415,9 +457,40 @@ bool x64Detour::unhook() {
 		m_allocator.deallocate(*m_valloc2_region);
 		m_valloc2_region = {};
 	}
+	freeExitThunks();
 	return status;
 }
 
+insts_t x64Detour::makeExitJmp(uintptr_t address, uintptr_t stub) {
+	const uint16_t thunkSize = 14;
+
+	if (!m_exitThunks) {
+		auto max = AlignDownwards(calc_2gb_above(address), getPageSize());
+		auto min = AlignDownwards(calc_2gb_below(address), getPageSize());
+		m_exitThunks = boundedAllocSupported() ? boundAlloc(min, max, getPageSize()) : boundAllocLegacy(min, max, getPageSize());
+		if (!m_exitThunks) {
+			DYNO_LOG_ERR("Failed to allocate the exit thunks near function");
+			return {};
+		}
+		m_exitThunksSize = 0;
+	}
+
+	const uintptr_t thunk = m_exitThunks + m_exitThunksSize;
+	m_exitThunksSize += thunkSize;
+
+	MemProtector prot(thunk, thunkSize, ProtFlag::RWX, *this, false);
+	writeEncoding(makex64Jump(thunk, stub));
+
+	return makex86Jmp(address, thunk);
+}
+
+void x64Detour::freeExitThunks() {
+	if (m_exitThunks) {
+		boundAllocFree(m_exitThunks, getPageSize());
+		m_exitThunks = 0;
+	}
+}
+
 /**
  * Holds a list of instructions that require us to store contents of the scratch register
  * into the original destination address. For example, in `add [0x...], rbx` after translation
@@ -584,8 +657,8 @@ std::vector<std::string> generateAbsoluteJump(uintptr_t destination, uint16_t st
  */
 std::optional<uintptr_t> x64Detour::generateTranslationRoutine(const Instruction& instruction, uintptr_t resume_address) {
 	// AsmTK parses strings for AsmJit, which generates the binary code.
-	CodeHolder code;
-	code.init(m_asmjit_rt.environment(), m_asmjit_rt.cpuFeatures());
+	ScratchCode scratch(m_asmjit_rt);
+	CodeHolder& code = *scratch;
 
 	x86::Assembler assembler(&code);
 	asmtk::AsmParser parser(&assembler);
@@ -719,40 +792,17 @@ bool x64Detour::makeTrampoline(insts_t& prologue, insts_t& outJmpTable) {
 	m_trampolineSz = (uint16_t) (prolSz + jmp_size * (1 + neededEntryCount) + alignment_pad_size);
 
 	// allocate new trampoline before deleting old to increase odds of new mem address
-	auto tmpTrampoline = (uintptr_t) new uint8_t[m_trampolineSz];
+	auto tmpTrampoline = allocateTrampoline(m_trampolineSz);
+	if (!tmpTrampoline)
+		return false;
+
 	if (m_trampoline != 0) {
-		delete[] (uint8_t*) m_trampoline;
+		freeTrampoline(m_trampoline);
 	}
 
 	m_trampoline = tmpTrampoline;
 	delta = (intptr_t) (m_trampoline - prolStart);
 
-	// since we did not set the address of the trampoline for the bridge at the time of its generation,
-	// we are looking for the nop space and set our address of the trampoline there
-	uint8_t match = 0;
-	const uint8_t* nop_addr = (uint8_t*) m_fnBridge + m_fnBridgeSize;
-	while (match < 14) {
-		if (*--nop_addr == 0x90)
-			match++;
-		else
-			match = 0;
-	}
-
-	const uintptr_t jmpToTramAddr = (uintptr_t) nop_addr;
-	const auto rel_jump_size = 5;
-	auto next_addr = jmpToTramAddr + rel_jump_size;
-	auto max = AlignDownwards(calc_2gb_above(next_addr), getPageSize());
-	auto min = AlignDownwards(calc_2gb_below(next_addr), getPageSize());
-	if (m_trampoline >= min && m_trampoline < max) {
-		const auto jmpToTram = makex86Jmp(jmpToTramAddr, m_trampoline);
-		DYNO_LOG_INFO("Jmp To Tram:\n" + instsToStr(jmpToTram) + "\n");
-		writeEncoding(jmpToTram);
-	} else {
-		const auto jmpToTram = makex64Jump(jmpToTramAddr, m_trampoline);
-		DYNO_LOG_INFO("Jmp To Tram:\n" + instsToStr(jmpToTram) + "\n");
-		writeEncoding(jmpToTram);
-	}
-
 	buildRelocationList(prologue, prolSz, delta, instsNeedingEntry, instsNeedingReloc, instsNeedingTranslation);
 	if (!instsNeedingEntry.empty()) {
 		DYNO_LOG_INFO("Instructions needing entry:\n" + instsToStr(instsNeedingEntry) + "\n");
@@ -770,10 +820,16 @@ bool x64Detour::makeTrampoline(insts_t& prologue, insts_t& outJmpTable) {
 		const auto inst_offset = instruction.getAddress() - prolStart;
 		// Address of the instruction that follows the problematic instruction
 		const uintptr_t resume_address = m_trampoline + inst_offset + instruction.size();
-		auto opt_translation_address = generateTranslationRoutine(instruction, resume_address);
+		std::optional<uintptr_t> opt_translation_address;
+		{
+			PhaseTimer timer(m_installReport.translationNs);
+			opt_translation_address = generateTranslationRoutine(instruction, resume_address);
+		}
 		if (!opt_translation_address)
 			return false;
 
+		m_installReport.translatedInsts++;
+
 		// replace the rip-relative instruction with jump to translation
 		auto inst_iterator = std::find(prologue.begin(), prologue.end(), instruction);
 		const auto jump = makeRelJmpWithAbsDest(instruction.getAddress(), *opt_translation_address);
@@ -834,5 +890,8 @@ bool x64Detour::makeTrampoline(insts_t& prologue, insts_t& outJmpTable) {
 	const uintptr_t jmpTblStart = jmpToProlAddr + getMinJmpSize();
 	outJmpTable = relocateTrampoline(prologue, jmpTblStart, delta, makeJmpFn, instsNeedingReloc, instsNeedingEntry);
 
-	return true;
+	// since we did not know the address of the trampoline for the bridge at the time of its generation,
+	// we set it in the continuation slot of the bridge now. A shared bridge is entered already, so only
+	// once the trampoline is complete.
+	return getDispatchHook().setContinuation(m_trampoline);
 }
\ No newline at end of file
@@ -1,4 +1,5 @@
 #include <dynohook/detours/x86_detour.h>
+#include <dynohook/fork_guard.h>
 
 using namespace dyno;
 
@@ -14,23 +15,49 @@ uint8_t getJmpSize() {
 }
 
 bool x86Detour::hook() {
-	DYNO_LOG_INFO("m_fnAddress: " + int_to_hex(m_fnAddress) + "\n");
+	m_installReport = {};
+	m_installReport.fnAddress = m_fnAddress;
+	PhaseTimer totalTimer(m_installReport.totalNs);
 
-	insts_t insts = m_disasm.disassemble(m_fnAddress, m_fnAddress, m_fnAddress + 100, *this);
-	DYNO_LOG_INFO("Original function:\n" + instsToStr(insts) + "\n");
+	// fork() must not seal the bridge or the trampoline halfway through
+	ForkGuard::InstallScope scope;
 
-	if (insts.empty()) {
-		DYNO_LOG_ERR("Disassembler unable to decode any valid instructions");
-		return false;
+	DYNO_LOG_INFO("m_fnAddress: " + int_to_hex(m_fnAddress) + "\n");
+
+	// functions which don't start with a jmp are only scanned, the prologue cache may know their shape
+	std::vector<uint8_t> scanBytes;
+	std::vector<InstShape> shapes;
+	insts_t insts;
+	{
+		PhaseTimer timer(m_installReport.disassemblyNs);
+		m_disasm.clearBranchMap();
+		if (!m_disasm.scan(m_fnAddress, m_fnAddress + 100, *this, scanBytes, shapes))
+			insts = m_disasm.disassemble(m_fnAddress, scanBytes, *this);
 	}
 
-	if (!followJmp(insts)) {
-		DYNO_LOG_ERR("Prologue jmp resolution failed");
-		return false;
+	if (shapes.empty()) {
+		DYNO_LOG_INFO("Original function:\n" + instsToStr(insts) + "\n");
+
+		if (insts.empty()) {
+			DYNO_LOG_ERR("Disassembler unable to decode any valid instructions");
+			m_installReport.failure = "disassembly";
+			return false;
+		}
+
+		{
+			PhaseTimer timer(m_installReport.followJmpNs);
+			if (!followJmp(insts)) {
+				DYNO_LOG_ERR("Prologue jmp resolution failed");
+				m_installReport.failure = "followJmp";
+				return false;
+			}
+		}
+
+		// update given fn address to resolved one
+		m_fnAddress = insts.front().getAddress();
 	}
 
-	// update given fn address to resolved one
-	m_fnAddress = insts.front().getAddress();
+	m_installReport.resolvedAddress = m_fnAddress;
 
 	// --------------- END RECURSIVE JMP RESOLUTION ---------------------
 
@@ -38,37 +65,38 @@ bool x86Detour::hook() {
 	uintptr_t roundProlSz = minProlSz; // nearest size to min that doesn't split any instructions
 
 	// find the prologue section we will overwrite with jmp + zero or more nops
-	auto prologueOpt = calcNearestSz(insts, minProlSz, roundProlSz);
-	if (!prologueOpt) {
-		DYNO_LOG_ERR("Function too small to hook safely!");
+	insts_t prologue;
+	if (!findPrologue(scanBytes, shapes, insts, minProlSz, roundProlSz, prologue))
 		return false;
-	}
 
-	assert(roundProlSz >= minProlSz);
-	auto prologue = *prologueOpt;
-
-	if (!expandProlSelfJmps(prologue, insts, minProlSz, roundProlSz)) {
-		DYNO_LOG_ERR("Function needs a prologue jmp table but it's too small to insert one");
-		return false;
-	}
+	PhaseTimer relocationTimer(m_installReport.relocationNs);
 
 	m_originalInsts = prologue;
+	m_installReport.prologueSize = (uint16_t) roundProlSz;
 	DYNO_LOG_INFO("Prologue to overwrite:\n" + instsToStr(prologue) + "\n");
 
 	// copy all the prologue stuff to trampoline
 	insts_t jmpTblOpt;
 	if (!makeTrampoline(prologue, jmpTblOpt)) {
+		m_installReport.failure = "trampoline";
 		return false;
 	}
 
+	relocationTimer.stop();
+	m_installReport.trampolineSize = m_trampolineSz;
+
 	// create the bridge function
-	if (!createBridge()) {
-		DYNO_LOG_ERR("Failed to create bridge");
-		return false;
+	{
+		PhaseTimer timer(m_installReport.bridgeNs);
+		if (!attachBridge()) {
+			DYNO_LOG_ERR("Failed to create bridge");
+			m_installReport.failure = "bridge";
+			return false;
+		}
 	}
 
-	auto tramp_instructions = m_disasm.disassemble(m_trampoline, m_trampoline, m_trampoline + m_trampolineSz, *this);
-	DYNO_LOG_INFO("Trampoline:\n" + instsToStr(tramp_instructions) + "\n\n");
+	// only decoded when the message is logged
+	DYNO_LOG_INFO("Trampoline:\n" + instsToStr(m_disasm.disassemble(m_trampoline, m_trampoline, m_trampoline + m_trampolineSz, *this, false)) + "\n\n");
 	if (!jmpTblOpt.empty()) {
 		DYNO_LOG_INFO("Trampoline Jmp Tbl:\n" + instsToStr(jmpTblOpt) + "\n\n");
 	}
@@ -76,17 +104,28 @@ bool x86Detour::hook() {
 	m_hookSize = (uint32_t) roundProlSz;
 	m_nopProlOffset = (uint16_t) minProlSz;
 
-	MemProtector prot(m_fnAddress, m_hookSize, ProtFlag::RWX, *this);
+	{
+		PhaseTimer timer(m_installReport.patchNs);
+
+		// the ret sites go first, before the prologue sends calls to the bridge
+		if (m_exitSitePatching)
+			m_installReport.exitSites = (uint8_t) patchExitSites(m_fnAddress + roundProlSz);
+
+		MemProtector prot(m_fnAddress, m_hookSize, ProtFlag::RWX, *this);
 
-	m_hookInsts = makex86Jmp(m_fnAddress, m_fnBridge);
-	DYNO_LOG_INFO("Hook instructions:\n" + instsToStr(m_hookInsts) + "\n");
-	writeEncoding(m_hookInsts);
+		m_hookInsts = makex86Jmp(m_fnAddress, m_fnBridge);
+		DYNO_LOG_INFO("Hook instructions:\n" + instsToStr(m_hookInsts) + "\n");
+		writeEncoding(m_hookInsts);
 
-	// Nop the space between jmp and end of prologue
-	assert(m_hookSize >= m_nopProlOffset);
-	m_nopSize = (uint16_t) (m_hookSize - m_nopProlOffset);
-	const auto nops = make_nops(m_fnAddress + m_nopProlOffset, m_nopSize);
-	writeEncoding(nops);
+		// Nop the space between jmp and end of prologue
+		assert(m_hookSize >= m_nopProlOffset);
+		m_nopSize = (uint16_t) (m_hookSize - m_nopProlOffset);
+		const auto nops = make_nops(m_fnAddress + m_nopProlOffset, m_nopSize);
+		writeEncoding(nops);
+	}
+
+	registerCode();
+	m_installReport.success = true;
 
 	m_hooked = true;
 	return true;
@@ -118,13 +157,15 @@ bool x86Detour::makeTrampoline(insts_t& prologue, insts_t& trampolineOut) {
 		}
 
 		if (m_trampoline != 0) {
-			delete[](uint8_t*) m_trampoline;
+			freeTrampoline(m_trampoline);
 			neededEntryCount = (uint8_t) instsNeedingEntry.size();
 		}
 
 		// prol + jmp back to prol + N * jmpEntries
 		m_trampolineSz = (uint16_t) (prolSz + getJmpSize() + getJmpSize() * neededEntryCount);
-		m_trampoline = (uintptr_t) new uint8_t[m_trampolineSz];
+		m_trampoline = allocateTrampoline(m_trampolineSz);
+		if (!m_trampoline)
+			return false;
 
 		const intptr_t delta = 1 - prolStart;
 
@@ -36,50 +36,66 @@ insts_t ZydisDisassembler::disassemble(
 	uintptr_t firstInstruction,
 	uintptr_t start,
 	uintptr_t end,
-	const MemAccessor& accessor
+	const MemAccessor& accessor,
+	bool trackBranches
 ) {
-	insts_t insVec;
-//	m_branchMap.clear();
-
 	size_t size = end - start;
 	assert(size > 0);
 	if (size <= 0) {
-		return insVec;
+		return {};
 	}
 
-	// copy potentially remote memory to local buffer
+	// copy potentially remote memory to a local buffer, kept by the thread for the next install
+	thread_local std::vector<uint8_t> buf;
 	size_t read = 0;
-	auto buf = std::make_unique<uint8_t[]>(size);
-	if (!accessor.safe_mem_read(firstInstruction, (uintptr_t) buf.get(), size, read)) {
+	buf.resize(size);
+	if (!accessor.safe_mem_read(firstInstruction, (uintptr_t) buf.data(), size, read)) {
+		return {};
+	}
+
+	return disassemble(start, buf.data(), read, accessor, trackBranches);
+}
+
+insts_t ZydisDisassembler::disassemble(
+	uintptr_t start,
+	const std::vector<uint8_t>& buf,
+	const MemAccessor& accessor,
+	bool trackBranches
+) {
+	return disassemble(start, buf.data(), buf.size(), accessor, trackBranches);
+}
+
+insts_t ZydisDisassembler::disassemble(
+	uintptr_t start,
+	const uint8_t* buf,
+	size_t size,
+	const MemAccessor& accessor,
+	bool trackBranches
+) {
+	insts_t insVec;
+	if (size == 0) {
 		return insVec;
 	}
+
+	// most instructions are 2 to 5 bytes long, growing the vector would copy every instruction again
+	insVec.reserve(size / 4 + 1);
+
 	ZydisDecodedOperand decoded_operands[ZYDIS_MAX_OPERAND_COUNT];
 	ZydisDecodedInstruction insInfo;
 	size_t offset = 0;
 	bool endHit = false;
 
-	uint8_t* buffer;
-
-	while (ZYAN_SUCCESS(ZydisDecoderDecodeFull(m_decoder, (char*) (buffer = (buf.get() + offset)), (ZyanUSize) (read - offset), &insInfo, decoded_operands))) {
-		Instruction::Displacement displacement{0};
-		displacement.Absolute = 0;
+	const uint8_t* buffer;
 
+	while (ZYAN_SUCCESS(ZydisDecoderDecodeFull(m_decoder, (buffer = (buf + offset)), (ZyanUSize) (size - offset), &insInfo, decoded_operands))) {
 		uintptr_t address = start + offset;
 
-		std::string opStr;
-		if (!getOpStr(&insInfo, decoded_operands, address, &opStr)) {
-			break;
-		}
-
+		// the operand string is only formatted when someone asks for it, installs don't need it
 		Instruction inst(&accessor,
 						 address,
-						 displacement,
-						 0,
-						 false,
-						 false,
-						 std::vector<uint8_t>(buffer, buffer + insInfo.length),
+						 buffer,
+						 insInfo.length,
 						 ZydisMnemonicGetString(insInfo.mnemonic),
-						 std::move(opStr),
 						 m_mode);
 
 		setDisplacementFields(inst, &insInfo, decoded_operands);
@@ -94,11 +110,13 @@ insts_t ZydisDisassembler::disassemble(
 			}
 		}
 
-		insVec.push_back(inst);
+		const Instruction& added = insVec.emplace_back(std::move(inst));
 
 		// searches instruction vector and updates references
-		addToBranchMap(insVec, inst);
-		if (isFuncEnd(inst, start == address)){
+		if (trackBranches) {
+			addToBranchMap(insVec, added);
+		}
+		if (isFuncEnd(added, start == address)){
 			endHit = true;
 		}
 
@@ -108,6 +126,137 @@ insts_t ZydisDisassembler::disassemble(
 	return insVec;
 }
 
+bool ZydisDisassembler::scan(
+	uintptr_t start,
+	uintptr_t end,
+	const MemAccessor& accessor,
+	std::vector<uint8_t>& bytes,
+	std::vector<InstShape>& shapes
+) {
+	shapes.clear();
+
+	size_t size = end - start;
+	assert(size > 0);
+	bytes.resize(size);
+
+	size_t read = 0;
+	if (!accessor.safe_mem_read(start, (uintptr_t) bytes.data(), size, read) || read == 0) {
+		bytes.clear();
+		return false;
+	}
+	bytes.resize(read);
+
+	ZydisDecoderContext context;
+	ZydisDecodedInstruction insInfo;
+	size_t offset = 0;
+	bool endHit = false;
+
+	// no operands and no formatting, the raw fields hold everything needed for planning
+	while (ZYAN_SUCCESS(ZydisDecoderDecodeInstruction(m_decoder, &context, bytes.data() + offset, (ZyanUSize) (read - offset), &insInfo))) {
+		const uint8_t* buffer = bytes.data() + offset;
+
+		InstShape shape{};
+		shape.offset = (uint16_t) offset;
+		shape.length = insInfo.length;
+		shape.branching = insInfo.meta.branch_type != ZYDIS_BRANCH_TYPE_NONE;
+		shape.pad = insInfo.mnemonic == ZYDIS_MNEMONIC_NOP;
+		shape.funcEnd = (insInfo.length == 1 && buffer[0] == 0xCC) ||
+						(insInfo.length >= 2 && buffer[0] == 0xf3 && buffer[1] == 0xc3) ||
+						insInfo.mnemonic == ZYDIS_MNEMONIC_JMP || insInfo.mnemonic == ZYDIS_MNEMONIC_RET ||
+						insInfo.mnemonic == ZYDIS_MNEMONIC_IRET || insInfo.mnemonic == ZYDIS_MNEMONIC_IRETD ||
+						insInfo.mnemonic == ZYDIS_MNEMONIC_IRETQ;
+
+		if (insInfo.attributes & ZYDIS_ATTRIB_IS_RELATIVE) {
+			if (insInfo.raw.imm[0].is_relative) {
+				shape.relOffset = insInfo.raw.imm[0].offset;
+				shape.relSize = insInfo.raw.imm[0].size / 8;
+				shape.destination = start + offset + insInfo.length + (intptr_t) insInfo.raw.imm[0].value.s;
+			} else {
+				shape.relOffset = insInfo.raw.disp.offset;
+				shape.relSize = insInfo.raw.disp.size / 8;
+			}
+		}
+
+		if (endHit && !shape.pad) {
+			break;
+		}
+
+		// jmps to follow, and jmp [rip + x] and the like, where they go depends on memory
+		if ((offset == 0 && shape.branching) || (shape.branching && !shape.destination && insInfo.raw.disp.size != 0)) {
+			shapes.clear();
+			return false;
+		}
+
+		shapes.push_back(shape);
+
+		if (shape.funcEnd) {
+			endHit = true;
+		}
+
+		offset += insInfo.length;
+	}
+
+	return !shapes.empty();
+}
+
+insts_t ZydisDisassembler::disassembleFunction(uintptr_t start, size_t maxSize, const MemAccessor& accessor) {
+	std::vector<uint8_t> buf(maxSize);
+	size_t read = 0;
+	if (!accessor.safe_mem_read(start, (uintptr_t) buf.data(), maxSize, read) || read == 0)
+		return {};
+	buf.resize(read);
+
+	insts_t insts;
+	uintptr_t reach = start; // furthest branch destination seen so far
+	size_t offset = 0;
+	while (offset < buf.size()) {
+		// up to the next ret or jmp, together with the nops behind it
+		insts_t chunk = disassemble(start + offset, buf.data() + offset, buf.size() - offset, accessor, false);
+		if (chunk.empty())
+			return {};
+
+		const bool padded = isPadBytes(chunk.back());
+		for (auto& inst : chunk) {
+			if (inst.isBranching() && !inst.isCalling() && inst.hasDisplacement() && inst.isDisplacementRelative())
+				reach = std::max(reach, inst.getDestination());
+			offset += inst.size();
+			insts.push_back(std::move(inst));
+		}
+
+		if (reach < start + offset) {
+			// int3 padding behind the last ret is never executed either
+			while (offset < buf.size() && buf[offset] == 0xCC) {
+				insts.emplace_back(&accessor, start + offset, &buf[offset], (uint8_t) 1, "int3", m_mode);
+				offset++;
+			}
+			return insts;
+		}
+
+		// a branch goes further, but code behind padding may already be the next function
+		if (padded || (offset < buf.size() && buf[offset] == 0xCC))
+			return {};
+	}
+
+	return {};
+}
+
+std::string ZydisDisassembler::formatOperands(const Instruction& instruction) {
+	// created once per thread, formatting is rare and mostly for diagnostics
+	thread_local ZydisDisassembler x86{ Mode::x86 };
+	thread_local ZydisDisassembler x64{ Mode::x64 };
+	ZydisDisassembler& disasm = instruction.getMode() == Mode::x64 ? x64 : x86;
+
+	ZydisDecodedOperand decoded_operands[ZYDIS_MAX_OPERAND_COUNT];
+	ZydisDecodedInstruction insInfo;
+	const auto& bytes = instruction.getBytes();
+	if (ZYAN_FAILED(ZydisDecoderDecodeFull(disasm.m_decoder, bytes.data(), (ZyanUSize) bytes.size(), &insInfo, decoded_operands)))
+		return {};
+
+	std::string opStr;
+	disasm.getOpStr(&insInfo, decoded_operands, instruction.getAddress(), &opStr);
+	return opStr;
+}
+
 bool ZydisDisassembler::getOpStr(ZydisDecodedInstruction* pInstruction, const ZydisDecodedOperand* decoded_operands, uintptr_t addr, std::string* pOpStrOut) {
 	char buffer[256];
 	if (ZYAN_SUCCESS(ZydisFormatterFormatInstruction(m_formatter, pInstruction, decoded_operands, pInstruction->operand_count, buffer, sizeof(buffer), (ZyanU64)addr, ZYAN_NULL))) {
@@ -0,0 +1,362 @@
+#include <dynohook/fork_guard.h>
+#include <dynohook/call_stack.h>
+#include <dynohook/log.h>
+#include <dynohook/os.h>
+
+#include <algorithm>
+#include <cstdio>
+#include <unordered_map>
+
+#if DYNO_PLATFORM_LINUX
+#include <pthread.h>
+#endif
+
+using namespace dyno;
+
+std::atomic<bool> ForkGuard::s_enabled{ false };
+
+namespace {
+	// reserved at once, the kernel only backs the pages which are touched
+	constexpr size_t kChunkSize = 1 << 20;
+
+	size_t alignUp(size_t value, size_t alignment) {
+		return (value + alignment - 1) & ~(alignment - 1);
+	}
+
+#if DYNO_PLATFORM_LINUX
+	// bump allocator over private anonymous mappings, freed blocks are reused by size
+	class Arena {
+	public:
+		explicit Arena(int prot) : m_prot{prot} {}
+
+		void* allocate(size_t size) {
+			size = alignUp(size, ForkGuard::kHotAlignment);
+
+			auto it = m_free.find(size);
+			if (it != m_free.end() && !it->second.empty()) {
+				uintptr_t address = it->second.back();
+				it->second.pop_back();
+				m_sizes[address] = size;
+				return (void*) address;
+			}
+
+			if (m_cursor + size > m_end) {
+				const size_t chunkSize = std::max(kChunkSize, alignUp(size, (size_t) getpagesize()));
+				void* chunk = mmap(nullptr, chunkSize, m_prot, MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+				if (chunk == MAP_FAILED)
+					return nullptr;
+
+				m_chunks.push_back({ (uintptr_t) chunk, chunkSize });
+				m_cursor = (uintptr_t) chunk;
+				m_end = m_cursor + chunkSize;
+			}
+
+			uintptr_t address = m_cursor;
+			m_cursor += size;
+			m_sizes[address] = size;
+			return (void*) address;
+		}
+
+		bool free(void* ptr) {
+			auto it = m_sizes.find((uintptr_t) ptr);
+			if (it == m_sizes.end())
+				return false;
+
+			m_free[it->second].push_back(it->first);
+			m_sizes.erase(it);
+			return true;
+		}
+
+		// drops the pages copied from the parent, they read back as zero from now on
+		void discard() {
+			for (const auto& [address, size] : m_chunks)
+				madvise((void*) address, size, MADV_DONTNEED);
+		}
+
+	private:
+		struct Chunk {
+			uintptr_t address;
+			size_t size;
+		};
+
+		int m_prot;
+		std::vector<Chunk> m_chunks;
+		uintptr_t m_cursor{ 0 };
+		uintptr_t m_end{ 0 };
+		std::unordered_map<uintptr_t, size_t> m_sizes;
+		std::unordered_map<size_t, std::vector<uintptr_t>> m_free;
+	};
+
+	struct CodeRegion {
+		const void* owner;
+		uintptr_t address;
+		size_t size;
+	};
+
+	// pages changed by a seal and the protection they had before it
+	struct SealedRange {
+		uintptr_t start;
+		uintptr_t end;
+		int prot;
+	};
+
+	struct State {
+		// recursive, installs hold it across allocateCode() and addCode()
+		std::recursive_mutex mutex;
+		Arena hot{ PROT_READ | PROT_WRITE };
+		Arena code{ PROT_READ | PROT_WRITE | PROT_EXEC };
+		std::vector<CodeRegion> regions;
+		std::vector<SealedRange> sealed;
+	};
+
+	// never destroyed, hooks owned by other statics release their memory during exit
+	State& state() {
+		static State* s = new State;
+		return *s;
+	}
+
+	std::pair<uintptr_t, uintptr_t> regionPages(const CodeRegion& region) {
+		const auto pageSize = (uintptr_t) getpagesize();
+		return { region.address & ~(pageSize - 1), alignUp(region.address + region.size, pageSize) };
+	}
+
+	void protectRange(uintptr_t start, uintptr_t end, int prot) {
+		if (mprotect((void*) start, end - start, prot) != 0)
+			DYNO_LOG_WARN("Failed to change the protection of generated code at " + int_to_hex(start));
+	}
+
+	// one pass over /proc/self/maps instead of one per region
+	std::vector<SealedRange> readMappings() {
+		std::vector<SealedRange> mappings;
+		std::FILE* maps = std::fopen("/proc/self/maps", "r");
+		if (!maps)
+			return mappings;
+
+		char line[512];
+		while (std::fgets(line, sizeof(line), maps)) {
+			unsigned long start, end;
+			char perms[5];
+			if (std::sscanf(line, "%lx-%lx %4s", &start, &end, perms) != 3)
+				continue;
+
+			int prot = PROT_NONE;
+			if (perms[0] == 'r')
+				prot |= PROT_READ;
+			if (perms[1] == 'w')
+				prot |= PROT_WRITE;
+			if (perms[2] == 'x')
+				prot |= PROT_EXEC;
+			mappings.push_back({ (uintptr_t) start, (uintptr_t) end, prot });
+		}
+
+		std::fclose(maps);
+		return mappings;
+	}
+
+	void sealLocked() {
+		auto& s = state();
+		if (s.regions.empty())
+			return;
+
+		// remember what every page had, generated code may live in pages the JIT runtime still fills
+		const std::vector<SealedRange> mappings = readMappings();
+		for (const auto& region : s.regions) {
+			const auto [start, end] = regionPages(region);
+			for (const auto& mapping : mappings) {
+				if (mapping.end <= start || mapping.start >= end || mapping.prot == (PROT_READ | PROT_EXEC))
+					continue;
+
+				const SealedRange range{ std::max(start, mapping.start), std::min(end, mapping.end), mapping.prot };
+				protectRange(range.start, range.end, PROT_READ | PROT_EXEC);
+				s.sealed.push_back(range);
+			}
+		}
+	}
+
+	void unsealLocked() {
+		auto& s = state();
+		for (const auto& range : s.sealed)
+			protectRange(range.start, range.end, range.prot);
+		s.sealed.clear();
+	}
+
+	template<typename Pred>
+	void removeRegions(Pred&& pred) {
+		std::lock_guard<std::recursive_mutex> lock(state().mutex);
+		auto& regions = state().regions;
+		auto it = std::stable_partition(regions.begin(), regions.end(), [&](const CodeRegion& region) {
+			return !pred(region);
+		});
+		for (auto removed = it; removed != regions.end(); ++removed) {
+			const auto [start, end] = regionPages(*removed);
+			protectRange(start, end, PROT_READ | PROT_WRITE | PROT_EXEC);
+		}
+		regions.erase(it, regions.end());
+	}
+
+	void prepareFork() {
+		state().mutex.lock();
+		sealLocked();
+	}
+
+	void parentAfterFork() {
+		// the parent keeps installing hooks, only the children keep the code sealed
+		unsealLocked();
+		state().mutex.unlock();
+	}
+
+	void childAfterFork() {
+		// fork() from inside a hooked call needs the copied register snapshots and frames on the way out,
+		// the child keeps its copies then, only losing the page sharing.
+		if (CallStack::current().empty())
+			state().hot.discard();
+
+		// the lock is owned by the thread id of the parent, unlocking it from the child fails
+		new (&state().mutex) std::recursive_mutex;
+	}
+#endif
+}
+
+bool ForkGuard::enable() {
+#if DYNO_PLATFORM_LINUX
+	static std::once_flag once;
+	static bool registered = false;
+	std::call_once(once, [] {
+		registered = pthread_atfork(&prepareFork, &parentAfterFork, &childAfterFork) == 0;
+	});
+
+	if (!registered) {
+		DYNO_LOG_ERR("Failed to register the fork handlers");
+		return false;
+	}
+
+	s_enabled.store(true, std::memory_order_relaxed);
+	return true;
+#else
+	DYNO_LOG_WARN("Fork mode is only supported on linux");
+	return false;
+#endif
+}
+
+void* ForkGuard::allocateHot(size_t size) {
+#if DYNO_PLATFORM_LINUX
+	if (isEnabled()) {
+		std::lock_guard<std::recursive_mutex> lock(state().mutex);
+		if (void* ptr = state().hot.allocate(size))
+			return ptr;
+		DYNO_LOG_WARN("Hot arena exhausted, falling back to the heap");
+	}
+#endif
+	return ::operator new(size, std::align_val_t{ kHotAlignment });
+}
+
+void ForkGuard::freeHot(void* ptr) {
+	if (!ptr)
+		return;
+#if DYNO_PLATFORM_LINUX
+	{
+		std::lock_guard<std::recursive_mutex> lock(state().mutex);
+		if (state().hot.free(ptr))
+			return;
+	}
+#endif
+	::operator delete(ptr, std::align_val_t{ kHotAlignment });
+}
+
+void* ForkGuard::allocateCode(size_t size) {
+#if DYNO_PLATFORM_LINUX
+	if (isEnabled()) {
+		std::lock_guard<std::recursive_mutex> lock(state().mutex);
+		// no heap fallback, sealing a heap page would take the neighbouring data with it
+		void* ptr = state().code.allocate(size);
+		if (!ptr)
+			DYNO_LOG_ERR("Failed to map a page for the code arena");
+		return ptr;
+	}
+#endif
+	return new uint8_t[size];
+}
+
+void ForkGuard::freeCode(void* ptr) {
+	if (!ptr)
+		return;
+#if DYNO_PLATFORM_LINUX
+	{
+		std::lock_guard<std::recursive_mutex> lock(state().mutex);
+		if (state().code.free(ptr))
+			return;
+	}
+#endif
+	delete[] (uint8_t*) ptr;
+}
+
+void ForkGuard::addCode(const void* owner, uintptr_t address, size_t size) {
+#if DYNO_PLATFORM_LINUX
+	if (!isEnabled() || !address || !size)
+		return;
+
+	std::lock_guard<std::recursive_mutex> lock(state().mutex);
+	state().regions.push_back({ owner, address, size });
+#else
+	DYNO_UNUSED(owner);
+	DYNO_UNUSED(address);
+	DYNO_UNUSED(size);
+#endif
+}
+
+void ForkGuard::removeCode(const void* owner) {
+#if DYNO_PLATFORM_LINUX
+	removeRegions([owner](const CodeRegion& region) {
+		return region.owner == owner;
+	});
+#else
+	DYNO_UNUSED(owner);
+#endif
+}
+
+void ForkGuard::removeCode(const void* owner, uintptr_t address) {
+#if DYNO_PLATFORM_LINUX
+	removeRegions([owner, address](const CodeRegion& region) {
+		return region.owner == owner && region.address == address;
+	});
+#else
+	DYNO_UNUSED(owner);
+	DYNO_UNUSED(address);
+#endif
+}
+
+void ForkGuard::seal() {
+#if DYNO_PLATFORM_LINUX
+	std::lock_guard<std::recursive_mutex> lock(state().mutex);
+	sealLocked();
+#endif
+}
+
+void ForkGuard::unseal() {
+#if DYNO_PLATFORM_LINUX
+	std::lock_guard<std::recursive_mutex> lock(state().mutex);
+	unsealLocked();
+#endif
+}
+
+ForkGuard::InstallScope::InstallScope() : m_locked{isEnabled()} {
+#if DYNO_PLATFORM_LINUX
+	if (m_locked) {
+		state().mutex.lock();
+		// sealed by seal() or inherited from the parent, the install writes into the generated code
+		m_resealed = !state().sealed.empty();
+		if (m_resealed)
+			unsealLocked();
+	}
+#endif
+}
+
+ForkGuard::InstallScope::~InstallScope() {
+#if DYNO_PLATFORM_LINUX
+	if (m_locked) {
+		if (m_resealed)
+			sealLocked();
+		state().mutex.unlock();
+	}
+#endif
+}
\ No newline at end of file
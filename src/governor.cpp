@@ -0,0 +1,281 @@
+#include <dynohook/governor.h>
+#include <dynohook/hook.h>
+#include <dynohook/log.h>
+
+#include <algorithm>
+
+#if DYNO_PLATFORM_MSVC_X86
+#include <intrin.h>
+#elif DYNO_PLATFORM_GCC_COMPATIBLE_X86
+#include <x86intrin.h>
+#endif
+
+using namespace dyno;
+
+namespace {
+	uint64_t readTsc() {
+#if DYNO_PLATFORM_X86
+		return __rdtsc();
+#else
+		return (uint64_t) std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+#endif
+	}
+
+	const char* modeName(DispatchMode mode) {
+		switch (mode) {
+			case DispatchMode::Full: return "full";
+			case DispatchMode::Sampled: return "sampled";
+			case DispatchMode::PassThrough: return "pass-through";
+		}
+		return "";
+	}
+
+	// average cycles all handlers of the hook add to one call, from the dispatches sampled so far
+	double handlerCycles(const Hook& hook) {
+		double cycles = 0;
+		for (const auto& profile : hook.getHandlerProfiles()) {
+			if (profile.sampledCalls)
+				cycles += (double) profile.cycles / (double) profile.sampledCalls;
+		}
+		return cycles;
+	}
+
+	// cycles one call costs in the given mode
+	double callCost(const GovernorBudget& budget, double handlers, DispatchMode mode) {
+		switch (mode) {
+			case DispatchMode::Full: return budget.dispatchCycles + handlers;
+			case DispatchMode::Sampled: return budget.dispatchCycles + handlers / std::max(budget.sampleEvery, 1u);
+			case DispatchMode::PassThrough: return 0;
+		}
+		return 0;
+	}
+
+	std::string percentOf(double part, double whole) {
+		return std::to_string(whole > 0 ? (uint64_t) (100 * part / whole) : 0) + "%";
+	}
+}
+
+Governor::~Governor() {
+	stop();
+}
+
+bool Governor::start(const GovernorBudget& budget, std::chrono::milliseconds interval) {
+	if (m_thread.joinable()) {
+		DYNO_LOG_WARN("Governor is already running");
+		return false;
+	}
+
+	{
+		std::lock_guard<std::mutex> lock(m_mutex);
+
+		m_budget = budget;
+		m_lastTsc = 0;
+		for (auto& source : m_sources) {
+			if (auto hook = source.hook.lock())
+				acquire(source, *hook);
+		}
+	}
+
+	m_interval = interval;
+	m_stop = false;
+	m_thread = std::thread(&Governor::run, this);
+	return true;
+}
+
+void Governor::stop() {
+	if (m_thread.joinable()) {
+		{
+			std::lock_guard<std::mutex> lock(m_cvMutex);
+			m_stop = true;
+		}
+		m_cv.notify_all();
+		m_thread.join();
+	}
+
+	std::lock_guard<std::mutex> lock(m_mutex);
+
+	for (auto& source : m_sources)
+		release(source);
+}
+
+bool Governor::isRunning() const {
+	return m_thread.joinable();
+}
+
+void Governor::run() {
+	std::unique_lock<std::mutex> lock(m_cvMutex);
+	while (!m_cv.wait_for(lock, m_interval, [this] { return m_stop; })) {
+		lock.unlock();
+		evaluate();
+		lock.lock();
+	}
+}
+
+void Governor::add(const std::shared_ptr<Hook>& hook, uintptr_t address) {
+	if (!hook)
+		return;
+
+	std::lock_guard<std::mutex> lock(m_mutex);
+
+	// virtual hooks are shared between vtables, govern them once
+	for (const auto& source : m_sources) {
+		if (source.key == hook.get() && !source.hook.expired())
+			return;
+	}
+
+	Source& source = m_sources.emplace_back(Source{hook, hook.get(), address, 0, 0, false, 0, 0});
+	if (m_thread.joinable())
+		acquire(source, *hook);
+}
+
+void Governor::clear() {
+	std::lock_guard<std::mutex> lock(m_mutex);
+
+	for (auto& source : m_sources)
+		release(source);
+	m_sources.clear();
+}
+
+void Governor::acquire(Source& source, Hook& hook) {
+	source.baseline = false;
+	source.hold = 0;
+	source.profileEvery = hook.getHandlerProfiling();
+	if (!source.profileEvery)
+		hook.setHandlerProfiling(kProfileEvery);
+}
+
+void Governor::release(Source& source) {
+	auto hook = source.hook.lock();
+	if (!hook)
+		return;
+
+	if (hook->getDispatchMode() != DispatchMode::Full) {
+		hook->setDispatchMode(DispatchMode::Full);
+		DYNO_LOG_INFO("Governor released hook at " + int_to_hex(source.address) + ", back to full dispatch");
+	}
+
+	// left alone if someone else changed it meanwhile
+	if (!source.profileEvery && hook->getHandlerProfiling() == kProfileEvery)
+		hook->setHandlerProfiling(0);
+	source.profileEvery = hook->getHandlerProfiling();
+}
+
+void Governor::evaluate() {
+	std::lock_guard<std::mutex> lock(m_mutex);
+
+	const uint64_t now = readTsc();
+	const uint64_t elapsed = m_lastTsc ? now - m_lastTsc : 0;
+	m_lastTsc = now;
+
+	const unsigned cpus = m_budget.cpus ? m_budget.cpus : std::max(std::thread::hardware_concurrency(), 1u);
+	const double budget = m_budget.cpuFraction * (double) elapsed * cpus;
+
+	struct Estimate {
+		Source* source;
+		std::shared_ptr<Hook> hook;
+		DispatchMode mode;
+		double handlers; // cycles per fully dispatched call
+		double cost; // cycles during the interval
+	};
+
+	// hooks which are gone release their entry
+	m_sources.erase(std::remove_if(m_sources.begin(), m_sources.end(), [](const Source& source) {
+		return source.hook.expired();
+	}), m_sources.end());
+
+	std::vector<Estimate> estimates;
+	estimates.reserve(m_sources.size());
+	double total = 0;
+
+	for (auto& source : m_sources) {
+		auto hook = source.hook.lock();
+		if (!hook)
+			continue;
+
+		const uint64_t calls = hook->getStats().calls.load(std::memory_order_relaxed);
+		const uint64_t delta = source.baseline ? calls - source.calls : 0;
+		source.calls = calls;
+		source.baseline = true;
+
+		// hooks in pass-through are never counted, their last rate stands in for them
+		if (delta && elapsed)
+			source.callRate = (double) delta / (double) elapsed;
+		if (source.hold)
+			source.hold--;
+
+		const DispatchMode mode = hook->getDispatchMode();
+		const double handlers = handlerCycles(*hook);
+		const double cost = (double) delta * callCost(m_budget, handlers, mode);
+		total += cost;
+		estimates.push_back({ &source, std::move(hook), mode, handlers, cost });
+	}
+
+	m_evaluations.fetch_add(1, std::memory_order_relaxed);
+	m_lastCost.store((uint64_t) total, std::memory_order_relaxed);
+	m_lastBudget.store((uint64_t) budget, std::memory_order_relaxed);
+
+	if (!elapsed || estimates.empty())
+		return;
+
+	const uint32_t sampleEvery = std::max(m_budget.sampleEvery, 1u);
+
+	if (total > budget) {
+		// only the hooks above their equal share pay for the excess, the most expensive first
+		const double share = budget / (double) estimates.size();
+		std::sort(estimates.begin(), estimates.end(), [](const Estimate& lhs, const Estimate& rhs) {
+			return lhs.cost > rhs.cost;
+		});
+
+		for (const auto& estimate : estimates) {
+			if (total <= budget || estimate.cost <= share)
+				break;
+
+			const DispatchMode next = estimate.mode == DispatchMode::Full ? DispatchMode::Sampled : DispatchMode::PassThrough;
+			const double calls = estimate.source->callRate * (double) elapsed;
+			const double cost = calls * callCost(m_budget, estimate.handlers, next);
+
+			estimate.hook->setDispatchMode(next, sampleEvery);
+			estimate.source->hold = m_budget.holdIntervals;
+			total -= estimate.cost - cost;
+			m_degradations.fetch_add(1, std::memory_order_relaxed);
+
+			DYNO_LOG_WARN("Governor switched hook at " + int_to_hex(estimate.source->address) + " to " + modeName(next) +
+						  " dispatch, it used " + percentOf(estimate.cost, budget) + " of the budget");
+		}
+		return;
+	}
+
+	// restores one step of the hooks held long enough, the cheapest projection first
+	std::sort(estimates.begin(), estimates.end(), [](const Estimate& lhs, const Estimate& rhs) {
+		return lhs.source->callRate * lhs.handlers < rhs.source->callRate * rhs.handlers;
+	});
+
+	for (const auto& estimate : estimates) {
+		if (estimate.mode == DispatchMode::Full || estimate.source->hold)
+			continue;
+
+		const DispatchMode previous = estimate.mode == DispatchMode::PassThrough ? DispatchMode::Sampled : DispatchMode::Full;
+		const double calls = estimate.source->callRate * (double) elapsed;
+		const double cost = calls * callCost(m_budget, estimate.handlers, previous);
+		if (total - estimate.cost + cost > budget * m_budget.restoreBelow)
+			continue;
+
+		estimate.hook->setDispatchMode(previous, sampleEvery);
+		estimate.source->hold = m_budget.holdIntervals;
+		total += cost - estimate.cost;
+		m_restorations.fetch_add(1, std::memory_order_relaxed);
+
+		DYNO_LOG_INFO("Governor restored hook at " + int_to_hex(estimate.source->address) + " to " + modeName(previous) +
+					  " dispatch, projected to use " + percentOf(cost, budget) + " of the budget");
+	}
+}
+
+GovernorStats Governor::getStats() const {
+	GovernorStats stats;
+	stats.evaluations = m_evaluations.load(std::memory_order_relaxed);
+	stats.degradations = m_degradations.load(std::memory_order_relaxed);
+	stats.restorations = m_restorations.load(std::memory_order_relaxed);
+	stats.lastCostCycles = m_lastCost.load(std::memory_order_relaxed);
+	stats.lastBudgetCycles = m_lastBudget.load(std::memory_order_relaxed);
+	return stats;
+}
\ No newline at end of file
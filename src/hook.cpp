@@ -1,12 +1,123 @@
 #include <dynohook/hook.h>
+#include <dynohook/fork_guard.h>
 #include <dynohook/log.h>
+#include <dynohook/mem_protector.h>
+
+#include <algorithm>
+#include <bit>
+#include <chrono>
+
+#if DYNO_PLATFORM_MSVC_X86
+#include <intrin.h>
+#elif DYNO_PLATFORM_GCC_COMPATIBLE_X86
+#include <x86intrin.h>
+#endif
 
 using namespace dyno;
 
-Hook::Hook(const ConvFunc& convention) : m_callingConvention{convention()}, m_registers{m_callingConvention->getRegisters()/*, Registers::ScratchList()*/} {
+namespace {
+	uint64_t nowNs() {
+		return (uint64_t) std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+	}
+
+	uint64_t readTsc() {
+#if DYNO_PLATFORM_X86
+		return __rdtsc();
+#else
+		return nowNs();
+#endif
+	}
+
+	// shared by every hook, the sampled dispatches of one thread stay evenly spaced
+	thread_local uint32_t t_profileCountdown = 0;
+
+	// same for the calls which run the callbacks of sampled hooks
+	thread_local uint32_t t_sampleCountdown = 0;
+
+#if DYNO_ARCH_X86 == 64
+	constexpr RegisterType kStackPtr = RSP;
+#else
+	constexpr RegisterType kStackPtr = ESP;
+#endif
+}
+
+Hook::Hook(const ConvFunc& convention) : m_callingConvention{convention()}, m_registers{m_callingConvention->getRegisters()/*, Registers::ScratchList()*/}, m_stats{ForkGuard::create<HookStats>()} {
+}
+
+Hook::~Hook() {
+	ForkGuard::removeCode(this);
+	ForkGuard::destroy(m_stats);
+	ForkGuard::destroy(m_callers.load(std::memory_order_relaxed));
+	for (const auto& [type, stats] : m_handlerStats) {
+		for (HandlerStats* handlerStats : stats)
+			ForkGuard::destroy(handlerStats);
+	}
+	for (HandlerStats* handlerStats : m_retiredStats)
+		ForkGuard::destroy(handlerStats);
+	PrebuiltStubs::release(m_prebuilt);
+}
+
+void Hook::registerCode() {
+	ForkGuard::addCode(this, m_fnBridge, m_fnBridgeSize);
+	ForkGuard::addCode(this, m_newRetAddr, m_newRetAddrSize);
+}
+
+bool Hook::usesPrebuiltStubs() const {
+	return PrebuiltStubs::isEnabled() && m_inlineHandlers.empty() && PrebuiltStubs::supports(m_registers);
+}
+
+bool Hook::createPrebuiltBridge() {
+	ReturnAction (DYNO_CDECL Hook::*callbackHandler)(CallbackType) = &Hook::callbackHandler;
+	void (DYNO_CDECL Hook::*setReturnAddress)(void*, void*) = &Hook::setReturnAddress;
+	void* (DYNO_CDECL Hook::*getReturnAddress)(void*) = &Hook::getReturnAddress;
+
+	PrebuiltStubs::Targets targets;
+	targets.hook = (uintptr_t) this;
+	targets.passThrough = (uintptr_t) &m_passThrough;
+	targets.callbackHandler = (uintptr_t) (void*&) callbackHandler;
+	targets.setReturnAddress = (uintptr_t) (void*&) setReturnAddress;
+	targets.getReturnAddress = (uintptr_t) (void*&) getReturnAddress;
+	targets.continuation = getAddress();
+
+	if (!PrebuiltStubs::create(m_registers, targets, (uint16_t) m_callingConvention->getPopSize(), m_prebuilt))
+		return false;
+
+	m_newRetAddr = m_prebuilt.postStub;
+	m_newRetAddrSize = m_prebuilt.postStubSize;
+	m_fnBridge = m_prebuilt.bridge;
+	m_fnBridgeSize = m_prebuilt.bridgeSize;
+	m_continuation = m_prebuilt.continuation;
+	return true;
+}
+
+bool Hook::setContinuation(uintptr_t target) {
+	if (!m_continuation) {
+		DYNO_LOG_ERR("Bridge has no continuation slot");
+		return false;
+	}
+
+	// the prebuilt slot is on a data page which stays writable
+	if (m_prebuilt.address) {
+		std::atomic_ref<uintptr_t>(*(uintptr_t*) m_continuation).store(target, std::memory_order_release);
+		return true;
+	}
+
+	// sealed in fork mode, the scope keeps fork() from sealing it between the protector and its restore
+	ForkGuard::InstallScope scope;
+	MemProtector prot(m_continuation, sizeof(uintptr_t), ProtFlag::R | ProtFlag::W | ProtFlag::X, *this);
+	std::atomic_ref<uintptr_t>(*(uintptr_t*) m_continuation).store(target, std::memory_order_release);
+	return true;
+}
+
+void Hook::releaseExitStub(uintptr_t stub) {
+	if (!stub)
+		return;
+
+	ForkGuard::removeCode(this, stub);
+	m_asmjit_rt.release((void*) stub);
 }
 
-bool Hook::addCallback(CallbackType type, CallbackHandler handler) {
+bool Hook::addCallback(CallbackType type, CallbackHandler handler, CallbackFlag flags) {
 	if (!handler) {
 		DYNO_LOG_WARN("Callback handler is null");
 		return false;
@@ -22,6 +133,9 @@ bool Hook::addCallback(CallbackType type, CallbackHandler handler) {
 	}
 
 	callbacks.push_back(handler);
+	m_handlerStats[type].push_back(ForkGuard::create<HandlerStats>());
+	m_handlerFlags[type].push_back(flags);
+	updateSavedState();
 	return true;
 }
 
@@ -42,6 +156,19 @@ bool Hook::removeCallback(CallbackType type, CallbackHandler handler) {
 			callbacks.erase(callbacks.begin() + i);
 			if (callbacks.empty())
 				m_handlers.erase(it);
+
+			std::vector<HandlerStats*>& stats = m_handlerStats[type];
+			m_retiredStats.push_back(stats[i]);
+			stats.erase(stats.begin() + i);
+			if (stats.empty())
+				m_handlerStats.erase(type);
+
+			std::vector<CallbackFlag>& flags = m_handlerFlags[type];
+			flags.erase(flags.begin() + i);
+			if (flags.empty())
+				m_handlerFlags.erase(type);
+
+			updateSavedState();
 			return true;
 		}
 	}
@@ -50,6 +177,22 @@ bool Hook::removeCallback(CallbackType type, CallbackHandler handler) {
 	return false;
 }
 
+void Hook::updateSavedState() {
+	const auto declares = [this](CallbackType type, CallbackFlag flag) {
+		auto it = m_handlerFlags.find(type);
+		if (it == m_handlerFlags.end())
+			return false;
+
+		return std::any_of(it->second.begin(), it->second.end(), [flag](CallbackFlag flags) {
+			return flags & flag;
+		});
+	};
+
+	// WriteArgs and ReadReturn need no copy, see CallbackFlag
+	m_saveArgs = declares(CallbackType::Post, CallbackFlag::ReadArgs);
+	m_saveReturn = declares(CallbackType::Pre, CallbackFlag::WriteReturn);
+}
+
 bool Hook::isCallbackRegistered(CallbackType type, CallbackHandler handler) const {
 	if (!handler) {
 		DYNO_LOG_WARN("Callback handler is null");
@@ -82,14 +225,74 @@ bool Hook::areCallbacksRegistered() const {
 	return false;
 }
 
+bool Hook::addInlineHandler(InlineHandler handler) {
+	if (m_fnBridge) {
+		DYNO_LOG_ERR("Inline handlers have to be added before the bridge is generated");
+		return false;
+	}
+
+	m_inlineHandlers.push_back(std::move(handler));
+	return true;
+}
+
+void Hook::writeInlineHandlers(Assembler& a, const asmjit::Label& original, const asmjit::Label& supercede) {
+	if (m_inlineHandlers.empty())
+		return;
+
+	ArgLocations locations;
+	locations.returnReg = m_callingConvention->getReturn().reg;
+	locations.popSize = (uint16_t) m_callingConvention->getPopSize();
+	locations.original = original;
+	locations.supercede = supercede;
+
+	// the conventions only know the stack arguments relative to the saved stack pointer
+	const auto& arguments = m_callingConvention->getArguments();
+	const uintptr_t base = m_registers[kStackPtr].getValue<uintptr_t>();
+	for (size_t i = 0; i < arguments.size(); i++) {
+		ArgLocation location{ arguments[i].reg, 0, arguments[i].size };
+		if (location.reg == NONE)
+			location.offset = (int32_t) ((uintptr_t) m_callingConvention->getArgumentPtr(i, m_registers) - base);
+		locations.args.push_back(location);
+	}
+
+	for (const auto& handler : m_inlineHandlers) {
+		locations.next = a.newLabel();
+		handler(a, locations);
+		a.bind(locations.next);
+	}
+}
+
 ReturnAction Hook::callbackHandler(CallbackType type) {
+	// the bridge pushed the frame in setReturnAddress() right before entering the pre callbacks, the bridge
+	// as well as the post and exit stubs save the stack pointer setReturnAddress() got
+	CallStack& stack = getCallStack();
+	CallFrame* frame = stack.find(this, (void*) m_registers[kStackPtr].getValue<uintptr_t>());
+	if (!frame) {
+		DYNO_LOG_ERR("Failed to find the pending call of the hook");
+		return ReturnAction::Ignored;
+	}
+
 	if (type == CallbackType::Post) {
-		ReturnAction lastPreReturnAction = m_lastPreReturnAction.back();
-		m_lastPreReturnAction.pop_back();
-		if (lastPreReturnAction >= ReturnAction::Override)
-			m_callingConvention->restoreReturnValue(m_registers);
-		if (lastPreReturnAction < ReturnAction::Supercede)
-			m_callingConvention->restoreCallArguments(m_registers);
+		ReturnAction lastPreReturnAction = frame->action;
+		endCall(*frame);
+
+		if (frame->skipped)
+			return ReturnAction::Ignored;
+
+		if (lastPreReturnAction >= ReturnAction::Override && frame->savedReturn)
+			m_callingConvention->restoreReturnValue(m_registers, frame->savedReturn);
+		if (lastPreReturnAction < ReturnAction::Supercede && frame->savedArgs)
+			m_callingConvention->restoreCallArguments(m_registers, frame->savedArgs);
+	} else if (m_dispatchMode.load(std::memory_order_relaxed) == DispatchMode::Sampled) {
+		const bool sampled = t_sampleCountdown == 0;
+		t_sampleCountdown = sampled ? m_sampleEvery.load(std::memory_order_relaxed) - 1 : t_sampleCountdown - 1;
+
+		// still counted, the governor needs the call rate to decide when the hook can be restored
+		if (!sampled) {
+			frame->skipped = true;
+			beginCall(*frame, ReturnAction::Ignored);
+			return ReturnAction::Ignored;
+		}
 	}
 
 	ReturnAction returnAction = ReturnAction::Ignored;
@@ -98,49 +301,247 @@ ReturnAction Hook::callbackHandler(CallbackType type) {
 		// still save the arguments for the post hook even if there
 		// is no pre-handler registered.
 		if (type == CallbackType::Pre) {
-			m_lastPreReturnAction.push_back(returnAction);
-			m_callingConvention->saveCallArguments(m_registers);
+			beginCall(*frame, returnAction);
+			saveCallState(stack, *frame);
 		}
 		return returnAction;
 	}
 
 	const std::vector<CallbackHandler>& callbacks = it->second;
 
-	for (const CallbackHandler callback : callbacks) {
-		ReturnAction result = callback(type, *this);
-		if (result > returnAction)
-			returnAction = result;
+	if (const uint32_t sampleEvery = m_profileEvery.load(std::memory_order_relaxed)) {
+		returnAction = dispatchProfiled(type, callbacks, sampleEvery);
+	} else {
+		for (const CallbackHandler callback : callbacks) {
+			ReturnAction result = callback(type, *this);
+			if (result > returnAction)
+				returnAction = result;
+		}
 	}
 
 	if (type == CallbackType::Pre) {
-		m_lastPreReturnAction.push_back(returnAction);
-		if (returnAction >= ReturnAction::Override)
-			m_callingConvention->saveReturnValue(m_registers);
-		if (returnAction < ReturnAction::Supercede)
-			m_callingConvention->saveCallArguments(m_registers);
+		beginCall(*frame, returnAction);
+		saveCallState(stack, *frame);
+
+		// a superceded call never reaches a ret site, it leaves through the post stub instead
+		if (returnAction == ReturnAction::Supercede && m_exitPatched.load(std::memory_order_relaxed))
+			*(uintptr_t*) frame->stackPtr = m_newRetAddr;
 	}
 
 	return returnAction;
 }
 
+ReturnAction Hook::dispatchProfiled(CallbackType type, const std::vector<CallbackHandler>& callbacks, uint32_t sampleEvery) {
+	auto it = m_handlerStats.find(type);
+	if (it == m_handlerStats.end())
+		return ReturnAction::Ignored;
+	const std::vector<HandlerStats*>& stats = it->second;
+
+	const bool sampled = t_profileCountdown == 0;
+	t_profileCountdown = sampled ? sampleEvery - 1 : t_profileCountdown - 1;
+
+	ReturnAction returnAction = ReturnAction::Ignored;
+	const size_t count = std::min(callbacks.size(), stats.size());
+	for (size_t i = 0; i < count; i++) {
+		HandlerStats& handlerStats = *stats[i];
+		handlerStats.calls.fetch_add(1, std::memory_order_relaxed);
+
+		ReturnAction result;
+		if (sampled) {
+			const uint64_t start = readTsc();
+			result = callbacks[i](type, *this);
+			handlerStats.cycles.fetch_add(readTsc() - start, std::memory_order_relaxed);
+			handlerStats.sampledCalls.fetch_add(1, std::memory_order_relaxed);
+		} else {
+			result = callbacks[i](type, *this);
+		}
+
+		if (result > returnAction)
+			returnAction = result;
+	}
+
+	return returnAction;
+}
+
+std::vector<HandlerProfile> Hook::getHandlerProfiles() const {
+	std::vector<HandlerProfile> profiles;
+	for (const auto& [type, callbacks] : m_handlers) {
+		const std::vector<HandlerStats*>& stats = m_handlerStats.at(type);
+		for (size_t i = 0; i < callbacks.size(); i++) {
+			profiles.push_back({
+				getAddress(),
+				type,
+				(uintptr_t) callbacks[i],
+				{},
+				stats[i]->calls.load(std::memory_order_relaxed),
+				stats[i]->sampledCalls.load(std::memory_order_relaxed),
+				stats[i]->cycles.load(std::memory_order_relaxed)
+			});
+		}
+	}
+	return profiles;
+}
+
+void Hook::saveCallState(CallStack& stack, CallFrame& frame) {
+	// copies live in the byte area of the stack, released together with the frame,
+	// and are only taken if a handler declared to need them, see CallbackFlag
+	const bool saveReturn = m_saveReturn && frame.action >= ReturnAction::Override;
+	if (saveReturn) {
+		frame.savedReturn = stack.allocate(m_callingConvention->getReturn().size);
+		if (frame.savedReturn)
+			m_callingConvention->saveReturnValue(m_registers, frame.savedReturn);
+	}
+
+	const bool saveArgs = m_saveArgs && frame.action < ReturnAction::Supercede;
+	if (saveArgs) {
+		frame.savedArgs = stack.allocate(m_callingConvention->getArgStackSize() + m_callingConvention->getArgRegisterSize());
+		if (frame.savedArgs)
+			m_callingConvention->saveCallArguments(m_registers, frame.savedArgs);
+	}
+
+	if ((saveReturn && !frame.savedReturn) || (saveArgs && !frame.savedArgs))
+		DYNO_LOG_ERR("Call stack byte area exhausted, the post callback sees the registers as they are");
+}
+
+size_t Hook::getRecursionDepth() {
+	return getCallStack().count(this);
+}
+
+CallStack& Hook::getCallStack() const {
+	if (ContextProvider provider = m_contextProvider.load(std::memory_order_relaxed)) {
+		if (CallStack* stack = provider())
+			return *stack;
+	}
+	return CallStack::current();
+}
+
+bool Hook::setPerfTracking(bool state) {
+	if (state && !PerfCounters::isSupported()) {
+		DYNO_LOG_WARN("Performance counters are not available, perf tracking stays off");
+		return false;
+	}
+
+	m_trackPerf.store(state, std::memory_order_relaxed);
+	return true;
+}
+
+void Hook::setHandlerProfiling(uint32_t sampleEvery) {
+	m_profileEvery.store(sampleEvery, std::memory_order_relaxed);
+	t_profileCountdown = 0;
+}
+
+void Hook::setDispatchMode(DispatchMode mode, uint32_t sampleEvery) {
+	m_sampleEvery.store(std::max(sampleEvery, 1u), std::memory_order_relaxed);
+	m_dispatchMode.store(mode, std::memory_order_relaxed);
+	m_passThrough.store(mode == DispatchMode::PassThrough ? 1 : 0, std::memory_order_relaxed);
+	t_sampleCountdown = 0;
+}
+
+void Hook::setCallerTracking(bool state) {
+	if (state && !m_callers.load(std::memory_order_acquire)) {
+		CallerHistogram* callers = ForkGuard::create<CallerHistogram>();
+		CallerHistogram* expected = nullptr;
+		if (!m_callers.compare_exchange_strong(expected, callers, std::memory_order_release, std::memory_order_acquire))
+			ForkGuard::destroy(callers);
+	}
+
+	// released after the histogram, a thread which sees the flag sees the pointer too
+	m_trackCallers.store(state, std::memory_order_release);
+}
+
+std::vector<CallerProfile> Hook::getCallerProfiles() const {
+	std::vector<CallerProfile> profiles;
+	const CallerHistogram* callers = m_callers.load(std::memory_order_acquire);
+	if (!callers)
+		return profiles;
+
+	for (const auto& [caller, calls] : callers->getCallers())
+		profiles.push_back({ getAddress(), caller, {}, calls });
+
+	if (const uint64_t dropped = callers->getDropped())
+		profiles.push_back({ getAddress(), 0, {}, dropped });
+
+	return profiles;
+}
+
+void Hook::beginCall(CallFrame& frame, ReturnAction action) {
+	m_stats->calls.fetch_add(1, std::memory_order_relaxed);
+	if (action == ReturnAction::Override)
+		m_stats->overrides.fetch_add(1, std::memory_order_relaxed);
+	else if (action == ReturnAction::Supercede)
+		m_stats->supercedes.fetch_add(1, std::memory_order_relaxed);
+
+	frame.action = action;
+	frame.startNs = m_trackLatency.load(std::memory_order_relaxed) ? nowNs() : 0;
+	frame.perfStart = m_trackPerf.load(std::memory_order_relaxed) ? PerfCounters::forThisThread().read() : PerfSample{};
+}
+
+void Hook::endCall(const CallFrame& frame) {
+	if (frame.startNs != 0) {
+		const size_t bucket = std::min<size_t>((size_t) std::bit_width(nowNs() - frame.startNs), kLatencyBuckets - 1);
+		m_stats->latency[bucket].fetch_add(1, std::memory_order_relaxed);
+	}
+
+	if (frame.perfStart.valid != 0) {
+		const PerfSample end = PerfCounters::forThisThread().read();
+		const PerfSample& start = frame.perfStart;
+
+		for (size_t i = 0; i < kPerfEventCount; i++) {
+			if (end.has((PerfEvent) i) && start.has((PerfEvent) i))
+				m_stats->perf[i].fetch_add(end.values[i] - start.values[i], std::memory_order_relaxed);
+		}
+		m_stats->perfCalls.fetch_add(1, std::memory_order_relaxed);
+	}
+}
+
 void* Hook::getReturnAddress(void* stackPtr) {
-	auto it = m_retAddr.find(stackPtr);
-	if (it == m_retAddr.end()) {
+	CallFrame frame;
+	if (!getCallStack().pop(this, stackPtr, frame)) {
 		DYNO_LOG_ERR("Failed to find return address of original function. Check the arguments and return type of your detour setup.");
 		return nullptr;
 	}
 
-	std::vector<void*>& v = it->second;
-	void* retAddr = v.back();
-	v.pop_back();
+	return frame.retAddr;
+}
+
+void Hook::setReturnAddress(void* retAddr, void* stackPtr) {
+	CallFrame* frame = getCallStack().push(this);
+	if (!frame) {
+		DYNO_LOG_ERR("Too many nested hooked calls in this context, the return address is lost");
+		return;
+	}
+
+	frame->stackPtr = stackPtr;
+	frame->retAddr = retAddr;
 
-	// clear the stack address from the cache now that we ran the last post hook.
-	if (v.empty())
-		m_retAddr.erase(it);
+	if (m_trackCallers.load(std::memory_order_acquire)) {
+		if (CallerHistogram* callers = m_callers.load(std::memory_order_acquire))
+			callers->record((uintptr_t) retAddr);
+	}
+	frame->startNs = 0;
+	frame->perfStart = {};
+	frame->savedArgs = nullptr;
+	frame->savedReturn = nullptr;
+	frame->action = ReturnAction::Ignored;
+	frame->skipped = false;
 
-	return retAddr;
+	// redirect the return to the post stub, unless the ret sites run the post callbacks
+	if (!m_exitPatched.load(std::memory_order_relaxed))
+		*(uintptr_t*) stackPtr = m_newRetAddr;
 }
 
-void Hook::setReturnAddress(void* retAddr, void* stackPtr) {
-	m_retAddr[stackPtr].push_back(retAddr);
+void Hook::exitHandler(void* stackPtr) {
+	// calls redirected before the ret sites were patched return through the post stub,
+	// the ones which entered the function before the hook was installed have no frame
+	if (*(uintptr_t*) stackPtr == m_newRetAddr)
+		return;
+
+	CallStack& stack = getCallStack();
+	if (!stack.find(this, stackPtr))
+		return;
+
+	callbackHandler(CallbackType::Post);
+
+	CallFrame popped;
+	stack.pop(this, stackPtr, popped);
 }
\ No newline at end of file
@@ -1,4 +1,5 @@
 #include <dynohook/instruction.h>
+#include <dynohook/disassembler.h>
 #include <dynohook/mem_accessor.h>
 
 #include <cstring>
@@ -12,7 +13,7 @@ Instruction::Instruction(
 	uint8_t displacementOffset,
 	bool isRelative,
 	bool isIndirect,
-	std::vector<uint8_t>&& bytes,
+	Bytes bytes,
 	std::string&& mnemonic,
 	std::string&& opStr,
 	Mode mode
@@ -34,13 +35,31 @@ Instruction::Instruction(
 	m_dispSize{0},
 
 	m_mode{mode},
+	m_formatLazily{false},
 	m_uid{s_counter++},
 
-	m_bytes{std::move(bytes)},
+	m_bytes{bytes},
 	m_mnemonic{std::move(mnemonic)},
 	m_opStr{std::move(opStr)} {
 }
 
+Instruction::Instruction(
+	const MemAccessor* accessor,
+	uintptr_t address,
+	const uint8_t* bytes,
+	uint8_t size,
+	const char* mnemonic,
+	Mode mode
+) : Instruction(accessor, address, Displacement{0}, 0, false, false, Bytes(bytes, size), mnemonic, {}, mode) {
+	m_formatLazily = true;
+}
+
+std::string Instruction::getFullName() const {
+	if (m_formatLazily)
+		return m_mnemonic + " " + ZydisDisassembler::formatOperands(*this);
+	return m_mnemonic + " " + m_opStr;
+}
+
 void Instruction::setDestination(uintptr_t dest) {
 	if (!hasDisplacement())
 		return;
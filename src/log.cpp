@@ -17,6 +17,10 @@ void ErrorLogger::log(const std::string& msg, ErrorLevel level) {
 	push(msg, level);
 }
 
+bool ErrorLogger::isEnabled(ErrorLevel level) const {
+	return level >= m_level && level != ErrorLevel::NONE;
+}
+
 void ErrorLogger::push(const std::string& msg, ErrorLevel level) {
 	if (level >= m_level) {
 		switch (level) {
@@ -54,4 +58,174 @@ void ErrorLogger::setLogLevel(ErrorLevel level) {
 ErrorLogger& ErrorLogger::Get() {
 	static ErrorLogger logger;
 	return logger;
+}
+
+namespace {
+	const char* levelPrefix(ErrorLevel level) {
+		switch (level) {
+			case ErrorLevel::INFO: return "[+] Info: ";
+			case ErrorLevel::WARN: return "[!] Warn: ";
+			case ErrorLevel::ERR: return "[!] Error: ";
+			default: return "Unsupported error message logged ";
+		}
+	}
+}
+
+AsyncLogger::AsyncLogger(size_t capacity, std::FILE* out, std::chrono::milliseconds flushInterval, bool start) : m_out{out}, m_flushInterval{flushInterval} {
+	size_t size = 1;
+	while (size < capacity)
+		size <<= 1;
+
+	m_records = std::make_unique<Record[]>(size);
+	m_mask = size - 1;
+	for (size_t i = 0; i < size; i++)
+		m_records[i].sequence.store(i, std::memory_order_relaxed);
+
+	if (start)
+		this->start();
+}
+
+AsyncLogger::~AsyncLogger() {
+	// never started, the messages queued so far are written out here
+	if (!m_thread.joinable()) {
+		drain();
+		return;
+	}
+
+	wake(true);
+	m_thread.join();
+}
+
+void AsyncLogger::start() {
+	if (!m_thread.joinable())
+		m_thread = std::thread(&AsyncLogger::run, this);
+}
+
+void AsyncLogger::wake(bool stop) {
+	{
+		std::lock_guard<std::mutex> lock(m_wakeMutex);
+		m_wakeRequested = true;
+		if (stop)
+			m_stop = true;
+	}
+	m_wake.notify_one();
+}
+
+bool AsyncLogger::isEnabled(ErrorLevel level) const {
+	return level >= m_level.load(std::memory_order_relaxed) && level != ErrorLevel::NONE;
+}
+
+void AsyncLogger::setLogLevel(ErrorLevel level) {
+	m_level.store(level, std::memory_order_relaxed);
+}
+
+void AsyncLogger::log(const std::string& msg, ErrorLevel level) {
+	if (!isEnabled(level))
+		return;
+
+	// claim a slot, bounded MPMC ring with per record sequence numbers
+	size_t pos = m_head.load(std::memory_order_relaxed);
+	Record* record;
+	for (;;) {
+		record = &m_records[pos & m_mask];
+		const size_t seq = record->sequence.load(std::memory_order_acquire);
+		const auto diff = (intptr_t) seq - (intptr_t) pos;
+		if (diff == 0) {
+			if (m_head.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed))
+				break;
+		} else if (diff < 0) {
+			m_dropped.fetch_add(1, std::memory_order_relaxed);
+			return;
+		} else {
+			pos = m_head.load(std::memory_order_relaxed);
+		}
+	}
+
+	const char* prefix = levelPrefix(level);
+	const size_t prefixLen = std::strlen(prefix);
+	const size_t room = kRecordSize - prefixLen - 1; // keep space for the newline
+	size_t msgLen = msg.size();
+	if (msgLen > room) {
+		msgLen = room;
+		m_truncated.fetch_add(1, std::memory_order_relaxed);
+	}
+
+	std::memcpy(record->text, prefix, prefixLen);
+	std::memcpy(record->text + prefixLen, msg.data(), msgLen);
+	record->text[prefixLen + msgLen] = '\n';
+	record->length = (uint16_t) (prefixLen + msgLen + 1);
+
+	record->sequence.store(pos + 1, std::memory_order_release);
+}
+
+size_t AsyncLogger::drain() {
+	// one write and one flush per batch instead of one per message
+	char batch[16 * kRecordSize];
+	size_t batchLen = 0;
+	size_t count = 0;
+
+	for (;;) {
+		Record& record = m_records[m_tail & m_mask];
+		if (record.sequence.load(std::memory_order_acquire) != m_tail + 1)
+			break;
+
+		if (batchLen + record.length > sizeof(batch)) {
+			std::fwrite(batch, 1, batchLen, m_out);
+			batchLen = 0;
+		}
+
+		std::memcpy(batch + batchLen, record.text, record.length);
+		batchLen += record.length;
+
+		record.sequence.store(m_tail + m_mask + 1, std::memory_order_release);
+		m_tail++;
+		count++;
+	}
+
+	if (batchLen) {
+		std::fwrite(batch, 1, batchLen, m_out);
+		std::fflush(m_out);
+	}
+
+	m_written.fetch_add(count, std::memory_order_relaxed);
+	m_flushed.store(m_tail, std::memory_order_release);
+	return count;
+}
+
+void AsyncLogger::run() {
+	std::unique_lock<std::mutex> lock(m_wakeMutex);
+	while (!m_stop) {
+		lock.unlock();
+		const size_t count = drain();
+		lock.lock();
+
+		// producers never wait for the lock, the ring is drained at least once per interval
+		if (count == 0)
+			m_wake.wait_for(lock, m_flushInterval, [this] { return m_wakeRequested || m_stop; });
+		m_wakeRequested = false;
+	}
+	lock.unlock();
+
+	drain();
+}
+
+void AsyncLogger::flush() {
+	// woken again while waiting, a record still being written may have sent the thread back to sleep
+	const size_t target = m_head.load(std::memory_order_acquire);
+	while (m_flushed.load(std::memory_order_acquire) < target) {
+		wake(false);
+		std::this_thread::yield();
+	}
+}
+
+uint64_t AsyncLogger::getWrittenCount() const {
+	return m_written.load(std::memory_order_relaxed);
+}
+
+uint64_t AsyncLogger::getDroppedCount() const {
+	return m_dropped.load(std::memory_order_relaxed);
+}
+
+uint64_t AsyncLogger::getTruncatedCount() const {
+	return m_truncated.load(std::memory_order_relaxed);
 }
\ No newline at end of file
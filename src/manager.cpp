@@ -1,7 +1,32 @@
 #include <dynohook/manager.h>
+#include <dynohook/fork_guard.h>
+
+#if DYNO_PLATFORM_LINUX || DYNO_PLATFORM_APPLE
+#include <dlfcn.h>
+#endif
 
 using namespace dyno;
 
+namespace {
+	std::string symbolize(uintptr_t address) {
+#if DYNO_PLATFORM_LINUX || DYNO_PLATFORM_APPLE
+		Dl_info info{};
+		if (!dladdr((void*) address, &info))
+			return {};
+
+		if (info.dli_sname && info.dli_saddr)
+			return address == (uintptr_t) info.dli_saddr ? info.dli_sname : info.dli_sname + ("+" + int_to_hex(address - (uintptr_t) info.dli_saddr));
+
+		// static functions have no dynamic symbol, the module offset still finds them with addr2line
+		if (info.dli_fname && info.dli_fbase)
+			return std::string{ info.dli_fname } + "+" + int_to_hex(address - (uintptr_t) info.dli_fbase);
+#else
+		DYNO_UNUSED(address);
+#endif
+		return {};
+	}
+}
+
 HookManager::HookManager() : m_cache{std::make_shared<VHookCache>()} {
 }
 
@@ -13,13 +38,27 @@ std::shared_ptr<IHook> HookManager::hookDetour(void* pFunc, const ConvFunc& conv
 
 	auto it = m_detours.find(pFunc);
 	if (it != m_detours.end())
-		return it->second;
+		return getDispatchHook(it->second);
 
 	auto detour = std::make_shared<NatDetour>((uintptr_t)pFunc, convention);
-	if (!detour->hook())
+
+	// a function which is already entered through a vtable slot keeps that bridge and its callbacks
+	auto existing = m_cache->find(pFunc);
+	if (existing)
+		detour->setDispatcher(existing);
+
+	const bool hooked = detour->hook();
+	addInstallReport(detour->getInstallReport());
+	if (!hooked)
 		return nullptr;
 
 	m_detours.emplace(pFunc, detour);
+	m_watchdog.add(detour);
+	if (existing)
+		return existing;
+
+	m_cache->add(pFunc, detour);
+	trackHook(detour, (uintptr_t)pFunc, &detour->getInstallReport());
 	return detour;
 }
 
@@ -30,12 +69,18 @@ std::shared_ptr<IHook> HookManager::hookVirtual(void* pClass, int index, const C
 	std::lock_guard<std::mutex> m_lock(m_mutex);
 
 	auto it = m_vtables.find(pClass);
-	if (it != m_vtables.end())
-		return it->second->hook(index, convention);
+	if (it != m_vtables.end()) {
+		auto hook = it->second->hook(index, convention);
+		if (hook) trackHook(hook, hook->getAddress());
+		return hook;
+	}
 
 	auto vtable = std::make_unique<VTable>(pClass, m_cache);
 	auto hook = vtable->hook(index, convention);
-	if (hook) m_vtables.emplace(pClass, std::move(vtable));
+	if (hook) {
+		m_vtables.emplace(pClass, std::move(vtable));
+		trackHook(hook, hook->getAddress());
+	}
 	return hook;
 }
 
@@ -51,7 +96,9 @@ std::shared_ptr<IHook> HookManager::hookVirtual(void* pClass, void* pFunc, const
 		int index = table->getVTableIndex(pFunc);
 		if (index == -1)
 			return nullptr;
-		return table->hook(index, convention);
+		auto hook = table->hook(index, convention);
+		if (hook) trackHook(hook, hook->getAddress());
+		return hook;
 	}
 
 	auto vtable = std::make_unique<VTable>(pClass, m_cache);
@@ -61,7 +108,29 @@ std::shared_ptr<IHook> HookManager::hookVirtual(void* pClass, void* pFunc, const
 		return nullptr;
 
 	auto hook = vtable->hook(index, convention);
-	if (hook) m_vtables.emplace(pClass, std::move(vtable));
+	if (hook) {
+		m_vtables.emplace(pClass, std::move(vtable));
+		trackHook(hook, hook->getAddress());
+	}
+	return hook;
+}
+
+std::shared_ptr<IHook> HookManager::hookSlot(void** slot, const ConvFunc& convention) {
+	if (!slot)
+		return nullptr;
+
+	std::lock_guard<std::mutex> m_lock(m_mutex);
+
+	auto it = m_slots.find(slot);
+	if (it != m_slots.end())
+		return it->second->find();
+
+	auto funcSlot = std::make_unique<FuncSlot>(slot, m_cache);
+	auto hook = funcSlot->hook(convention);
+	if (hook) {
+		m_slots.emplace(slot, std::move(funcSlot));
+		trackHook(hook, hook->getAddress());
+	}
 	return hook;
 }
 
@@ -73,7 +142,15 @@ bool HookManager::unhookDetour(void* pFunc) {
 
 	auto it = m_detours.find(pFunc);
 	if (it != m_detours.end()) {
+		auto detour = std::move(it->second);
+		m_watchdog.remove(detour.get());
 		m_detours.erase(it);
+
+		// vtable slots can keep the bridge alive, which continues in the restored function then
+		if (detour->isHooked())
+			detour->unhook();
+		detour.reset();
+		m_cache->release(pFunc);
 		return true;
 	}
 
@@ -127,9 +204,24 @@ bool HookManager::unhookVirtual(void* pClass, void* pFunc) {
 	return false;
 }
 
+bool HookManager::unhookSlot(void** slot) {
+	if (!slot)
+		return false;
+
+	std::lock_guard<std::mutex> m_lock(m_mutex);
+
+	auto it = m_slots.find(slot);
+	if (it == m_slots.end())
+		return false;
+
+	it->second->unhook();
+	m_slots.erase(it);
+	return true;
+}
+
 std::shared_ptr<IHook> HookManager::findDetour(void* pFunc) const {
 	auto it = m_detours.find(pFunc);
-	return it != m_detours.end() ? it->second : nullptr;
+	return it != m_detours.end() ? getDispatchHook(it->second) : nullptr;
 }
 
 std::shared_ptr<IHook> HookManager::findVirtual(void* pClass, int index) const {
@@ -149,12 +241,22 @@ std::shared_ptr<IHook> HookManager::findVirtual(void* pClass, void* pFunc) const
 	return nullptr;
 }
 
+std::shared_ptr<IHook> HookManager::findSlot(void** slot) const {
+	auto it = m_slots.find(slot);
+	return it != m_slots.end() ? it->second->find() : nullptr;
+}
+
 void HookManager::unhookAll() {
 	std::lock_guard<std::mutex> m_lock(m_mutex);
 
 	m_cache->clear();
+	m_watchdog.clear();
+	m_statsExporter.clear();
+	m_governor.clear();
+	m_tracked.clear();
 	m_detours.clear();
 	m_vtables.clear();
+	m_slots.clear();
 }
 
 void HookManager::unhookAllVirtual(void* pClass) {
@@ -174,6 +276,174 @@ void HookManager::clearCache() {
 	m_cache->cleanup();
 }
 
+bool HookManager::startWatchdog(std::chrono::milliseconds interval, uint32_t maxRepairsPerSweep) {
+	std::lock_guard<std::mutex> m_lock(m_mutex);
+
+	return m_watchdog.start(interval, maxRepairsPerSweep);
+}
+
+void HookManager::stopWatchdog() {
+	std::lock_guard<std::mutex> m_lock(m_mutex);
+
+	m_watchdog.stop();
+}
+
+WatchdogStats HookManager::getWatchdogStats() const {
+	return m_watchdog.getStats();
+}
+
+std::vector<InstallReport> HookManager::getInstallReports() const {
+	std::lock_guard<std::mutex> m_lock(m_mutex);
+
+	return m_installReports;
+}
+
+InstallTotals HookManager::getInstallTotals() const {
+	std::lock_guard<std::mutex> m_lock(m_mutex);
+
+	return m_installTotals;
+}
+
+bool HookManager::startStatsExport(const std::string& name, std::chrono::milliseconds interval, size_t capacity) {
+	std::lock_guard<std::mutex> m_lock(m_mutex);
+
+	return m_statsExporter.start(name, interval, capacity);
+}
+
+void HookManager::stopStatsExport() {
+	std::lock_guard<std::mutex> m_lock(m_mutex);
+
+	m_statsExporter.stop();
+}
+
+std::string HookManager::getStatsExportPath() const {
+	return m_statsExporter.getPath();
+}
+
+bool HookManager::startGovernor(const GovernorBudget& budget, std::chrono::milliseconds interval) {
+	std::lock_guard<std::mutex> m_lock(m_mutex);
+
+	return m_governor.start(budget, interval);
+}
+
+void HookManager::stopGovernor() {
+	std::lock_guard<std::mutex> m_lock(m_mutex);
+
+	m_governor.stop();
+}
+
+GovernorStats HookManager::getGovernorStats() const {
+	return m_governor.getStats();
+}
+
+bool HookManager::enableForkMode() {
+	std::lock_guard<std::mutex> m_lock(m_mutex);
+
+	if (!m_detours.empty() || !m_vtables.empty() || !m_slots.empty())
+		DYNO_LOG_WARN("Fork mode enabled after hooks were created, their state stays on the heap");
+
+	return ForkGuard::enable();
+}
+
+void HookManager::setContextProvider(ContextProvider provider) {
+	CallStack::setProvider(provider);
+}
+
+void HookManager::setHandlerProfiling(uint32_t sampleEvery) {
+	std::lock_guard<std::mutex> m_lock(m_mutex);
+
+	m_profileEvery = sampleEvery;
+	for (const auto& [pFunc, hook] : m_cache->getHooks())
+		hook->setHandlerProfiling(sampleEvery);
+}
+
+std::vector<HandlerProfile> HookManager::getHandlerProfiles() const {
+	std::vector<HandlerProfile> profiles;
+	{
+		std::lock_guard<std::mutex> m_lock(m_mutex);
+
+		for (const auto& [pFunc, hook] : m_cache->getHooks()) {
+			auto hookProfiles = hook->getHandlerProfiles();
+			// detours report their trampoline as address
+			for (auto& profile : hookProfiles)
+				profile.function = (uintptr_t) pFunc;
+			profiles.insert(profiles.end(), hookProfiles.begin(), hookProfiles.end());
+		}
+	}
+
+	// dladdr takes the loader lock, resolve outside of ours
+	for (auto& profile : profiles)
+		profile.symbol = symbolize(profile.handler);
+	return profiles;
+}
+
+void HookManager::setCallerTracking(bool state) {
+	std::lock_guard<std::mutex> m_lock(m_mutex);
+
+	m_trackCallers = state;
+	for (const auto& [pFunc, hook] : m_cache->getHooks())
+		hook->setCallerTracking(state);
+}
+
+std::vector<CallerProfile> HookManager::getCallerProfiles() const {
+	std::vector<CallerProfile> profiles;
+	{
+		std::lock_guard<std::mutex> m_lock(m_mutex);
+
+		for (const auto& [pFunc, hook] : m_cache->getHooks()) {
+			auto hookProfiles = hook->getCallerProfiles();
+			for (auto& profile : hookProfiles)
+				profile.function = (uintptr_t) pFunc;
+			profiles.insert(profiles.end(), hookProfiles.begin(), hookProfiles.end());
+		}
+	}
+
+	// symbolized on demand only, the bridge records bare addresses
+	for (auto& profile : profiles) {
+		if (profile.caller)
+			profile.symbol = symbolize(profile.caller);
+	}
+	return profiles;
+}
+
+void HookManager::trackHook(const std::shared_ptr<Hook>& hook, uintptr_t address, const InstallReport* report) {
+	// shared bridges are tracked again through every entry, they keep what was set on them since
+	if (m_tracked.size() >= m_trackedSweep) {
+		std::erase_if(m_tracked, [](const auto& entry) { return entry.second.expired(); });
+		m_trackedSweep = std::max<size_t>(64, m_tracked.size() * 2);
+	}
+
+	auto& tracked = m_tracked[hook.get()];
+	if (tracked.expired()) {
+		tracked = hook;
+		hook->setHandlerProfiling(m_profileEvery);
+		if (m_trackCallers)
+			hook->setCallerTracking(true);
+	}
+
+	m_statsExporter.add(hook, address, report);
+	m_governor.add(hook, address);
+}
+
+void HookManager::addInstallReport(const InstallReport& report) {
+	m_installReports.push_back(report);
+
+	m_installTotals.installs++;
+	if (!report.success)
+		m_installTotals.failures++;
+	if (report.prologueCached)
+		m_installTotals.prologueCacheHits++;
+
+	m_installTotals.disassemblyNs += report.disassemblyNs;
+	m_installTotals.followJmpNs += report.followJmpNs;
+	m_installTotals.schemeSelectionNs += report.schemeSelectionNs;
+	m_installTotals.bridgeNs += report.bridgeNs;
+	m_installTotals.relocationNs += report.relocationNs;
+	m_installTotals.translationNs += report.translationNs;
+	m_installTotals.patchNs += report.patchNs;
+	m_installTotals.totalNs += report.totalNs;
+}
+
 IHookManager& HookManager::Get() {
 	static HookManager s_manager;
 	return s_manager;
@@ -44,6 +44,13 @@ ProtFlag MemAccessor::mem_protect(uintptr_t dest, size_t size, ProtFlag prot, bo
 	return TranslateProtection((int)orig);
 }
 
+ProtFlag MemAccessor::mem_query(uintptr_t address) const {
+	MEMORY_BASIC_INFORMATION info;
+	if (VirtualQuery((char*)address, &info, sizeof(info)) == 0 || info.State != MEM_COMMIT)
+		return ProtFlag::UNSET;
+	return TranslateProtection((int)info.Protect);
+}
+
 #elif DYNO_PLATFORM_LINUX
 
 #include <fstream>
@@ -131,6 +138,10 @@ ProtFlag MemAccessor::mem_protect(uintptr_t dest, size_t size, ProtFlag prot, bo
 	return region_infos.prot;
 }
 
+ProtFlag MemAccessor::mem_query(uintptr_t address) const {
+	return get_region_from_addr(address).prot;
+}
+
 #elif DYNO_PLATFORM_APPLE
 
 bool MemAccessor::mem_copy(uintptr_t dest, uintptr_t src, size_t size) const {
@@ -163,13 +174,24 @@ ProtFlag MemAccessor::mem_protect(uintptr_t dest, size_t size, ProtFlag prot, bo
 	return ProtFlag::R | ProtFlag::X;
 }
 
+ProtFlag MemAccessor::mem_query(uintptr_t address) const {
+	mach_vm_address_t region = (mach_vm_address_t)address;
+	mach_vm_size_t size = 0;
+	vm_region_basic_info_data_64_t info;
+	mach_msg_type_number_t count = VM_REGION_BASIC_INFO_COUNT_64;
+	mach_port_t object = MACH_PORT_NULL;
+	if (mach_vm_region(mach_task_self(), &region, &size, VM_REGION_BASIC_INFO_64, (vm_region_info_t)&info, &count, &object) != KERN_SUCCESS || region > address)
+		return ProtFlag::UNSET;
+	return TranslateProtection(info.protection);
+}
+
 #endif
 
 /**
  * Write a 14 byte indirect near jump.
  */
 insts_t MemAccessor::makex64Jump(uintptr_t address, uintptr_t destination) {
-	std::vector<uint8_t> bytes(14);
+	Instruction::Bytes bytes(14);
 	bytes[0] = 0xFF;
 	bytes[1] = 0x25;
 	std::memcpy(&bytes[6], &destination, 8);
@@ -185,7 +207,7 @@ insts_t MemAccessor::makex64PreferredJump(uintptr_t address, uintptr_t destinati
 	Instruction::Displacement zeroDisp{0};
 	uintptr_t curInstAddress = address;
 
-	std::vector<uint8_t> raxBytes = { 0x50 };
+	Instruction::Bytes raxBytes = { 0x50 };
 	Instruction pushRax(this,
 						curInstAddress,
 						zeroDisp,
@@ -200,7 +222,7 @@ insts_t MemAccessor::makex64PreferredJump(uintptr_t address, uintptr_t destinati
 	std::stringstream ss;
 	ss << std::hex << destination;
 
-	std::vector<uint8_t> movRaxBytes(10);
+	Instruction::Bytes movRaxBytes(10);
 	movRaxBytes[0] = 0x48;
 	movRaxBytes[1] = 0xB8;
 	std::memcpy(&movRaxBytes[2], &destination, 8);
@@ -209,12 +231,12 @@ insts_t MemAccessor::makex64PreferredJump(uintptr_t address, uintptr_t destinati
 					   std::move(movRaxBytes), "mov", "rax, " + ss.str(), Mode::x64);
 	curInstAddress += movRax.size();
 
-	std::vector<uint8_t> xchgBytes = { 0x48, 0x87, 0x04, 0x24 };
+	Instruction::Bytes xchgBytes = { 0x48, 0x87, 0x04, 0x24 };
 	Instruction xchgRspRax(this, curInstAddress, zeroDisp, 0, false, false,
 						   std::move(xchgBytes), "xchg", "QWORD PTR [rsp],rax", Mode::x64);
 	curInstAddress += xchgRspRax.size();
 
-	std::vector<uint8_t> retBytes = { 0xC3 };
+	Instruction::Bytes retBytes = { 0xC3 };
 	Instruction ret(this, curInstAddress, zeroDisp, 0, false, false,
 					std::move(retBytes), "ret", "", Mode::x64);
 
@@ -231,11 +253,11 @@ insts_t MemAccessor::makex64MinimumJump(uintptr_t address, uintptr_t destination
 	Instruction::Displacement disp{0};
 	disp.Relative = Instruction::calculateRelativeDisplacement<int32_t>(address, destHolder, 6);
 
-	std::vector<uint8_t> destBytes(8);
+	Instruction::Bytes destBytes(8);
 	std::memcpy(destBytes.data(), &destination, 8);
 	Instruction specialDest(this, destHolder, disp, 0, false, false, std::move(destBytes), "dest holder", "", Mode::x64);
 
-	std::vector<uint8_t> bytes(6);
+	Instruction::Bytes bytes(6);
 	bytes[0] = 0xFF;
 	bytes[1] = 0x25;
 	std::memcpy(&bytes[2], &disp.Relative, 4);
@@ -250,7 +272,7 @@ insts_t MemAccessor::makex86Jmp(uintptr_t address, uintptr_t destination) {
 	Instruction::Displacement disp{0};
 	disp.Relative = Instruction::calculateRelativeDisplacement<int32_t>(address, destination, 5);
 
-	std::vector<uint8_t> bytes(5);
+	Instruction::Bytes bytes(5);
 	bytes[0] = 0xE9;
 	std::memcpy(&bytes[1], &disp.Relative, 4);
 
@@ -266,7 +288,7 @@ insts_t MemAccessor::makeAgnosticJmp(uintptr_t address, uintptr_t destination) {
 }
 
 insts_t MemAccessor::makex64DestHolder(uintptr_t destination, uintptr_t destHolder) {
-	std::vector<uint8_t> destBytes(8);
+	Instruction::Bytes destBytes(8);
 	std::memcpy(destBytes.data(), &destination, 8);
 	return insts_t{ Instruction(this, destHolder, Instruction::Displacement{0}, 0, false, false, std::move(destBytes), "dest holder", "", Mode::x64) };
 }
@@ -0,0 +1,168 @@
+#include <dynohook/perf_counters.h>
+#include <dynohook/os.h>
+
+#if DYNO_PLATFORM_LINUX
+#include <linux/perf_event.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <cpuid.h>
+#include <cerrno>
+#endif
+
+using namespace dyno;
+
+namespace {
+#if DYNO_PLATFORM_LINUX
+	struct EventConfig {
+		uint32_t type;
+		uint64_t config;
+	};
+
+	bool isIntel() {
+		unsigned int eax = 0, ebx = 0, ecx = 0, edx = 0;
+		if (!__get_cpuid(0, &eax, &ebx, &ecx, &edx))
+			return false;
+		return ebx == 0x756E6547 && edx == 0x49656E69 && ecx == 0x6C65746E; // "GenuineIntel"
+	}
+
+	bool eventConfig(PerfEvent event, EventConfig& out) {
+		switch (event) {
+			case PerfEvent::Instructions:
+				out = { PERF_TYPE_HARDWARE, PERF_COUNT_HW_INSTRUCTIONS };
+				return true;
+			case PerfEvent::BranchMisses:
+				out = { PERF_TYPE_HARDWARE, PERF_COUNT_HW_BRANCH_MISSES };
+				return true;
+			case PerfEvent::ITlbMisses:
+				out = { PERF_TYPE_HW_CACHE, PERF_COUNT_HW_CACHE_ITLB | (PERF_COUNT_HW_CACHE_OP_READ << 8) | (PERF_COUNT_HW_CACHE_RESULT_MISS << 16) };
+				return true;
+			case PerfEvent::MachineClears:
+				// MACHINE_CLEARS.COUNT, the generic events have no equivalent
+				if (!isIntel())
+					return false;
+				out = { PERF_TYPE_RAW, 0x01C3 };
+				return true;
+		}
+		return false;
+	}
+#endif
+}
+
+PerfCounters::~PerfCounters() {
+	close();
+}
+
+bool PerfCounters::open() {
+	close();
+
+#if DYNO_PLATFORM_LINUX
+	for (size_t i = 0; i < kPerfEventCount; i++) {
+		const auto event = (PerfEvent) i;
+
+		EventConfig config{};
+		if (!eventConfig(event, config)) {
+			m_error += std::string(name(event)) + ": unknown on this cpu; ";
+			continue;
+		}
+
+		perf_event_attr attr{};
+		attr.size = sizeof(attr);
+		attr.type = config.type;
+		attr.config = config.config;
+		attr.disabled = m_leader == -1; // the group starts together with its leader
+		attr.exclude_kernel = 1;
+		attr.exclude_hv = 1;
+		attr.read_format = PERF_FORMAT_GROUP;
+
+		const int fd = (int) syscall(SYS_perf_event_open, &attr, 0, -1, m_leader, PERF_FLAG_FD_CLOEXEC);
+		if (fd == -1) {
+			m_error += std::string(name(event)) + ": " + std::strerror(errno) + "; ";
+			continue;
+		}
+
+		if (m_leader == -1)
+			m_leader = fd;
+
+		m_fds[i] = fd;
+		m_order[m_count++] = event;
+		m_available |= (uint8_t) (1u << i);
+	}
+
+	if (m_leader == -1)
+		return false;
+
+	ioctl(m_leader, PERF_EVENT_IOC_RESET, PERF_IOC_FLAG_GROUP);
+	ioctl(m_leader, PERF_EVENT_IOC_ENABLE, PERF_IOC_FLAG_GROUP);
+	return true;
+#else
+	m_error = "performance counters are only supported on linux";
+	return false;
+#endif
+}
+
+void PerfCounters::close() {
+#if DYNO_PLATFORM_LINUX
+	// members first, the leader owns the group
+	for (size_t i = m_count; i-- > 0;) {
+		int& fd = m_fds[(size_t) m_order[i]];
+		::close(fd);
+		fd = -1;
+	}
+#endif
+	m_count = 0;
+	m_leader = -1;
+	m_available = 0;
+	m_error.clear();
+}
+
+PerfSample PerfCounters::read() const {
+	PerfSample sample;
+#if DYNO_PLATFORM_LINUX
+	if (m_leader == -1)
+		return sample;
+
+	// PERF_FORMAT_GROUP: number of values followed by the values in the order the events were opened
+	uint64_t buffer[1 + kPerfEventCount];
+	const ssize_t bytes = ::read(m_leader, buffer, sizeof(buffer));
+	if (bytes < (ssize_t) sizeof(uint64_t))
+		return sample;
+
+	const size_t count = std::min<size_t>({ (size_t) buffer[0], m_count, (size_t) bytes / sizeof(uint64_t) - 1 });
+	for (size_t i = 0; i < count; i++) {
+		sample.values[(size_t) m_order[i]] = buffer[1 + i];
+		sample.valid |= (uint8_t) (1u << (uint8_t) m_order[i]);
+	}
+#endif
+	return sample;
+}
+
+const char* PerfCounters::name(PerfEvent event) {
+	switch (event) {
+		case PerfEvent::Instructions: return "instructions";
+		case PerfEvent::BranchMisses: return "branch_misses";
+		case PerfEvent::ITlbMisses: return "itlb_misses";
+		case PerfEvent::MachineClears: return "machine_clears";
+	}
+	return "";
+}
+
+PerfCounters& PerfCounters::forThisThread() {
+	thread_local PerfCounters counters;
+	thread_local bool opened = false;
+	if (!opened) {
+		opened = true;
+		if (!counters.open())
+			DYNO_LOG_WARN("No performance counters available: " + counters.getError());
+		else if (!counters.getError().empty())
+			DYNO_LOG_INFO("Some performance counters are unavailable: " + counters.getError());
+	}
+	return counters;
+}
+
+bool PerfCounters::isSupported() {
+	static const bool supported = [] {
+		PerfCounters probe;
+		return probe.open();
+	}();
+	return supported;
+}
\ No newline at end of file
@@ -0,0 +1,412 @@
+#include <dynohook/prebuilt_stubs.h>
+#include <dynohook/ihook.h>
+#include <dynohook/os.h>
+
+#include <array>
+#include <cstring>
+#include <utility>
+#include <vector>
+
+using namespace dyno;
+
+std::atomic<bool> PrebuiltStubs::s_enabled{ false };
+
+namespace {
+	// an instruction sequence with room for one address operand at hole
+	struct Snippet {
+		uint8_t bytes[16]{};
+		uint8_t size{ 0 };
+		uint8_t hole{ kNoHole };
+
+		static constexpr uint8_t kNoHole = 0xFF;
+	};
+
+	constexpr Snippet make(std::initializer_list<uint8_t> bytes, uint8_t hole = Snippet::kNoHole) {
+		Snippet snippet;
+		for (uint8_t byte : bytes)
+			snippet.bytes[snippet.size++] = byte;
+		snippet.hole = hole;
+		return snippet;
+	}
+
+	template<size_t N>
+	constexpr int indexOf(const RegisterType (&table)[N], RegisterType reg) {
+		for (size_t i = 0; i < N; i++) {
+			if (table[i] == reg)
+				return (int) i;
+		}
+		return -1;
+	}
+
+	// branches end with their rel32 operand
+	constexpr Snippet kJne = make({ 0x0F, 0x85, 0, 0, 0, 0 });
+	constexpr Snippet kJe = make({ 0x0F, 0x84, 0, 0, 0, 0 });
+
+	constexpr Snippet kCmpSupercede = make({ 0x3C, (uint8_t) ReturnAction::Supercede }); // cmp al, Supercede
+
+	constexpr Snippet ret(uint16_t popSize) {
+		if (popSize == 0)
+			return make({ 0xC3 });
+		return make({ 0xC2, (uint8_t) popSize, (uint8_t) (popSize >> 8) });
+	}
+
+#if DYNO_ARCH_X86 == 64
+	// the index is the number the register has in the modrm byte
+	constexpr RegisterType kGeneral[] = { RAX, RCX, RDX, RBX, RSP, RBP, RSI, RDI, R8, R9, R10, R11, R12, R13, R14, R15 };
+	constexpr RegisterType kVector[] = { XMM0, XMM1, XMM2, XMM3, XMM4, XMM5, XMM6, XMM7, XMM8, XMM9, XMM10, XMM11, XMM12, XMM13, XMM14, XMM15 };
+
+	// mov rax, address; then op with register n and [rax]
+	constexpr Snippet access(bool vector, uint8_t opcode, uint8_t n) {
+		Snippet snippet = make({ 0x48, 0xB8, 0, 0, 0, 0, 0, 0, 0, 0 }, 2);
+		if (vector) {
+			if (n >= 8)
+				snippet.bytes[snippet.size++] = 0x44;
+			snippet.bytes[snippet.size++] = 0x0F;
+		} else {
+			snippet.bytes[snippet.size++] = n >= 8 ? 0x4C : 0x48;
+		}
+		snippet.bytes[snippet.size++] = opcode;
+		snippet.bytes[snippet.size++] = (uint8_t) ((n & 7) << 3);
+		return snippet;
+	}
+#else
+	// the index is the number the register has in the modrm byte
+	constexpr RegisterType kGeneral[] = { EAX, ECX, EDX, EBX, ESP, EBP, ESI, EDI };
+	constexpr RegisterType kVector[] = { XMM0, XMM1, XMM2, XMM3, XMM4, XMM5, XMM6, XMM7 };
+
+	// op with register n and [address], absolute addressing needs no scratch register
+	constexpr Snippet access(bool vector, uint8_t opcode, uint8_t n) {
+		const auto modrm = (uint8_t) (0x05 | (n << 3));
+		if (vector)
+			return make({ 0x0F, opcode, modrm, 0, 0, 0, 0 }, 3);
+		return make({ opcode, modrm, 0, 0, 0, 0 }, 2);
+	}
+#endif
+
+	template<size_t... I>
+	constexpr std::array<Snippet, sizeof...(I)> makeTable(bool vector, uint8_t opcode, std::index_sequence<I...>) {
+		return { access(vector, opcode, (uint8_t) I)... };
+	}
+
+	constexpr auto kStoreGeneral = makeTable(false, 0x89, std::make_index_sequence<std::size(kGeneral)>{}); // mov [address], reg
+	constexpr auto kLoadGeneral = makeTable(false, 0x8B, std::make_index_sequence<std::size(kGeneral)>{}); // mov reg, [address]
+	constexpr auto kStoreVector = makeTable(true, 0x29, std::make_index_sequence<std::size(kVector)>{}); // movaps [address], xmm
+	constexpr auto kLoadVector = makeTable(true, 0x28, std::make_index_sequence<std::size(kVector)>{}); // movaps xmm, [address]
+
+#if DYNO_ARCH_X86 == 64
+	static_assert(kStoreGeneral[4].size == 13 && kStoreGeneral[4].bytes[12] == 0x20, "mov [rax], rsp");
+	static_assert(kLoadVector[9].size == 14 && kLoadVector[9].bytes[10] == 0x44 && kLoadVector[9].bytes[13] == 0x08, "movaps xmm9, [rax]");
+
+	// rax can use the moffs forms, which need no scratch register
+	constexpr Snippet kStoreRax = make({ 0x48, 0xA3, 0, 0, 0, 0, 0, 0, 0, 0 }, 2); // mov [address], rax
+	constexpr Snippet kLoadRax = make({ 0x48, 0xA1, 0, 0, 0, 0, 0, 0, 0, 0 }, 2); // mov rax, [address]
+
+	// mov r11, address; cmp byte ptr [r11], 0
+	constexpr Snippet kTestPassThrough = make({ 0x49, 0xBB, 0, 0, 0, 0, 0, 0, 0, 0, 0x41, 0x80, 0x3B, 0x00 }, 2);
+
+	constexpr Snippet kJmpSlot = make({ 0xFF, 0x25, 0, 0, 0, 0 }); // jmp qword ptr [rip+rel32]
+	constexpr Snippet kStoreReturnAddress = make({ 0x48, 0x89, 0x04, 0x24 }); // mov [rsp], rax
+
+#if DYNO_PLATFORM_WINDOWS
+	constexpr Snippet kMovThis = make({ 0x48, 0xB9, 0, 0, 0, 0, 0, 0, 0, 0 }, 2); // mov rcx, hook
+	constexpr Snippet kCall = make({ 0x48, 0x83, 0xEC, 0x28, 0x48, 0xB8, 0, 0, 0, 0, 0, 0, 0, 0, 0xFF, 0xD0 }, 6); // sub rsp, 40; mov rax, function; call rax (+8 = 48)
+	constexpr Snippet kCallEnd = make({ 0x48, 0x83, 0xC4, 0x28 }); // add rsp, 40
+	constexpr Snippet kSetReturnAddressArgs = make({ 0x49, 0x89, 0xE0, 0x48, 0x8B, 0x14, 0x24 }); // mov r8, rsp; mov rdx, [rsp]
+	constexpr Snippet kGetReturnAddressArgs = make({ 0x48, 0x89, 0xE2 }); // mov rdx, rsp
+	constexpr uint8_t kMovType = 0xBA; // mov edx, imm32
+#else // __systemV__
+	constexpr Snippet kMovThis = make({ 0x48, 0xBF, 0, 0, 0, 0, 0, 0, 0, 0 }, 2); // mov rdi, hook
+	constexpr Snippet kCall = make({ 0x48, 0x83, 0xEC, 0x18, 0x48, 0xB8, 0, 0, 0, 0, 0, 0, 0, 0, 0xFF, 0xD0 }, 6); // sub rsp, 24; mov rax, function; call rax (+8 = 32)
+	constexpr Snippet kCallEnd = make({ 0x48, 0x83, 0xC4, 0x18 }); // add rsp, 24
+	constexpr Snippet kSetReturnAddressArgs = make({ 0x48, 0x89, 0xE2, 0x48, 0x8B, 0x34, 0x24 }); // mov rdx, rsp; mov rsi, [rsp]
+	constexpr Snippet kGetReturnAddressArgs = make({ 0x48, 0x89, 0xE6 }); // mov rsi, rsp
+	constexpr uint8_t kMovType = 0xBE; // mov esi, imm32
+#endif
+
+	constexpr Snippet handlerArgs(CallbackType type) {
+		return make({ kMovType, (uint8_t) type, 0, 0, 0 });
+	}
+
+	constexpr Snippet subSp(uint32_t size) {
+		if (size < 0x80)
+			return make({ 0x48, 0x83, 0xEC, (uint8_t) size });
+		return make({ 0x48, 0x81, 0xEC, (uint8_t) size, (uint8_t) (size >> 8), (uint8_t) (size >> 16), (uint8_t) (size >> 24) });
+	}
+#else
+	static_assert(kStoreGeneral[4].size == 6 && kStoreGeneral[4].bytes[1] == 0x25, "mov [address], esp");
+	static_assert(kLoadVector[1].size == 7 && kLoadVector[1].bytes[2] == 0x0D, "movaps xmm1, [address]");
+
+	constexpr Snippet kTestPassThrough = make({ 0x80, 0x3D, 0, 0, 0, 0, 0x00 }, 2); // cmp byte ptr [address], 0
+
+	constexpr Snippet kJmpSlot = make({ 0xFF, 0x25, 0, 0, 0, 0 }); // jmp dword ptr [address]
+	constexpr Snippet kStoreReturnAddress = make({ 0x89, 0x04, 0x24 }); // mov [esp], eax
+
+	// cdecl member calls, +4 = 16 (aligned by 16 bytes)
+	constexpr Snippet kMovThis = make({ 0x68, 0, 0, 0, 0 }, 1); // push hook
+	constexpr Snippet kCall = make({ 0xB8, 0, 0, 0, 0, 0xFF, 0xD0 }, 1); // mov eax, function; call eax
+	constexpr Snippet kCallEnd = make({ 0x83, 0xC4, 0x0C }); // add esp, 12
+	constexpr Snippet kSetReturnAddressArgs = make({ 0x8B, 0x04, 0x24, 0x54, 0x50 }); // mov eax, [esp]; push esp; push eax
+	constexpr Snippet kGetReturnAddressArgs = make({ 0x89, 0xE0, 0x83, 0xEC, 0x04, 0x50 }); // mov eax, esp; sub esp, 4; push eax
+
+	constexpr Snippet handlerArgs(CallbackType type) {
+		return make({ 0x83, 0xEC, 0x04, 0x6A, (uint8_t) type }); // sub esp, 4; push type
+	}
+
+	constexpr Snippet subSp(uint32_t size) {
+		if (size < 0x80)
+			return make({ 0x83, 0xEC, (uint8_t) size });
+		return make({ 0x81, 0xEC, (uint8_t) size, (uint8_t) (size >> 8), (uint8_t) (size >> 16), (uint8_t) (size >> 24) });
+	}
+#endif
+
+	class Writer {
+	public:
+		size_t put(const Snippet& snippet, uintptr_t address = 0) {
+			const size_t offset = m_code.size();
+			m_code.insert(m_code.end(), snippet.bytes, snippet.bytes + snippet.size);
+			if (snippet.hole != Snippet::kNoHole)
+				std::memcpy(m_code.data() + offset + snippet.hole, &address, sizeof(address));
+			return offset;
+		}
+
+		// points the rel32 operand which ends the snippet put at offset to target
+		void link(size_t offset, const Snippet& snippet, size_t target) {
+			const size_t end = offset + snippet.size;
+			const int32_t rel = (int32_t) ((int64_t) target - (int64_t) end);
+			std::memcpy(m_code.data() + end - sizeof(rel), &rel, sizeof(rel));
+		}
+
+		// points the absolute operand which ends the snippet put at offset to target, rebased by place()
+		void linkAbsolute(size_t offset, const Snippet& snippet, size_t target) {
+			const size_t operand = offset + snippet.size - sizeof(uintptr_t);
+			std::memcpy(m_code.data() + operand, &target, sizeof(target));
+			m_relocations.push_back(operand);
+		}
+
+		size_t size() const {
+			return m_code.size();
+		}
+
+		// copies the code to where it's executed from
+		void place(uint8_t* destination, uintptr_t address) const {
+			std::memcpy(destination, m_code.data(), m_code.size());
+			for (const size_t operand : m_relocations) {
+				uintptr_t target;
+				std::memcpy(&target, destination + operand, sizeof(target));
+				target += address;
+				std::memcpy(destination + operand, &target, sizeof(target));
+			}
+		}
+
+	private:
+		std::vector<uint8_t> m_code;
+		std::vector<size_t> m_relocations;
+	};
+
+#if DYNO_ARCH_X86 == 64
+	// rax first, the others go through it
+	void writeSaveRegisters(Writer& w, const Registers& registers) {
+		for (const auto& reg : registers) {
+			if (reg == RAX) {
+				w.put(kStoreRax, reg.getAddress<uintptr_t>());
+				break;
+			}
+		}
+
+		for (const auto& reg : registers) {
+			if (reg == RAX)
+				continue;
+
+			const int general = indexOf(kGeneral, reg);
+			w.put(general >= 0 ? kStoreGeneral[general] : kStoreVector[indexOf(kVector, reg)], reg.getAddress<uintptr_t>());
+		}
+	}
+
+	// rax last, the others go through it
+	void writeRestoreRegisters(Writer& w, const Registers& registers) {
+		for (const auto& reg : registers) {
+			if (reg == RAX)
+				continue;
+
+			const int general = indexOf(kGeneral, reg);
+			w.put(general >= 0 ? kLoadGeneral[general] : kLoadVector[indexOf(kVector, reg)], reg.getAddress<uintptr_t>());
+		}
+
+		for (const auto& reg : registers) {
+			if (reg == RAX) {
+				w.put(kLoadRax, reg.getAddress<uintptr_t>());
+				break;
+			}
+		}
+	}
+
+	// the slot is addressed rip relative
+	void linkSlot(Writer& w, size_t jmp, size_t slot) {
+		w.link(jmp, kJmpSlot, slot);
+	}
+#else
+	void writeSaveRegisters(Writer& w, const Registers& registers) {
+		for (const auto& reg : registers) {
+			const int general = indexOf(kGeneral, reg);
+			w.put(general >= 0 ? kStoreGeneral[general] : kStoreVector[indexOf(kVector, reg)], reg.getAddress<uintptr_t>());
+		}
+	}
+
+	void writeRestoreRegisters(Writer& w, const Registers& registers) {
+		for (const auto& reg : registers) {
+			const int general = indexOf(kGeneral, reg);
+			w.put(general >= 0 ? kLoadGeneral[general] : kLoadVector[indexOf(kVector, reg)], reg.getAddress<uintptr_t>());
+		}
+	}
+
+	// the slot is addressed absolutely
+	void linkSlot(Writer& w, size_t jmp, size_t slot) {
+		w.linkAbsolute(jmp, kJmpSlot, slot);
+	}
+#endif
+
+	void writeCall(Writer& w, uintptr_t hook, uintptr_t function) {
+		w.put(kMovThis, hook);
+		w.put(kCall, function);
+		w.put(kCallEnd);
+	}
+
+	// does what the assembled bridge does without inline handlers, jmp is left for linkSlot()
+	Writer writeBridge(const Registers& registers, const PrebuiltStubs::Targets& targets, uint16_t popSize, size_t& jmp) {
+		Writer w;
+
+		// governed hooks may be switched to pass-through
+		w.put(kTestPassThrough, targets.passThrough);
+		const size_t toOriginal = w.put(kJne);
+
+		writeSaveRegisters(w, registers);
+
+		// redirect the return address to the post stub
+		w.put(kSetReturnAddressArgs);
+		writeCall(w, targets.hook, targets.setReturnAddress);
+
+		w.put(handlerArgs(CallbackType::Pre));
+		writeCall(w, targets.hook, targets.callbackHandler);
+		w.put(kCmpSupercede);
+
+		// the loads leave the flags alone
+		writeRestoreRegisters(w, registers);
+		const size_t toOverride = w.put(kJe);
+
+		w.link(toOriginal, kJne, w.size());
+		jmp = w.put(kJmpSlot);
+
+		w.link(toOverride, kJe, w.size());
+		w.put(ret(popSize));
+
+		return w;
+	}
+
+	// does what Hook::createPostCallback() generates
+	Writer writePostStub(const Registers& registers, const PrebuiltStubs::Targets& targets, uint16_t popSize) {
+		Writer w;
+
+		// back over the popped bytes and the return address, to reach the arguments again
+		w.put(subSp(popSize + sizeof(void*)));
+
+		writeSaveRegisters(w, registers);
+
+		w.put(handlerArgs(CallbackType::Post));
+		writeCall(w, targets.hook, targets.callbackHandler);
+
+		// put the original return address back into the slot it was taken from
+		w.put(kGetReturnAddressArgs);
+		writeCall(w, targets.hook, targets.getReturnAddress);
+		w.put(kStoreReturnAddress);
+
+		writeRestoreRegisters(w, registers);
+		w.put(ret(popSize));
+
+		return w;
+	}
+
+	uintptr_t mapPages(size_t size) {
+#if DYNO_PLATFORM_WINDOWS
+		return (uintptr_t) VirtualAlloc(nullptr, size, MEM_RESERVE | MEM_COMMIT, PAGE_READWRITE);
+#else
+		void* pages = mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+		return pages == MAP_FAILED ? 0 : (uintptr_t) pages;
+#endif
+	}
+
+	// writable until here, executable from now on
+	bool sealPages(uintptr_t address, size_t size) {
+#if DYNO_PLATFORM_WINDOWS
+		DWORD old;
+		if (!VirtualProtect((void*) address, size, PAGE_EXECUTE_READ, &old))
+			return false;
+		FlushInstructionCache(GetCurrentProcess(), (void*) address, size);
+		return true;
+#else
+		return mprotect((void*) address, size, PROT_READ | PROT_EXEC) == 0;
+#endif
+	}
+
+	void unmapPages(uintptr_t address, size_t size) {
+#if DYNO_PLATFORM_WINDOWS
+		DYNO_UNUSED(size);
+		VirtualFree((void*) address, 0, MEM_RELEASE);
+#else
+		munmap((void*) address, size);
+#endif
+	}
+}
+
+bool PrebuiltStubs::supports(const Registers& registers) {
+	for (const auto& reg : registers) {
+		if (indexOf(kGeneral, reg) < 0 && indexOf(kVector, reg) < 0)
+			return false;
+	}
+	return true;
+}
+
+bool PrebuiltStubs::create(const Registers& registers, const Targets& targets, uint16_t popSize, Code& code) {
+	size_t jmp = 0;
+	const Writer postStub = writePostStub(registers, targets, popSize);
+	Writer bridge = writeBridge(registers, targets, popSize, jmp);
+
+	// the continuation slot gets a data page of its own behind the code, which never has to become writable again
+	const size_t pageSize = getPageSize();
+	const size_t bridgeOffset = (postStub.size() + 15) & ~(size_t) 15;
+	const size_t codeSize = (bridgeOffset + bridge.size() + pageSize - 1) & ~(pageSize - 1);
+	const size_t size = codeSize + pageSize;
+	linkSlot(bridge, jmp, codeSize - bridgeOffset);
+
+	const uintptr_t address = mapPages(size);
+	if (!address) {
+		DYNO_LOG_ERR("Failed to map the pages of a prebuilt bridge");
+		return false;
+	}
+
+	postStub.place((uint8_t*) address, address);
+	bridge.place((uint8_t*) address + bridgeOffset, address + bridgeOffset);
+	*(uintptr_t*) (address + codeSize) = targets.continuation;
+
+	if (!sealPages(address, codeSize)) {
+		DYNO_LOG_ERR("Failed to make a prebuilt bridge executable");
+		unmapPages(address, size);
+		return false;
+	}
+
+	code.address = address;
+	code.size = size;
+	code.postStub = address;
+	code.postStubSize = postStub.size();
+	code.bridge = address + bridgeOffset;
+	code.bridgeSize = bridge.size();
+	code.continuation = address + codeSize;
+	return true;
+}
+
+void PrebuiltStubs::release(Code& code) {
+	if (!code.address)
+		return;
+
+	unmapPages(code.address, code.size);
+	code = {};
+}
\ No newline at end of file
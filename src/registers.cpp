@@ -1,4 +1,5 @@
 #include <dynohook/registers.h>
+#include <dynohook/fork_guard.h>
 
 #include <array>
 #include <algorithm>
@@ -46,45 +47,25 @@ regs_t Registers::s_scratch = {
 #endif // DYNO_ARCH_X86
 };
 
+// cache line aligned, carved from the hot arena in fork mode
 Register::Register(RegisterType type, RegisterSize size, uint8_t alignment) : m_type{type}, m_size{size}, m_alignment{alignment} {
 	if (m_size == 0)
 		m_address = nullptr;
-	else if (m_alignment > 0)
-#if DYNO_PLATFORM_WINDOWS
-		m_address = _aligned_malloc(m_size, m_alignment);
-#else
-		m_address = aligned_alloc(alignment, size);
-#endif
 	else
-		m_address = malloc(m_size);
+		m_address = ForkGuard::allocateHot(m_size);
 }
 
 Register::~Register() {
-	if (m_address) {
-#if DYNO_PLATFORM_WINDOWS
-		if (m_alignment > 0)
-			_aligned_free(m_address);
-		else
-			free(m_address);
-#else
-		free(m_address);
-#endif
-	}
+	ForkGuard::freeHot(m_address);
 }
 
 Register::Register(const Register& other) {
 	m_type = other.m_type;
 	m_size = other.m_size;
 	m_alignment = other.m_alignment;
-	if (m_alignment > 0)
-#if DYNO_PLATFORM_WINDOWS
-		m_address = _aligned_malloc(m_size, m_alignment);
-#else
-		m_address = aligned_alloc(m_alignment, m_size);
-#endif
-	else
-		m_address = malloc(m_size);
-	std::memcpy(m_address, other.m_address, m_size);
+	m_address = m_size == 0 ? nullptr : ForkGuard::allocateHot(m_size);
+	if (m_address)
+		std::memcpy(m_address, other.m_address, m_size);
 }
 
 Register::Register(Register&& other) noexcept {
@@ -0,0 +1,37 @@
+#include <dynohook/scratch_code.h>
+
+#include <vector>
+
+using namespace dyno;
+using namespace asmjit;
+
+namespace {
+	// holders of the thread which aren't borrowed right now, freed when it exits
+	struct Pool {
+		~Pool() {
+			for (CodeHolder* code : free)
+				delete code;
+		}
+
+		std::vector<CodeHolder*> free;
+	};
+
+	thread_local Pool t_pool;
+}
+
+ScratchCode::ScratchCode(const JitRuntime& runtime, uint64_t baseAddress) {
+	if (t_pool.free.empty()) {
+		m_code = new CodeHolder;
+	} else {
+		m_code = t_pool.free.back();
+		t_pool.free.pop_back();
+	}
+
+	m_code->init(runtime.environment(), runtime.cpuFeatures(), baseAddress);
+}
+
+ScratchCode::~ScratchCode() {
+	// detaches the assemblers still attached, keeps the memory of the zone
+	m_code->reset(ResetPolicy::kSoft);
+	t_pool.free.push_back(m_code);
+}
\ No newline at end of file
@@ -0,0 +1,288 @@
+#include <dynohook/stats_exporter.h>
+#include <dynohook/hook.h>
+#include <dynohook/os.h>
+
+#if DYNO_PLATFORM_LINUX
+#include <fcntl.h>
+#include <sys/stat.h>
+#endif
+
+using namespace dyno;
+
+static_assert(shm::kLatencyBuckets == kLatencyBuckets, "stats layout and hook stats disagree on the bucket count");
+
+namespace {
+	uint64_t nowNs() {
+		return (uint64_t) std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+	}
+
+	// sequence lock writer side, there is only ever one writer per entry
+	template<typename F>
+	void writeEntry(shm::Entry& entry, F&& update) {
+		const uint32_t sequence = entry.sequence.load(std::memory_order_relaxed);
+		entry.sequence.store(sequence + 1, std::memory_order_relaxed);
+		std::atomic_thread_fence(std::memory_order_release);
+		update(entry);
+		entry.sequence.store(sequence + 2, std::memory_order_release);
+	}
+}
+
+StatsExporter::~StatsExporter() {
+	stop();
+}
+
+bool StatsExporter::start(const std::string& name, std::chrono::milliseconds interval, size_t capacity) {
+	if (m_thread.joinable()) {
+		DYNO_LOG_WARN("Stats exporter is already running");
+		return false;
+	}
+
+	{
+		std::lock_guard<std::mutex> lock(m_mutex);
+
+		if (!map(name, capacity))
+			return false;
+
+		for (auto& source : m_sources) {
+			source.slot = -1;
+			if (auto hook = source.hook.lock())
+				hook->setLatencyTracking(true);
+		}
+		m_freeSlots.clear();
+	}
+
+	publish();
+
+	m_interval = interval;
+	m_stop = false;
+	m_thread = std::thread(&StatsExporter::run, this);
+	return true;
+}
+
+void StatsExporter::stop() {
+	if (m_thread.joinable()) {
+		{
+			std::lock_guard<std::mutex> lock(m_cvMutex);
+			m_stop = true;
+		}
+		m_cv.notify_all();
+		m_thread.join();
+	}
+
+	std::lock_guard<std::mutex> lock(m_mutex);
+
+	for (auto& source : m_sources) {
+		if (auto hook = source.hook.lock())
+			hook->setLatencyTracking(false);
+	}
+
+	unmap();
+}
+
+bool StatsExporter::isRunning() const {
+	return m_thread.joinable();
+}
+
+void StatsExporter::run() {
+	std::unique_lock<std::mutex> lock(m_cvMutex);
+	while (!m_cv.wait_for(lock, m_interval, [this] { return m_stop; })) {
+		lock.unlock();
+		publish();
+		lock.lock();
+	}
+}
+
+void StatsExporter::add(const std::shared_ptr<Hook>& hook, uintptr_t address, const InstallReport* report) {
+	if (!hook)
+		return;
+
+	std::lock_guard<std::mutex> lock(m_mutex);
+
+	// virtual hooks are shared between vtables, export them once
+	for (const auto& source : m_sources) {
+		if (source.key == hook.get() && !source.hook.expired())
+			return;
+	}
+
+	Source source{hook, hook.get(), address, -1, {}, 0, 0, 0};
+	if (report) {
+		std::strncpy(source.scheme, report->scheme, shm::kSchemeSize - 1);
+		source.prologueSize = report->prologueSize;
+		source.trampolineSize = report->trampolineSize;
+		source.installNs = report->totalNs;
+	}
+	m_sources.push_back(source);
+
+	if (m_header)
+		hook->setLatencyTracking(true);
+}
+
+void StatsExporter::clear() {
+	std::lock_guard<std::mutex> lock(m_mutex);
+
+	for (auto& source : m_sources) {
+		if (source.slot < 0 || !m_header)
+			continue;
+
+		writeEntry(*entry((size_t) source.slot), [](shm::Entry& e) {
+			e.address = 0;
+		});
+		m_freeSlots.push_back((uint32_t) source.slot);
+	}
+	m_sources.clear();
+}
+
+void StatsExporter::publish() {
+	std::lock_guard<std::mutex> lock(m_mutex);
+
+	if (!m_header)
+		return;
+
+	for (size_t i = 0; i < m_sources.size();) {
+		Source& source = m_sources[i];
+		auto hook = source.hook.lock();
+
+		if (!hook) {
+			// hook is gone, release its entry for the next one
+			if (source.slot >= 0) {
+				writeEntry(*entry((size_t) source.slot), [](shm::Entry& e) {
+					e.address = 0;
+				});
+				m_freeSlots.push_back((uint32_t) source.slot);
+			}
+			m_sources[i] = m_sources.back();
+			m_sources.pop_back();
+			continue;
+		}
+
+		if (source.slot < 0) {
+			if (!m_freeSlots.empty()) {
+				source.slot = m_freeSlots.back();
+				m_freeSlots.pop_back();
+			} else if (m_header->count.load(std::memory_order_relaxed) < m_header->capacity) {
+				source.slot = m_header->count.load(std::memory_order_relaxed);
+				m_header->count.store((uint32_t) source.slot + 1, std::memory_order_release);
+			} else {
+				i++;
+				continue; // segment is full, picked up again once an entry is released
+			}
+		}
+
+		const HookStats& stats = hook->getStats();
+		writeEntry(*entry((size_t) source.slot), [&](shm::Entry& e) {
+			e.mode = (uint8_t) hook->getMode();
+			e.address = source.address;
+			e.calls = stats.calls.load(std::memory_order_relaxed);
+			e.overrides = stats.overrides.load(std::memory_order_relaxed);
+			e.supercedes = stats.supercedes.load(std::memory_order_relaxed);
+			for (size_t j = 0; j < kLatencyBuckets; j++)
+				e.latency[j] = stats.latency[j].load(std::memory_order_relaxed);
+			std::memcpy(e.scheme, source.scheme, shm::kSchemeSize);
+			e.prologueSize = source.prologueSize;
+			e.trampolineSize = source.trampolineSize;
+			e.installNs = source.installNs;
+		});
+		i++;
+	}
+
+	m_header->updateNs.store(nowNs(), std::memory_order_relaxed);
+	m_header->generation.fetch_add(1, std::memory_order_release);
+}
+
+std::string StatsExporter::getPath() const {
+	std::lock_guard<std::mutex> lock(m_mutex);
+
+	if (!m_header)
+		return {};
+
+	if (!m_name.empty())
+		return "/dev/shm" + m_name;
+
+#if DYNO_PLATFORM_LINUX
+	return "/proc/" + std::to_string(getpid()) + "/fd/" + std::to_string(m_fd);
+#else
+	return {};
+#endif
+}
+
+shm::Entry* StatsExporter::entry(size_t slot) const {
+	return (shm::Entry*) ((uint8_t*) m_header + m_header->headerSize + slot * sizeof(shm::Entry));
+}
+
+bool StatsExporter::map(const std::string& name, size_t capacity) {
+#if DYNO_PLATFORM_LINUX
+	const size_t headerSize = (sizeof(shm::Header) + alignof(shm::Entry) - 1) & ~(alignof(shm::Entry) - 1);
+	const size_t size = headerSize + capacity * sizeof(shm::Entry);
+
+	int fd;
+	if (name.empty()) {
+		fd = memfd_create("dynohook-stats", MFD_CLOEXEC);
+	} else {
+		if (name.front() != '/' || name.find('/', 1) != std::string::npos) {
+			DYNO_LOG_ERR("Shared memory name has to start with a single '/': " + name);
+			return false;
+		}
+		fd = shm_open(name.c_str(), O_RDWR | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+	}
+
+	if (fd == -1) {
+		DYNO_LOG_ERR("Failed to create stats segment: " + std::string(std::strerror(errno)));
+		return false;
+	}
+
+	if (ftruncate(fd, (off_t) size) != 0) {
+		DYNO_LOG_ERR("Failed to size stats segment: " + std::string(std::strerror(errno)));
+		close(fd);
+		if (!name.empty())
+			shm_unlink(name.c_str());
+		return false;
+	}
+
+	void* memory = mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+	if (memory == MAP_FAILED) {
+		DYNO_LOG_ERR("Failed to map stats segment: " + std::string(std::strerror(errno)));
+		close(fd);
+		if (!name.empty())
+			shm_unlink(name.c_str());
+		return false;
+	}
+
+	// ftruncate zero fills, only the header has to be written
+	auto header = new (memory) shm::Header{};
+	header->version = shm::kVersion;
+	header->headerSize = (uint32_t) headerSize;
+	header->entrySize = sizeof(shm::Entry);
+	header->capacity = (uint32_t) capacity;
+	header->pid = (uint64_t) getpid();
+	std::atomic_thread_fence(std::memory_order_release);
+	header->magic = shm::kMagic; // written last, readers ignore the segment until it's set
+
+	m_header = header;
+	m_size = size;
+	m_fd = fd;
+	m_name = name;
+	return true;
+#else
+	DYNO_UNUSED(name);
+	DYNO_UNUSED(capacity);
+	DYNO_LOG_ERR("Stats export is not supported on this platform");
+	return false;
+#endif
+}
+
+void StatsExporter::unmap() {
+#if DYNO_PLATFORM_LINUX
+	if (!m_header)
+		return;
+
+	munmap(m_header, m_size);
+	close(m_fd);
+	if (!m_name.empty())
+		shm_unlink(m_name.c_str());
+
+	m_header = nullptr;
+	m_size = 0;
+	m_fd = -1;
+	m_name.clear();
+#endif
+}
\ No newline at end of file
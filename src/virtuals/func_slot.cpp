@@ -0,0 +1,70 @@
+#include <dynohook/virtuals/func_slot.h>
+#include <dynohook/core.h>
+#include <dynohook/log.h>
+#include <dynohook/mem_protector.h>
+
+#include <atomic>
+#include <optional>
+
+using namespace dyno;
+
+FuncSlot::FuncSlot(void** slot, std::shared_ptr<VHookCache> hookCache) : m_slot{slot}, m_hookCache{std::move(hookCache)} {
+}
+
+FuncSlot::~FuncSlot() {
+	if (m_hook)
+		unhook();
+}
+
+std::shared_ptr<Hook> FuncSlot::hook(const ConvFunc& convention) {
+	if (m_hook)
+		return m_hook;
+
+	void* original = std::atomic_ref<void*>(*m_slot).load(std::memory_order_acquire);
+	if (!isValidPtr(original)) {
+		DYNO_LOG_ERR("Function slot at " + int_to_hex((uintptr_t) m_slot) + " holds no function");
+		return nullptr;
+	}
+
+	auto hook = m_hookCache->get(original, convention);
+	if (!hook) {
+		DYNO_LOG_ERR("Invalid slot hook");
+		return nullptr;
+	}
+
+	if (!exchange(original, (void*) hook->getBridge())) {
+		DYNO_LOG_ERR("Function slot at " + int_to_hex((uintptr_t) m_slot) + " changed while it was hooked");
+		hook.reset();
+		m_hookCache->release(original);
+		return nullptr;
+	}
+
+	m_original = original;
+	m_hook = std::move(hook);
+	return m_hook;
+}
+
+bool FuncSlot::unhook() {
+	if (!m_hook)
+		return false;
+
+	// like unhooked vtable slots, the hook stays in the cache until clearCache(), so calls still inside the bridge finish
+	if (!exchange((void*) m_hook->getBridge(), m_original))
+		DYNO_LOG_WARN("Function slot at " + int_to_hex((uintptr_t) m_slot) + " was replaced by someone else, leaving it as it is");
+
+	m_hook.reset();
+	m_original = nullptr;
+	return true;
+}
+
+bool FuncSlot::exchange(void* expected, void* desired) {
+	// ops structs are often const and live in read only data, tables in code sections stay executable
+	const ProtFlag current = mem_query((uintptr_t) m_slot);
+	std::optional<MemProtector> protector;
+	if (current == ProtFlag::UNSET)
+		protector.emplace((uintptr_t) m_slot, sizeof(void*), ProtFlag::R | ProtFlag::W, *this);
+	else if (!(current & ProtFlag::W))
+		protector.emplace((uintptr_t) m_slot, sizeof(void*), current | ProtFlag::W, *this);
+
+	return std::atomic_ref<void*>(*m_slot).compare_exchange_strong(expected, desired, std::memory_order_acq_rel);
+}
\ No newline at end of file
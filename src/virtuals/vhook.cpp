@@ -1,3 +1,4 @@
+#include <dynohook/fork_guard.h>
 #include <dynohook/log.h>
 #include <dynohook/virtuals/vhook.h>
 
@@ -19,11 +20,13 @@ bool VHook::hook() {
 		DYNO_LOG_WARN("Vhook failed: hook already present");
 		return false;
 	}
+	ForkGuard::InstallScope scope;
 	// create the bridge function
 	if (!createBridge()) {
 		DYNO_LOG_ERR("Failed to create bridge");
 		return false;
 	}
+	registerCode();
 	m_hooked = true;
 	return true;
 }
@@ -34,6 +37,7 @@ bool VHook::unhook() {
 		DYNO_LOG_ERR("Vhook failed: no hook present");
 		return false;
 	}
+	ForkGuard::removeCode(this);
 	m_hooked = false;
 	// restore should be handled by holder
 	return true;
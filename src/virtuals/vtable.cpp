@@ -190,21 +190,40 @@ std::shared_ptr<Hook> VTable::find(int index) const {
 	return it != m_hooked.end() ? it->second : nullptr;
 }
 
-std::shared_ptr<VHook> VHookCache::get(void* pFunc, const ConvFunc &convention) {
+std::shared_ptr<Hook> VHookCache::get(void* pFunc, const ConvFunc &convention) {
 	auto it = m_hooked.find(pFunc);
 	if (it != m_hooked.end())
 		return it->second;
 	auto vhook = std::make_shared<VHook>((uintptr_t)pFunc, convention);
 	if (!vhook->hook())
-		return std::shared_ptr<VHook>(static_cast<VHook*>(nullptr));
+		return nullptr;
 	m_hooked.emplace(pFunc, vhook);
 	return vhook;
 }
 
+std::shared_ptr<Hook> VHookCache::find(void* pFunc) const {
+	auto it = m_hooked.find(pFunc);
+	return it != m_hooked.end() ? it->second : nullptr;
+}
+
+void VHookCache::add(void* pFunc, std::shared_ptr<Hook> hook) {
+	m_hooked.emplace(pFunc, std::move(hook));
+}
+
+void VHookCache::release(void* pFunc) {
+	auto it = m_hooked.find(pFunc);
+	if (it != m_hooked.end() && it->second.use_count() == 1)
+		m_hooked.erase(it);
+}
+
 void VHookCache::clear() {
 	m_hooked.clear();
 }
 
+std::vector<std::pair<void*, std::shared_ptr<Hook>>> VHookCache::getHooks() const {
+	return { m_hooked.begin(), m_hooked.end() };
+}
+
 void VHookCache::cleanup() {
 	if (m_hooked.empty())
 		return;
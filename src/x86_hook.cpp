@@ -1,21 +1,38 @@
 #include <dynohook/x86_hook.h>
+#include <dynohook/fork_guard.h>
+#include <dynohook/scratch_code.h>
 
 using namespace dyno;
 using namespace asmjit;
 using namespace asmjit::x86;
 using namespace std::string_literals;
 
-x86Hook::x86Hook(const ConvFunc& convention) : Hook(convention), m_scratchRegisters(Registers::ScratchList()) {
+x86Hook::x86Hook(const ConvFunc& convention) : Hook(convention) {
 }
 
 bool x86Hook::createBridge() {
 	assert(m_fnBridge == 0);
 
-	CodeHolder code;
-	code.init(m_asmjit_rt.environment(), m_asmjit_rt.cpuFeatures());
+	if (usesPrebuiltStubs())
+		return createPrebuiltBridge();
+
+	ScratchCode scratch(m_asmjit_rt);
+	CodeHolder& code = *scratch;
 	Assembler a(&code);
 
 	Label override = a.newLabel();
+	Label original = a.newLabel();
+	Label continuation = a.newLabel();
+
+	// governed hooks may be switched to pass-through
+	a.cmp(byte_ptr((uint64_t) (uintptr_t) &m_passThrough), 0);
+	a.jne(original);
+
+	// then the inline handlers, on the registers of the call
+	writeInlineHandlers(a, original, override);
+
+	// save the registers once, the return address bookkeeping and the handlers both work on top of them
+	writeSaveRegisters(a, false);
 
 	// write a redirect to the post-hook code
 	writeModifyReturnAddress(a);
@@ -30,8 +47,10 @@ bool x86Hook::createBridge() {
 	// skip trampoline if equal
 	a.je(override);
 
-	// jump to the original address (trampoline)
-	a.jmp(getAddress());
+	a.bind(original);
+
+	// jump to the original address (trampoline) through the continuation slot, see setContinuation()
+	a.jmp(dword_ptr(continuation));
 
 	// this code will be executed if a pre-hook returns Supercede
 	a.bind(override);
@@ -44,6 +63,11 @@ bool x86Hook::createBridge() {
 	else
 		a.ret();
 
+	// aligned, so it's replaced with a single store
+	a.align(AlignMode::kData, sizeof(uint32_t));
+	a.bind(continuation);
+	a.embedUInt32((uint32_t) getAddress());
+
 	// generate code
 	auto error = m_asmjit_rt.add(&m_fnBridge, &code);
 	if (error) {
@@ -52,6 +76,7 @@ bool x86Hook::createBridge() {
 	}
 
 	m_fnBridgeSize = code.codeSize();
+	m_continuation = m_fnBridge + (uintptr_t) code.labelOffsetFromBase(continuation);
 
 	return true;
 }
@@ -59,8 +84,8 @@ bool x86Hook::createBridge() {
 bool x86Hook::createPostCallback() {
 	assert(m_newRetAddr == 0);
 
-	CodeHolder code;
-	code.init(m_asmjit_rt.environment(), m_asmjit_rt.cpuFeatures());
+	ScratchCode scratch(m_asmjit_rt);
+	CodeHolder& code = *scratch;
 	Assembler a(&code);
 
 	// gets pop size + return address
@@ -70,16 +95,13 @@ bool x86Hook::createPostCallback() {
 	// that we can access the arguments again
 	a.sub(esp, popSize);
 
+	// save the registers once, the handlers and getReturnAddress both work on top of them
+	writeSaveRegisters(a, true);
+
 	// call the post-hook handler
 	writeCallHandler(a, CallbackType::Post);
 
-	// restore the previously saved registers, so any changes will be applied
-	writeRestoreRegisters(a, true);
-
-	// save scratch registers that are used by getReturnAddress
-	writeSaveScratchRegisters(a);
-
-	// get the original return address
+	// get the original return address, the stack pointer is the one setReturnAddress got
 	void* (DYNO_CDECL Hook::*getReturnAddress)(void*) = &x86Hook::getReturnAddress;
 
 	// store stack pointer in eax
@@ -92,16 +114,19 @@ bool x86Hook::createPostCallback() {
 	a.call((void*&) getReturnAddress); // +4 = 16 (aligned by 16 bytes)
 	a.add(esp, 12);
 
-	// save the original return address
-	a.push(eax);
+	// put the original return address back into the slot it was taken from
+	a.mov(dword_ptr(esp), eax);
 
-	// restore scratch registers
-	writeRestoreScratchRegisters(a);
+	// restore the previously saved registers, so any changes will be applied
+	writeRestoreRegisters(a, true);
 
 	// return to the original address
-	// add the bytes again to the stack (stack size + return address), so we
-	// don't corrupt the stack.
-	a.ret(popSize);
+	// add the bytes again to the stack (stack size), so we don't corrupt the stack.
+	popSize -= sizeof(void*);
+	if (popSize > 0)
+		a.ret(popSize);
+	else
+		a.ret();
 
 	// generate code
 	auto error = m_asmjit_rt.add(&m_newRetAddr, &code);
@@ -118,8 +143,7 @@ bool x86Hook::createPostCallback() {
 void x86Hook::writeModifyReturnAddress(Assembler& a) {
 	/// https://en.wikipedia.org/wiki/X86_calling_conventions
 
-	// save scratch registers that are used by setReturnAddress
-	writeSaveScratchRegisters(a);
+	// the bridge saved the registers already, the scratch ones are free until they are restored
 
 	// save the original return address by using the current sp as the key.
 	// this should be unique until we have returned to the original caller.
@@ -134,19 +158,59 @@ void x86Hook::writeModifyReturnAddress(Assembler& a) {
 	a.call((void*&) setReturnAddress); // +4 = 16 (aligned by 16 bytes)
 	a.add(esp, 12);
 
-	// restore scratch registers
-	writeRestoreScratchRegisters(a);
-
-	// override the return address. This is a redirect to our post-hook code
+	// the post-hook code setReturnAddress redirects the return address to
 	createPostCallback();
-	a.mov(dword_ptr(esp), m_newRetAddr);
+}
+
+uintptr_t x86Hook::createExitStub(const std::vector<uint8_t>& prefix, uint16_t retImm) {
+	ScratchCode scratch(m_asmjit_rt);
+	CodeHolder& code = *scratch;
+	Assembler a(&code);
+
+	// the instructions moved out of the ret site
+	if (!prefix.empty())
+		a.embed(prefix.data(), prefix.size());
+
+	// the stack pointer is the one setReturnAddress got, with the untouched return address on top
+	writeSaveRegisters(a, true);
+
+	// run the post-hook handlers of the returning call
+	void (DYNO_CDECL Hook::*exitHandler)(void*) = &x86Hook::exitHandler;
+
+	// store stack pointer in eax
+	a.mov(eax, esp);
+
+	// subtract 4 bytes to preserve 16-byte stack alignment for Linux
+	a.sub(esp, 4);
+	a.push(eax);
+	a.push(this);
+	a.call((void*&) exitHandler); // +4 = 16 (aligned by 16 bytes)
+	a.add(esp, 12);
+
+	writeRestoreRegisters(a, true);
+
+	// the ret of the site
+	if (retImm > 0)
+		a.ret(retImm);
+	else
+		a.ret();
+
+	uintptr_t stub = 0;
+	auto error = m_asmjit_rt.add(&stub, &code);
+	if (error) {
+		DYNO_LOG_ERR("AsmJit error: "s + DebugUtils::errorAsString(error));
+		return 0;
+	}
+
+	ForkGuard::addCode(this, stub, code.codeSize());
+
+	return stub;
 }
 
 void x86Hook::writeCallHandler(Assembler& a, CallbackType type) const {
 	ReturnAction (DYNO_CDECL Hook::*callbackHandler)(CallbackType) = &x86Hook::callbackHandler;
 
-	// save the registers so that we can access them in our handlers
-	writeSaveRegisters(a, type == CallbackType::Post);
+	// the registers were saved by the caller, so that we can access them in our handlers
 
 	// call the global hook handler
 	// subtract 4 bytes to preserve 16-byte stack alignment for Linux
@@ -157,19 +221,6 @@ void x86Hook::writeCallHandler(Assembler& a, CallbackType type) const {
 	a.add(esp, 12);
 }
 
-int32_t x86Hook::writeSaveScratchRegisters(Assembler& a) const {
-	for (const auto& reg : m_scratchRegisters) {
-		writeRegToMem(a, reg, false);
-	}
-	return 0;
-}
-
-void x86Hook::writeRestoreScratchRegisters(Assembler& a) const {
-	for (const auto& reg : m_scratchRegisters) {
-		writeMemToReg(a, reg, false);
-	}
-}
-
 void x86Hook::writeSaveRegisters(Assembler& a, bool post) const {
 	for (const auto& reg : m_registers) {
 		writeRegToMem(a, reg, post);
@@ -1,10 +1,17 @@
 #include <catch2/catch_test_macros.hpp>
 
 #include "dynohook/detours/x64_detour.h"
+#include "dynohook/fork_guard.h"
+#include "dynohook/governor.h"
+#include "dynohook/prebuilt_stubs.h"
 #include "dynohook/tests/stack_canary.h"
 #include "dynohook/tests/effect_tracker.h"
 #include "dynohook/os.h"
 
+#if DYNO_PLATFORM_LINUX
+#include <sys/wait.h>
+#endif
+
 #if DYNO_PLATFORM_WINDOWS
 #include "dynohook/conventions/x64_windows_call.h"
 #define DEFAULT_CALLCONV dyno::x64WindowsCall
@@ -26,6 +33,13 @@ DYNO_NOINLINE void hookMe1() {
     REQUIRE(var2 == 40);
 }
 
+DYNO_NOINLINE int hookMeInline(int x) {
+    volatile int y = x;
+    y *= 3;
+    y += 7;
+    return y;
+}
+
 DYNO_NOINLINE void hookMe2() {
     dyno::StackCanary canary;
     for (int i = 0; i < 10; i++) {
@@ -69,6 +83,23 @@ uint8_t hookMe6[] = {
     0xc2, 0x14, 0x00 // retn 0x14
 };
 
+// leaf with a single ret, followed by int3 padding
+uint8_t hookMe7[] = {
+    0x55, // push rbp
+    0x48, 0x89, 0xE5, // mov rbp, rsp
+    0x48, 0x89, 0xF8, // mov rax, rdi
+    0x48, 0x01, 0xF0, // add rax, rsi
+    0x48, 0x01, 0xF0, // add rax, rsi
+    0x48, 0x01, 0xF0, // add rax, rsi
+    0x48, 0x01, 0xF0, // add rax, rsi
+    0x48, 0x01, 0xF0, // add rax, rsi
+    0x48, 0x01, 0xF0, // add rax, rsi
+    0x48, 0x01, 0xF0, // add rax, rsi
+    0x5D, // pop rbp
+    0xC3, // ret
+    0xCC, 0xCC, 0xCC, 0xCC
+};
+
 dyno::EffectTracker effects;
 
 TEST_CASE("Testing x64 detours", "[x64Detour][Detour]") {
@@ -119,6 +150,473 @@ TEST_CASE("Testing x64 detours", "[x64Detour][Detour]") {
         REQUIRE(detour.unhook() == true);
     }
 
+    SECTION("Install report") {
+        dyno::StackCanary canary;
+        dyno::x64Detour detour((uintptr_t) &hookMe1, callConvVoid);
+        REQUIRE(detour.hook() == true);
+
+        const auto& report = detour.getInstallReport();
+        REQUIRE(report.success == true);
+        REQUIRE(report.resolvedAddress == (uintptr_t) &hookMe1);
+        REQUIRE(report.prologueSize >= dyno::x64Detour::getMinJmpSize());
+        REQUIRE(report.trampolineSize > 0);
+        REQUIRE(std::string(report.scheme) == dyno::x64Detour::printDetourScheme(dyno::x64Detour::VALLOC2) ||
+                std::string(report.scheme) == dyno::x64Detour::printDetourScheme(dyno::x64Detour::INPLACE) ||
+                std::string(report.scheme) == dyno::x64Detour::printDetourScheme(dyno::x64Detour::CODE_CAVE));
+        REQUIRE(report.totalNs >= report.disassemblyNs + report.bridgeNs + report.patchNs);
+        REQUIRE(detour.unhook() == true);
+    }
+
+    SECTION("Exit site patching") {
+        dyno::StackCanary canary;
+        dyno::x64Detour detour((uintptr_t) &hookMe7, callConvVoid);
+        detour.setExitSitePatching(true);
+        REQUIRE(detour.hook() == true);
+
+        // the ret and the padding behind it make room for the jmp to the exit stub
+        REQUIRE(detour.getInstallReport().exitSites == 1);
+        REQUIRE(hookMe7[29] == 0xE9);
+
+        REQUIRE(detour.unhook() == true);
+        REQUIRE(hookMe7[29] == 0xC3);
+        REQUIRE(hookMe7[30] == 0xCC);
+    }
+
+    SECTION("Exit site patching of an executed leaf") {
+        dyno::ConvFunc callConvLeaf = []{ return new DEFAULT_CALLCONV({dyno::DataType::Int64, dyno::DataType::Int64}, dyno::DataType::Int64); };
+
+        auto PostLeaf = +[](dyno::CallbackType type, dyno::IHook& hook) {
+            DYNO_UNUSED(type);
+            dyno::StackCanary canary;
+            if (hook.getReturn<int64_t>() == 1 + 7 * 2)
+                effects.peak().trigger();
+            return dyno::ReturnAction::Handled;
+        };
+
+        // same shape as hookMe7, with the argument registers of the platform
+#if DYNO_PLATFORM_WINDOWS
+        const uint8_t first = 0xC8, second = 0xD0; // rcx, rdx
+#else
+        const uint8_t first = 0xF8, second = 0xF0; // rdi, rsi
+#endif
+        const uint8_t body[] = {
+            0x55, // push rbp
+            0x48, 0x89, 0xE5, // mov rbp, rsp
+            0x48, 0x89, first, // mov rax, first
+            0x48, 0x01, second, // add rax, second
+            0x48, 0x01, second, // add rax, second
+            0x48, 0x01, second, // add rax, second
+            0x48, 0x01, second, // add rax, second
+            0x48, 0x01, second, // add rax, second
+            0x48, 0x01, second, // add rax, second
+            0x48, 0x01, second, // add rax, second
+            0x5D, // pop rbp
+            0xC3, // ret
+            0xCC, 0xCC, 0xCC, 0xCC
+        };
+
+        alignas(4096) static uint8_t leaf[4096];
+        dyno::MemAccessor accessor;
+        bool status = false;
+        accessor.mem_protect((uintptr_t) leaf, sizeof(leaf), dyno::ProtFlag::R | dyno::ProtFlag::W, status);
+        REQUIRE(status);
+        std::memcpy(leaf, body, sizeof(body));
+        accessor.mem_protect((uintptr_t) leaf, sizeof(leaf), dyno::ProtFlag::R | dyno::ProtFlag::X, status);
+        REQUIRE(status);
+
+        auto fn = (int64_t (*)(int64_t, int64_t)) (void*) leaf;
+        REQUIRE(fn(1, 2) == 15);
+
+        dyno::StackCanary canary;
+        dyno::x64Detour detour((uintptr_t) leaf, callConvLeaf);
+        detour.setExitSitePatching(true);
+        REQUIRE(detour.hook() == true);
+        REQUIRE(detour.getInstallReport().exitSites == 1);
+        detour.addCallback(dyno::CallbackType::Post, PostLeaf);
+
+        // the post callback runs in the exit stub, once per call
+        effects.push();
+        for (int i = 0; i < 3; i++)
+            REQUIRE(fn(1, 2) == 15);
+        REQUIRE(effects.pop().didExecute(3));
+        REQUIRE(detour.getStats().calls == 3);
+
+        REQUIRE(detour.unhook() == true);
+        REQUIRE(leaf[29] == 0xC3);
+
+        effects.push();
+        REQUIRE(fn(1, 2) == 15);
+        REQUIRE(effects.pop().didExecute(0));
+    }
+
+    SECTION("Inline handler") {
+        dyno::ConvFunc callConvInt = []{ return new DEFAULT_CALLCONV({dyno::DataType::Int32}, dyno::DataType::Int32); };
+
+        dyno::StackCanary canary;
+        dyno::x64Detour detour((uintptr_t) &hookMeInline, callConvInt);
+
+        // 5 returns 42 right away, everything else goes on as usual
+        REQUIRE(detour.addInlineHandler([](asmjit::x86::Assembler& a, const dyno::ArgLocations& locations) {
+            REQUIRE(locations.args.size() == 1);
+            REQUIRE(locations.args[0].reg != dyno::NONE);
+#if DYNO_PLATFORM_WINDOWS
+            a.cmp(asmjit::x86::ecx, 5);
+#else
+            a.cmp(asmjit::x86::edi, 5);
+#endif
+            a.jne(locations.next);
+            a.mov(asmjit::x86::eax, 42);
+            a.jmp(locations.supercede);
+        }) == true);
+        REQUIRE(detour.hook() == true);
+
+        // the bridge exists by now
+        REQUIRE(detour.addInlineHandler([](asmjit::x86::Assembler& a, const dyno::ArgLocations& locations) {
+            a.jmp(locations.next);
+        }) == false);
+
+        int (*volatile fn)(int) = &hookMeInline;
+        REQUIRE(fn(5) == 42);
+        REQUIRE(fn(1) == 10);
+        REQUIRE(detour.unhook() == true);
+    }
+
+    SECTION("Callback flags") {
+        dyno::ConvFunc callConvInt = []{ return new DEFAULT_CALLCONV({dyno::DataType::Int32}, dyno::DataType::Int32); };
+
+        auto PreOverride = +[](dyno::CallbackType type, dyno::IHook& hook) {
+            DYNO_UNUSED(type);
+            if (hook.getArgument<int>(0) != 2)
+                return dyno::ReturnAction::Ignored;
+
+            hook.setReturn<int>(5);
+            return dyno::ReturnAction::Override;
+        };
+
+        auto PostReturn = +[](dyno::CallbackType type, dyno::IHook& hook) {
+            DYNO_UNUSED(type);
+            if (hook.getReturn<int>() == 10)
+                effects.peak().trigger();
+            return dyno::ReturnAction::Handled;
+        };
+
+        dyno::StackCanary canary;
+        dyno::x64Detour detour((uintptr_t) &hookMeInline, callConvInt);
+        REQUIRE(detour.hook() == true);
+
+        // no handler reads the arguments after the call, only the overridden return value is kept
+        detour.addCallback(dyno::CallbackType::Pre, PreOverride, dyno::CallbackFlag::ReadArgs | dyno::CallbackFlag::WriteReturn);
+        detour.addCallback(dyno::CallbackType::Post, PostReturn, dyno::CallbackFlag::ReadReturn);
+
+        int (*volatile fn)(int) = &hookMeInline;
+        effects.push();
+        REQUIRE(fn(1) == 10);
+        REQUIRE(effects.pop().didExecute(1));
+        REQUIRE(fn(2) == 5);
+        REQUIRE(detour.unhook() == true);
+    }
+
+    SECTION("Prebuilt bridge") {
+        dyno::ConvFunc callConvInt = []{ return new DEFAULT_CALLCONV({dyno::DataType::Int32}, dyno::DataType::Int32); };
+
+        auto PreSupercede = +[](dyno::CallbackType type, dyno::IHook& hook) {
+            DYNO_UNUSED(type);
+            if (hook.getArgument<int>(0) != 3)
+                return dyno::ReturnAction::Ignored;
+
+            hook.setReturn<int>(7);
+            return dyno::ReturnAction::Supercede;
+        };
+
+        auto PostReturn = +[](dyno::CallbackType type, dyno::IHook& hook) {
+            DYNO_UNUSED(type);
+            if (hook.getReturn<int>() == 10)
+                effects.peak().trigger();
+            return dyno::ReturnAction::Handled;
+        };
+
+        dyno::StackCanary canary;
+        dyno::PrebuiltStubs::enable(true);
+        dyno::x64Detour detour((uintptr_t) &hookMeInline, callConvInt);
+        REQUIRE(detour.hook() == true);
+        dyno::PrebuiltStubs::enable(false);
+
+        detour.addCallback(dyno::CallbackType::Pre, PreSupercede);
+        detour.addCallback(dyno::CallbackType::Post, PostReturn);
+
+        int (*volatile fn)(int) = &hookMeInline;
+        effects.push();
+        REQUIRE(fn(1) == 10);
+        REQUIRE(effects.pop().didExecute(1));
+        REQUIRE(fn(3) == 7);
+
+        detour.setDispatchMode(dyno::DispatchMode::PassThrough);
+        REQUIRE(fn(3) == 16);
+        REQUIRE(detour.unhook() == true);
+    }
+
+    SECTION("Prologue cache") {
+        auto PreHook1 = +[](dyno::CallbackType type, dyno::IHook& hook) {
+            DYNO_UNUSED(type);
+            DYNO_UNUSED(hook);
+            effects.peak().trigger();
+            return dyno::ReturnAction::Handled;
+        };
+
+        dyno::StackCanary canary;
+        {
+            dyno::x64Detour detour((uintptr_t) &hookMe1, callConvVoid);
+            REQUIRE(detour.hook() == true);
+            REQUIRE(detour.unhook() == true);
+        }
+
+        // the same bytes are known by now
+        dyno::x64Detour detour((uintptr_t) &hookMe1, callConvVoid);
+        REQUIRE(detour.hook() == true);
+        REQUIRE(detour.getInstallReport().prologueCached == true);
+
+        detour.addCallback(dyno::CallbackType::Pre, PreHook1);
+
+        effects.push();
+        hookMe1();
+        REQUIRE(effects.pop().didExecute(1));
+        REQUIRE(detour.unhook() == true);
+    }
+
+    SECTION("Hook stats") {
+        auto PreHook1 = +[](dyno::CallbackType type, dyno::IHook& hook) {
+            DYNO_UNUSED(type);
+            DYNO_UNUSED(hook);
+            dyno::StackCanary canary;
+            return dyno::ReturnAction::Handled;
+        };
+
+        dyno::StackCanary canary;
+        dyno::x64Detour detour((uintptr_t) &hookMe1, callConvVoid);
+        REQUIRE(detour.hook() == true);
+        detour.addCallback(dyno::CallbackType::Pre, PreHook1);
+        detour.setLatencyTracking(true);
+
+        hookMe1();
+        hookMe1();
+
+        const auto& stats = detour.getStats();
+        REQUIRE(stats.calls == 2);
+        REQUIRE(stats.supercedes == 0);
+
+        uint64_t samples = 0;
+        for (const auto& bucket : stats.latency)
+            samples += bucket;
+        REQUIRE(samples == 2);
+        REQUIRE(detour.unhook() == true);
+    }
+
+    SECTION("Handler profiling") {
+        auto PreHook1 = +[](dyno::CallbackType type, dyno::IHook& hook) {
+            DYNO_UNUSED(type);
+            DYNO_UNUSED(hook);
+            dyno::StackCanary canary;
+            return dyno::ReturnAction::Handled;
+        };
+
+        dyno::StackCanary canary;
+        dyno::x64Detour detour((uintptr_t) &hookMe1, callConvVoid);
+        REQUIRE(detour.hook() == true);
+        detour.addCallback(dyno::CallbackType::Pre, PreHook1);
+        // also restarts the sampling of this thread, earlier sections leave it anywhere
+        detour.setHandlerProfiling(2);
+
+        hookMe1();
+        hookMe1();
+        hookMe1();
+        hookMe1();
+
+        const auto profiles = detour.getHandlerProfiles();
+        REQUIRE(profiles.size() == 1);
+        REQUIRE(profiles[0].handler == (uintptr_t) PreHook1);
+        REQUIRE(profiles[0].type == dyno::CallbackType::Pre);
+        REQUIRE(profiles[0].calls == 4);
+        REQUIRE(profiles[0].sampledCalls == 2);
+        REQUIRE(detour.unhook() == true);
+    }
+
+    SECTION("Dispatch modes") {
+        static int preCalls = 0;
+        auto PreHook1 = +[](dyno::CallbackType type, dyno::IHook& hook) {
+            DYNO_UNUSED(type);
+            DYNO_UNUSED(hook);
+            dyno::StackCanary canary;
+            preCalls++;
+            return dyno::ReturnAction::Handled;
+        };
+
+        dyno::StackCanary canary;
+        auto detour = std::make_shared<dyno::x64Detour>((uintptr_t) &hookMe1, callConvVoid);
+        REQUIRE(detour->hook() == true);
+        detour->addCallback(dyno::CallbackType::Pre, PreHook1);
+
+        preCalls = 0;
+        detour->setDispatchMode(dyno::DispatchMode::Sampled, 2);
+        for (int i = 0; i < 4; i++)
+            hookMe1();
+        REQUIRE(preCalls == 2);
+        REQUIRE(detour->getStats().calls == 4);
+
+        detour->setDispatchMode(dyno::DispatchMode::PassThrough);
+        hookMe1();
+        REQUIRE(preCalls == 2);
+        REQUIRE(detour->getStats().calls == 4);
+
+        // a budget no hook fits in, the second evaluation degrades it
+        dyno::GovernorBudget budget;
+        budget.cpuFraction = 1e-9;
+        budget.cpus = 1;
+        budget.sampleEvery = 2;
+
+        detour->setDispatchMode(dyno::DispatchMode::Full);
+        dyno::Governor governor;
+        governor.add(detour, (uintptr_t) &hookMe1);
+        REQUIRE(governor.start(budget, std::chrono::hours(1)) == true);
+        REQUIRE(detour->getHandlerProfiling() != 0);
+
+        governor.evaluate();
+        for (int i = 0; i < 4; i++)
+            hookMe1();
+        governor.evaluate();
+        REQUIRE(detour->getDispatchMode() == dyno::DispatchMode::Sampled);
+        REQUIRE(governor.getStats().degradations == 1);
+
+        governor.stop();
+        REQUIRE(detour->getDispatchMode() == dyno::DispatchMode::Full);
+        REQUIRE(detour->getHandlerProfiling() == 0);
+        REQUIRE(detour->unhook() == true);
+    }
+
+    SECTION("Caller histogram") {
+        dyno::StackCanary canary;
+        dyno::x64Detour detour((uintptr_t) &hookMe1, callConvVoid);
+        REQUIRE(detour.hook() == true);
+        detour.setCallerTracking(true);
+
+        for (int i = 0; i < 3; i++)
+            hookMe1();
+
+        const auto profiles = detour.getCallerProfiles();
+        REQUIRE(profiles.size() == 1);
+        REQUIRE(profiles[0].caller != 0);
+        REQUIRE(profiles[0].calls == 3);
+        REQUIRE(detour.unhook() == true);
+    }
+
+    SECTION("Context provider") {
+        static dyno::CallStack fiberStack;
+
+        auto PreHook1 = +[](dyno::CallbackType type, dyno::IHook& hook) {
+            DYNO_UNUSED(type);
+            dyno::StackCanary canary;
+            if (hook.getRecursionDepth() == 1 && fiberStack.depth() == 1)
+                effects.peak().trigger();
+            return dyno::ReturnAction::Handled;
+        };
+
+        dyno::StackCanary canary;
+        dyno::x64Detour detour((uintptr_t) &hookMe1, callConvVoid);
+        REQUIRE(detour.hook() == true);
+        detour.addCallback(dyno::CallbackType::Pre, PreHook1);
+        detour.setContextProvider(+[] { return &fiberStack; });
+
+        effects.push();
+        hookMe1();
+        REQUIRE(effects.pop().didExecute(1));
+        REQUIRE(fiberStack.empty());
+
+        // a frame left above the call by an abandoned inner call must not be taken for the returning one
+        static const void* owner = nullptr;
+        owner = static_cast<const dyno::Hook*>(&detour);
+
+        auto PreAbandon = +[](dyno::CallbackType type, dyno::IHook& hook) {
+            DYNO_UNUSED(type);
+            DYNO_UNUSED(hook);
+            dyno::CallFrame* stale = fiberStack.push(owner);
+            stale->stackPtr = nullptr;
+            stale->savedArgs = nullptr;
+            stale->savedReturn = nullptr;
+            stale->action = dyno::ReturnAction::Ignored;
+            stale->skipped = true;
+            return dyno::ReturnAction::Handled;
+        };
+
+        auto PostHook1 = +[](dyno::CallbackType type, dyno::IHook& hook) {
+            DYNO_UNUSED(type);
+            DYNO_UNUSED(hook);
+            effects.peak().trigger();
+            return dyno::ReturnAction::Handled;
+        };
+
+        detour.removeCallback(dyno::CallbackType::Pre, PreHook1);
+        detour.addCallback(dyno::CallbackType::Pre, PreAbandon);
+        detour.addCallback(dyno::CallbackType::Post, PostHook1);
+
+        effects.push();
+        hookMe1();
+        REQUIRE(effects.pop().didExecute(1));
+        REQUIRE(fiberStack.empty());
+
+        detour.setContextProvider(nullptr);
+        REQUIRE(detour.unhook() == true);
+    }
+
+#if DYNO_PLATFORM_LINUX
+    SECTION("Fork mode") {
+        auto PreHook1 = +[](dyno::CallbackType type, dyno::IHook& hook) {
+            DYNO_UNUSED(type);
+            DYNO_UNUSED(hook);
+            dyno::StackCanary canary;
+            return dyno::ReturnAction::Handled;
+        };
+
+        dyno::StackCanary canary;
+        REQUIRE(dyno::ForkGuard::enable() == true);
+
+        dyno::x64Detour detour((uintptr_t) &hookMe1, callConvVoid);
+        REQUIRE(detour.hook() == true);
+        detour.addCallback(dyno::CallbackType::Pre, PreHook1);
+        hookMe1();
+
+        // the child starts from zeroed counters and can still call through the sealed code
+        pid_t pid = fork();
+        REQUIRE(pid >= 0);
+        if (pid == 0) {
+            const bool fresh = detour.getStats().calls == 0;
+            hookMe1();
+
+            // the child inherits the sealed code, installs unseal it for their duration
+            dyno::x64Detour childDetour((uintptr_t) &hookMe2, callConvVoid);
+            const bool installed = childDetour.hook() && childDetour.unhook();
+            _exit(fresh && detour.getStats().calls == 1 && installed ? 0 : 1);
+        }
+
+        int status = 0;
+        REQUIRE(waitpid(pid, &status, 0) == pid);
+        REQUIRE(WIFEXITED(status));
+        REQUIRE(WEXITSTATUS(status) == 0);
+
+        REQUIRE(detour.getStats().calls == 1);
+
+        // the parent gets writable code back, the trampoline arena and the bridges are written again
+        dyno::x64Detour detour2((uintptr_t) &hookMe2, callConvVoid);
+        REQUIRE(detour2.hook() == true);
+        detour2.addCallback(dyno::CallbackType::Pre, PreHook1);
+        hookMe2();
+        REQUIRE(detour2.getStats().calls == 1);
+
+        REQUIRE(detour2.unhook() == true);
+        REQUIRE(detour.unhook() == true);
+        hookMe1();
+        REQUIRE(detour.getStats().calls == 1);
+    }
+#endif
+
 #if DYNO_PLATFORM_WINDOWS
         // In release mode win apis usually go through two levels of jmps
         /*
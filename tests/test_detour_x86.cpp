@@ -1,6 +1,7 @@
 #include <catch2/catch_test_macros.hpp>
 
 #include "dynohook/detours/x86_detour.h"
+#include "dynohook/prebuilt_stubs.h"
 #include "dynohook/tests/stack_canary.h"
 #include "dynohook/tests/effect_tracker.h"
 #include "dynohook/os.h"
@@ -135,6 +136,42 @@ TEST_CASE("Testing x86 detours", "[x86Detour][Detour]") {
         REQUIRE(detour.unhook() == true);
     }
 
+    SECTION("Prebuilt bridge") {
+        static bool supercede = false;
+        auto PreSupercede = +[](dyno::CallbackType type, dyno::IHook& hook) {
+            DYNO_UNUSED(type);
+            if (!supercede)
+                return dyno::ReturnAction::Ignored;
+
+            hook.setReturn<int>(7);
+            return dyno::ReturnAction::Supercede;
+        };
+
+        dyno::StackCanary canary;
+        dyno::PrebuiltStubs::enable(true);
+        dyno::x86Detour detour((uintptr_t) &hookMe1, callConvInt);
+        REQUIRE(detour.hook() == true);
+        dyno::PrebuiltStubs::enable(false);
+
+        detour.addCallback(dyno::CallbackType::Pre, PreSupercede);
+        detour.addCallback(dyno::CallbackType::Post, PostHook1);
+
+        supercede = false;
+        effects.push();
+        REQUIRE(hookMe1() == 2);
+        REQUIRE(effects.pop().didExecute(1));
+
+        supercede = true;
+        REQUIRE(hookMe1() == 7);
+        supercede = false;
+
+        detour.setDispatchMode(dyno::DispatchMode::PassThrough);
+        effects.push();
+        REQUIRE(hookMe1() == 2);
+        REQUIRE(effects.pop().didExecute(0));
+        REQUIRE(detour.unhook() == true);
+    }
+
     SECTION("Jmp into prologue w/ src in range") {
         dyno::x86Detour detour((uintptr_t) &hookMe2, callConvVoid);
 
@@ -229,6 +229,16 @@ TEST_CASE("Test Disassemblers x64", "[ZydisDisassembler]") {
         REQUIRE(insts.at(10).hasDisplacement());
     }
 
+    SECTION("Operands are formatted on demand") {
+        REQUIRE(Instructions[0].getFullName() == "mov qword ptr ss:[rsp+0x08], rbx");
+        REQUIRE(Instructions[3].getFullName() == "sub rsp, 0x20");
+
+        // copies keep their bytes, they format the same
+        const dyno::Instruction copy = Instructions[0];
+        REQUIRE(copy.getFullName() == Instructions[0].getFullName());
+        REQUIRE(copy.getBytes().size() == 5);
+    }
+
     SECTION("Test garbage instructions") {
         char randomBuf[500];
         for (char& i : randomBuf)
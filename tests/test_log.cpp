@@ -0,0 +1,126 @@
+#include <catch2/catch_test_macros.hpp>
+
+#include "dynohook/log.h"
+
+#include <string>
+#include <vector>
+
+namespace {
+    // everything written to the stream so far, one entry per line
+    std::vector<std::string> readLines(std::FILE* file) {
+        std::fflush(file);
+        std::rewind(file);
+
+        std::vector<std::string> lines;
+        std::string line;
+        for (int c = std::fgetc(file); c != EOF; c = std::fgetc(file)) {
+            if (c == '\n') {
+                lines.push_back(line);
+                line.clear();
+            } else {
+                line += (char) c;
+            }
+        }
+        return lines;
+    }
+}
+
+TEST_CASE("Testing the async logger", "[AsyncLogger][Log]") {
+    std::FILE* file = std::tmpfile();
+    REQUIRE(file);
+
+    SECTION("Messages are written in order") {
+        {
+            dyno::AsyncLogger logger(128, file);
+            for (int i = 0; i < 100; i++)
+                logger.log(std::to_string(i), dyno::ErrorLevel::INFO);
+            logger.flush();
+
+            REQUIRE(logger.getWrittenCount() == 100);
+            REQUIRE(logger.getDroppedCount() == 0);
+        }
+
+        const auto lines = readLines(file);
+        REQUIRE(lines.size() == 100);
+        for (int i = 0; i < 100; i++)
+            REQUIRE(lines[i] == "[+] Info: " + std::to_string(i));
+    }
+
+    SECTION("Ring wraps around") {
+        {
+            dyno::AsyncLogger logger(4, file);
+            for (int round = 0; round < 5; round++) {
+                for (int i = 0; i < 3; i++)
+                    logger.log(std::to_string(round * 3 + i), dyno::ErrorLevel::WARN);
+                logger.flush();
+            }
+
+            REQUIRE(logger.getWrittenCount() == 15);
+            REQUIRE(logger.getDroppedCount() == 0);
+        }
+
+        const auto lines = readLines(file);
+        REQUIRE(lines.size() == 15);
+        for (int i = 0; i < 15; i++)
+            REQUIRE(lines[i] == "[!] Warn: " + std::to_string(i));
+    }
+
+    SECTION("Full ring drops and long messages are truncated") {
+        {
+            // nothing is written before start(), the ring fills up
+            dyno::AsyncLogger logger(4, file, std::chrono::milliseconds(10), false);
+
+            logger.log(std::string(1000, 'x'), dyno::ErrorLevel::ERR);
+            for (int i = 1; i < 10; i++)
+                logger.log(std::to_string(i), dyno::ErrorLevel::ERR);
+
+            REQUIRE(logger.getDroppedCount() == 6);
+            REQUIRE(logger.getTruncatedCount() == 1);
+            REQUIRE(logger.getWrittenCount() == 0);
+
+            logger.start();
+            logger.flush();
+            REQUIRE(logger.getWrittenCount() == 4);
+        }
+
+        const auto lines = readLines(file);
+        REQUIRE(lines.size() == 4);
+        REQUIRE(lines[0].size() < 1000);
+        REQUIRE(lines[0].rfind("[!] Error: xxx", 0) == 0);
+        REQUIRE(lines[3] == "[!] Error: 3");
+    }
+
+    SECTION("Flush wakes the background thread") {
+        {
+            // would sleep for an hour if nothing woke it
+            dyno::AsyncLogger logger(64, file, std::chrono::hours(1));
+            logger.log("first", dyno::ErrorLevel::INFO);
+            logger.flush();
+            logger.log("second", dyno::ErrorLevel::INFO);
+            logger.flush();
+
+            REQUIRE(logger.getWrittenCount() == 2);
+        }
+
+        const auto lines = readLines(file);
+        REQUIRE(lines.size() == 2);
+        REQUIRE(lines[1] == "[+] Info: second");
+    }
+
+    SECTION("Destructor drains the ring") {
+        {
+            // the destructor wakes the background thread instead of waiting for the interval
+            dyno::AsyncLogger logger(64, file, std::chrono::hours(1));
+            for (int i = 0; i < 50; i++)
+                logger.log(std::to_string(i), dyno::ErrorLevel::INFO);
+            logger.setLogLevel(dyno::ErrorLevel::WARN);
+            logger.log("filtered", dyno::ErrorLevel::INFO);
+        }
+
+        const auto lines = readLines(file);
+        REQUIRE(lines.size() == 50);
+        REQUIRE(lines.back() == "[+] Info: 49");
+    }
+
+    std::fclose(file);
+}
\ No newline at end of file
@@ -0,0 +1,191 @@
+#include <catch2/catch_test_macros.hpp>
+
+#include "dynohook/detours/x64_detour.h"
+#include "dynohook/stats_exporter.h"
+#include "dynohook/stats_layout.h"
+#include "dynohook/tests/stack_canary.h"
+#include "dynohook/os.h"
+
+#if DYNO_PLATFORM_LINUX
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+#if DYNO_PLATFORM_WINDOWS
+#include "dynohook/conventions/x64_windows_call.h"
+#define DEFAULT_CALLCONV dyno::x64WindowsCall
+#else
+#include "dynohook/conventions/x64_systemV_call.h"
+#define DEFAULT_CALLCONV dyno::x64SystemVcall
+#endif
+
+DYNO_NOINLINE int exportMe1(int a) {
+    dyno::StackCanary canary;
+    volatile int var = a;
+    var += 5;
+    return var;
+}
+
+DYNO_NOINLINE int exportMe2(int a) {
+    dyno::StackCanary canary;
+    volatile int var = a;
+    var *= 7;
+    return var;
+}
+
+#if DYNO_PLATFORM_LINUX
+namespace {
+    // maps the segment the way an out of process reader does, read only through the path
+    struct SegmentReader {
+        explicit SegmentReader(const std::string& path) {
+            const int fd = open(path.c_str(), O_RDONLY);
+            if (fd == -1)
+                return;
+
+            struct stat st{};
+            if (fstat(fd, &st) == 0 && st.st_size > 0) {
+                void* memory = mmap(nullptr, (size_t) st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+                if (memory != MAP_FAILED) {
+                    base = (const uint8_t*) memory;
+                    size = (size_t) st.st_size;
+                }
+            }
+            close(fd);
+        }
+
+        ~SegmentReader() {
+            if (base)
+                munmap((void*) base, size);
+        }
+
+        const dyno::shm::Header& header() const {
+            return *(const dyno::shm::Header*) base;
+        }
+
+        const dyno::shm::Entry& entry(size_t slot) const {
+            return *(const dyno::shm::Entry*) (base + header().headerSize + slot * header().entrySize);
+        }
+
+        // snapshot of the entry publishing the given address, false if there is none
+        bool find(uintptr_t address, dyno::shm::Snapshot& out) const {
+            const uint32_t count = header().count.load(std::memory_order_acquire);
+            for (uint32_t i = 0; i < count; i++) {
+                if (dyno::shm::readEntry(entry(i), out) && out.address == address)
+                    return true;
+            }
+            return false;
+        }
+
+        const uint8_t* base{ nullptr };
+        size_t size{ 0 };
+    };
+}
+
+TEST_CASE("Testing stats export", "[StatsExporter][Detour]") {
+    dyno::ConvFunc callConvInt = []{ return new DEFAULT_CALLCONV({dyno::DataType::Int32}, dyno::DataType::Int32); };
+
+    auto PreHook = +[](dyno::CallbackType type, dyno::IHook& hook) {
+        DYNO_UNUSED(type);
+        DYNO_UNUSED(hook);
+        dyno::StackCanary canary;
+        return dyno::ReturnAction::Handled;
+    };
+
+    SECTION("Segment is readable from outside") {
+        dyno::StackCanary canary;
+        auto detour1 = std::make_shared<dyno::x64Detour>((uintptr_t) &exportMe1, callConvInt);
+        REQUIRE(detour1->hook() == true);
+        detour1->addCallback(dyno::CallbackType::Pre, PreHook);
+
+        dyno::StatsExporter exporter;
+        exporter.add(detour1, (uintptr_t) &exportMe1, &detour1->getInstallReport());
+
+        // the background thread never runs in between, every publish is explicit
+        REQUIRE(exporter.start("", std::chrono::hours(1), 8) == true);
+        REQUIRE(exporter.isRunning());
+
+        SegmentReader reader(exporter.getPath());
+        REQUIRE(reader.base != nullptr);
+
+        // layout
+        const auto& header = reader.header();
+        REQUIRE(header.magic == dyno::shm::kMagic);
+        REQUIRE(header.version == dyno::shm::kVersion);
+        REQUIRE(header.entrySize == sizeof(dyno::shm::Entry));
+        REQUIRE(header.headerSize % alignof(dyno::shm::Entry) == 0);
+        REQUIRE(header.capacity == 8);
+        REQUIRE(header.pid == (uint64_t) getpid());
+        REQUIRE(reader.size >= header.headerSize + header.capacity * header.entrySize);
+        REQUIRE(header.count.load() == 1);
+
+        dyno::shm::Snapshot snapshot{};
+        REQUIRE(reader.find((uintptr_t) &exportMe1, snapshot));
+        REQUIRE(snapshot.calls == 0);
+        REQUIRE(snapshot.prologueSize == detour1->getInstallReport().prologueSize);
+        REQUIRE(std::string(snapshot.scheme) == detour1->getInstallReport().scheme);
+
+        // counters after calls
+        const uint64_t generation = header.generation.load();
+        for (int i = 0; i < 3; i++)
+            REQUIRE(exportMe1(i) == i + 5);
+        exporter.publish();
+        REQUIRE(header.generation.load() > generation);
+
+        REQUIRE(reader.find((uintptr_t) &exportMe1, snapshot));
+        REQUIRE(snapshot.calls == 3);
+        REQUIRE(snapshot.mode == (uint8_t) detour1->getMode());
+
+        uint64_t latencySamples = 0;
+        for (size_t i = 0; i < dyno::shm::kLatencyBuckets; i++)
+            latencySamples += snapshot.latency[i];
+        REQUIRE(latencySamples == 3);
+
+        // a hook added while running gets the next entry
+        auto detour2 = std::make_shared<dyno::x64Detour>((uintptr_t) &exportMe2, callConvInt);
+        REQUIRE(detour2->hook() == true);
+        detour2->addCallback(dyno::CallbackType::Pre, PreHook);
+        exporter.add(detour2, (uintptr_t) &exportMe2, &detour2->getInstallReport());
+        REQUIRE(exportMe2(2) == 14);
+        exporter.publish();
+
+        REQUIRE(header.count.load() == 2);
+        REQUIRE(reader.find((uintptr_t) &exportMe2, snapshot));
+        REQUIRE(snapshot.calls == 1);
+
+        // a destroyed hook releases its entry, the other one is left untouched
+        REQUIRE(detour1->unhook() == true);
+        detour1.reset();
+        exporter.publish();
+
+        REQUIRE_FALSE(reader.find((uintptr_t) &exportMe1, snapshot));
+        REQUIRE(reader.find((uintptr_t) &exportMe2, snapshot));
+        REQUIRE(snapshot.calls == 1);
+        REQUIRE(exportMe1(1) == 6);
+
+        exporter.stop();
+        REQUIRE_FALSE(exporter.isRunning());
+        REQUIRE(detour2->unhook() == true);
+    }
+
+    SECTION("Sequence lock rejects an entry being written") {
+        alignas(dyno::shm::Entry) uint8_t storage[sizeof(dyno::shm::Entry)]{};
+        auto& entry = *new (storage) dyno::shm::Entry{};
+        entry.address = 0x1234;
+        entry.calls = 42;
+
+        dyno::shm::Snapshot snapshot{};
+        REQUIRE(dyno::shm::readEntry(entry, snapshot));
+        REQUIRE(snapshot.address == 0x1234);
+        REQUIRE(snapshot.calls == 42);
+
+        // odd sequence, the writer is in the middle of an update
+        entry.sequence.store(1);
+        REQUIRE_FALSE(dyno::shm::readEntry(entry, snapshot, 4));
+
+        entry.sequence.store(2);
+        REQUIRE(dyno::shm::readEntry(entry, snapshot));
+    }
+}
+#endif
\ No newline at end of file
@@ -1,6 +1,8 @@
 #include <catch2/catch_test_macros.hpp>
 
 #include "dynohook/virtuals/vtable.h"
+#include "dynohook/virtuals/func_slot.h"
+#include "dynohook/detours/nat_detour.h"
 #include "dynohook/tests/stack_canary.h"
 #include "dynohook/tests/effect_tracker.h"
 #include "dynohook/os.h"
@@ -123,6 +125,105 @@ TEST_CASE("VTableSwap tests", "[VTableSwap]") {
         REQUIRE(table.unhook(uint16_t(0u)));
     }
 
+    SECTION("Verify function slot hook") {
+        dyno::ConvFunc callConvInt = []{ return new DEFAULT_CALLCONV({}, dyno::DataType::Int32); };
+
+        auto PreNoParamVirt = +[](dyno::CallbackType type, dyno::IHook& hook) {
+            DYNO_UNUSED(type);
+            DYNO_UNUSED(hook);
+            dyno::StackCanary canary;
+            vTblSwapEffects.peak().trigger();
+            return dyno::ReturnAction::Handled;
+        };
+
+        typedef int(DYNO_THISCALL *NoParamVirt)(void*);
+
+        dyno::StackCanary canary;
+        void** vtable = *(void***) ClassToHook.get();
+        void* ops[1] = { vtable[0] };
+        {
+            dyno::FuncSlot slot(&ops[0], cache);
+            auto hook = slot.hook(callConvInt);
+            REQUIRE(hook);
+            REQUIRE(ops[0] == (void*) hook->getBridge());
+            hook->addCallback(dyno::CallbackType::Pre, PreNoParamVirt);
+
+            vTblSwapEffects.push();
+            REQUIRE(((NoParamVirt) ops[0])(ClassToHook.get()) == 4);
+            REQUIRE(vTblSwapEffects.pop().didExecute(1));
+            REQUIRE(slot.unhook());
+        }
+        REQUIRE(ops[0] == vtable[0]);
+    }
+
+    SECTION("Function slot in executable memory") {
+        dyno::ConvFunc callConvInt = []{ return new DEFAULT_CALLCONV({}, dyno::DataType::Int32); };
+
+        typedef int(DYNO_THISCALL *NoParamVirt)(void*);
+
+        // like a table of function pointers in a code section
+        alignas(4096) static void* table[4096 / sizeof(void*)];
+        void** vtable = *(void***) ClassToHook.get();
+        table[0] = vtable[0];
+
+        dyno::MemAccessor accessor;
+        bool status = false;
+        accessor.mem_protect((uintptr_t) table, sizeof(table), dyno::ProtFlag::R | dyno::ProtFlag::X, status);
+        REQUIRE(status);
+
+        {
+            dyno::FuncSlot slot(&table[0], cache);
+            auto hook = slot.hook(callConvInt);
+            REQUIRE(hook);
+            REQUIRE(table[0] == (void*) hook->getBridge());
+            REQUIRE(accessor.mem_query((uintptr_t) table) == (dyno::ProtFlag::R | dyno::ProtFlag::X));
+            REQUIRE(((NoParamVirt) table[0])(ClassToHook.get()) == 4);
+            REQUIRE(slot.unhook());
+        }
+        REQUIRE(table[0] == vtable[0]);
+        REQUIRE(accessor.mem_query((uintptr_t) table) == (dyno::ProtFlag::R | dyno::ProtFlag::X));
+
+        accessor.mem_protect((uintptr_t) table, sizeof(table), dyno::ProtFlag::R | dyno::ProtFlag::W, status);
+    }
+
+    SECTION("Detour shares the vtable bridge") {
+        dyno::ConvFunc callConvInt = []{ return new DEFAULT_CALLCONV({}, dyno::DataType::Int32); };
+
+        auto PreNoParamVirt2 = +[](dyno::CallbackType type, dyno::IHook& hook) {
+            DYNO_UNUSED(type);
+            DYNO_UNUSED(hook);
+            dyno::StackCanary canary;
+            vTblSwapEffects.peak().trigger();
+            return dyno::ReturnAction::Handled;
+        };
+
+        typedef int(DYNO_THISCALL *NoParamVirt)(void*);
+
+        dyno::StackCanary canary;
+        void** vtable = *(void***) ClassToHook.get();
+        auto noParamVirt2 = (NoParamVirt) vtable[1];
+
+        auto hook = table.hook(uint16_t(1u), callConvInt);
+        REQUIRE(hook);
+        hook->addCallback(dyno::CallbackType::Pre, PreNoParamVirt2);
+
+        auto detour = std::make_shared<dyno::NatDetour>((uintptr_t) noParamVirt2, callConvInt);
+        detour->setDispatcher(hook);
+        REQUIRE(detour->hook() == true);
+
+        // one dispatch per call, whichever way the function is entered
+        vTblSwapEffects.push();
+        REQUIRE(((NoParamVirt) vtable[1])(ClassToHook.get()) == 7);
+        REQUIRE(vTblSwapEffects.pop().didExecute(1));
+
+        vTblSwapEffects.push();
+        REQUIRE(noParamVirt2(ClassToHook.get()) == 7);
+        REQUIRE(vTblSwapEffects.pop().didExecute(1));
+
+        REQUIRE(detour->unhook() == true);
+        REQUIRE(table.unhook(uint16_t(1u)));
+    }
+
     SECTION("Verify multiple callbacks") {
         dyno::ConvFunc callConvFloat = []{
 #if DYNO_ARCH_X86 == 64
@@ -181,6 +282,24 @@ TEST_CASE("VTableSwap tests", "[VTableSwap]") {
             REQUIRE(arg5 == "test");
             REQUIRE(arg6 == 4.0f);
 
+            // the bulk lookups see the same arguments
+            auto args = hook.getArgs();
+            REQUIRE(args.size() == 8);
+            auto [self, a, b, c] = args.as<VirtualTest*, int, float, double>();
+            REQUIRE(self == arg0);
+            REQUIRE(a == arg1);
+            REQUIRE(b == arg2);
+            REQUIRE(c == arg3);
+            REQUIRE(args.get<float>(6) == arg6);
+            REQUIRE(args.get<uintptr_t>(7) == arg7);
+
+            uint8_t packed[256];
+            size_t packedSize = hook.getArguments(packed, sizeof(packed));
+            REQUIRE(packedSize > 0);
+            REQUIRE(hook.getArguments(packed, packedSize - 1) == 0);
+            REQUIRE(hook.setArguments(packed, packedSize) == true);
+            REQUIRE(hook.getArgument<float>(6) == arg6);
+
             std::cout << "PreMultParamVirt 3 Called!" << std::endl;
             vTblSwapEffects.peak().trigger();
             return dyno::ReturnAction::Handled;
@@ -0,0 +1,82 @@
+#include <catch2/catch_test_macros.hpp>
+
+#include "dynohook/detours/x64_detour.h"
+#include "dynohook/detours/watchdog.h"
+#include "dynohook/mem_protector.h"
+#include "dynohook/tests/stack_canary.h"
+#include "dynohook/tests/effect_tracker.h"
+#include "dynohook/os.h"
+
+#if DYNO_PLATFORM_WINDOWS
+#include "dynohook/conventions/x64_windows_call.h"
+#define DEFAULT_CALLCONV dyno::x64WindowsCall
+#else
+#include "dynohook/conventions/x64_systemV_call.h"
+#define DEFAULT_CALLCONV dyno::x64SystemVcall
+#endif
+
+DYNO_NOINLINE int watchMe(int a) {
+    dyno::StackCanary canary;
+    volatile int var = a;
+    var *= 3;
+    std::cout << var << std::endl;
+    return var;
+}
+
+dyno::EffectTracker watchdogEffects;
+
+TEST_CASE("Testing detour watchdog", "[Watchdog][Detour]") {
+    dyno::ConvFunc callConvInt = []{ return new DEFAULT_CALLCONV({dyno::DataType::Int32}, dyno::DataType::Int32); };
+
+    auto PreHook = +[](dyno::CallbackType type, dyno::IHook& hook) {
+        DYNO_UNUSED(type);
+        DYNO_UNUSED(hook);
+        dyno::StackCanary canary;
+        watchdogEffects.peak().trigger();
+        return dyno::ReturnAction::Handled;
+    };
+
+    SECTION("Intact hook is left alone") {
+        auto detour = std::make_shared<dyno::x64Detour>((uintptr_t) &watchMe, callConvInt);
+        REQUIRE(detour->hook() == true);
+
+        dyno::Watchdog watchdog;
+        watchdog.add(detour);
+        REQUIRE(watchdog.sweep() == 0);
+
+        auto stats = watchdog.getStats();
+        REQUIRE(stats.sweeps == 1);
+        REQUIRE(stats.sitesChecked > 0);
+        REQUIRE(stats.mismatches == 0);
+
+        watchdog.remove(detour.get());
+        REQUIRE(detour->unhook() == true);
+    }
+
+    SECTION("Overwritten hook is restored") {
+        auto detour = std::make_shared<dyno::x64Detour>((uintptr_t) &watchMe, callConvInt);
+        REQUIRE(detour->hook() == true);
+        detour->addCallback(dyno::CallbackType::Pre, PreHook);
+
+        dyno::Watchdog watchdog;
+        watchdog.add(detour);
+
+        // simulate a third party restoring the original prologue
+        const auto patch = detour->getPatchInsts();
+        {
+            dyno::MemProtector prot((uintptr_t) &watchMe, 1, dyno::ProtFlag::RWX, *detour);
+            *(volatile uint8_t*) &watchMe = 0xCC;
+        }
+
+        REQUIRE(watchdog.sweep() == 1);
+        REQUIRE(watchdog.getStats().repairs == 1);
+        REQUIRE(*(uint8_t*) &watchMe == patch.front().getBytes().front());
+
+        watchdogEffects.push();
+        REQUIRE(watchMe(2) == 6);
+        REQUIRE(watchdogEffects.pop().didExecute(1));
+
+        watchdog.remove(detour.get());
+        REQUIRE(detour->unhook() == true);
+    }
+}
\ No newline at end of file
@@ -0,0 +1,191 @@
+// Live view of the hook counters published by StatsExporter.
+//
+//   dynohook_top <segment> [-n count] [-i milliseconds] [--once]
+//
+// <segment> is the path returned by IHookManager::getStatsExportPath(),
+// e.g. /dev/shm/dynohook or /proc/<pid>/fd/<fd> for anonymous segments.
+
+#include <dynohook/stats_layout.h>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <chrono>
+#include <cinttypes>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+namespace {
+	struct Row {
+		dyno::shm::Snapshot entry;
+		double rate;
+	};
+
+	const char* modeName(uint8_t mode) {
+		// mirrors dyno::HookMode
+		static const char* names[] = { "unknown", "detour", "veh", "vtable", "iat", "eat" };
+		return mode < sizeof(names) / sizeof(names[0]) ? names[mode] : "?";
+	}
+
+	std::string formatNs(uint64_t ns) {
+		char buffer[32];
+		if (ns < 1000)
+			std::snprintf(buffer, sizeof(buffer), "%" PRIu64 "ns", ns);
+		else if (ns < 1000 * 1000)
+			std::snprintf(buffer, sizeof(buffer), "%.1fus", (double) ns / 1e3);
+		else if (ns < 1000 * 1000 * 1000)
+			std::snprintf(buffer, sizeof(buffer), "%.1fms", (double) ns / 1e6);
+		else
+			std::snprintf(buffer, sizeof(buffer), "%.1fs", (double) ns / 1e9);
+		return buffer;
+	}
+
+	// upper bound of the bucket containing the given percentile, "-" without samples
+	std::string percentile(const dyno::shm::Snapshot& entry, double p) {
+		uint64_t total = 0;
+		for (uint64_t count : entry.latency)
+			total += count;
+		if (total == 0)
+			return "-";
+
+		const auto target = (uint64_t) ((double) total * p);
+		uint64_t seen = 0;
+		for (size_t i = 0; i < dyno::shm::kLatencyBuckets; i++) {
+			seen += entry.latency[i];
+			if (seen > target)
+				return (i == dyno::shm::kLatencyBuckets - 1 ? ">" : "<") + formatNs(1ull << i);
+		}
+		return "-";
+	}
+
+	void usage(const char* self) {
+		std::fprintf(stderr, "usage: %s <segment> [-n count] [-i milliseconds] [--once]\n", self);
+	}
+}
+
+int main(int argc, char* argv[]) {
+	const char* path = nullptr;
+	size_t top = 20;
+	int intervalMs = 1000;
+	bool once = false;
+
+	for (int i = 1; i < argc; i++) {
+		if (!std::strcmp(argv[i], "-n") && i + 1 < argc) {
+			top = (size_t) std::strtoul(argv[++i], nullptr, 10);
+		} else if (!std::strcmp(argv[i], "-i") && i + 1 < argc) {
+			intervalMs = std::max(1, std::atoi(argv[++i]));
+		} else if (!std::strcmp(argv[i], "--once")) {
+			once = true;
+		} else if (!path && argv[i][0] != '-') {
+			path = argv[i];
+		} else {
+			usage(argv[0]);
+			return 1;
+		}
+	}
+
+	if (!path) {
+		usage(argv[0]);
+		return 1;
+	}
+
+	int fd = open(path, O_RDONLY | O_CLOEXEC);
+	if (fd == -1) {
+		std::fprintf(stderr, "failed to open %s: %s\n", path, std::strerror(errno));
+		return 1;
+	}
+
+	struct stat info{};
+	if (fstat(fd, &info) != 0 || (size_t) info.st_size < sizeof(dyno::shm::Header)) {
+		std::fprintf(stderr, "%s is not a stats segment\n", path);
+		close(fd);
+		return 1;
+	}
+
+	const auto size = (size_t) info.st_size;
+	void* memory = mmap(nullptr, size, PROT_READ, MAP_SHARED, fd, 0);
+	close(fd);
+	if (memory == MAP_FAILED) {
+		std::fprintf(stderr, "failed to map %s: %s\n", path, std::strerror(errno));
+		return 1;
+	}
+
+	const auto* header = (const dyno::shm::Header*) memory;
+	if (header->magic != dyno::shm::kMagic || header->version != dyno::shm::kVersion || header->entrySize != sizeof(dyno::shm::Entry) ||
+		header->headerSize + (size_t) header->capacity * header->entrySize > size) {
+		std::fprintf(stderr, "%s has an unsupported layout (version %u)\n", path, header->version);
+		munmap(memory, size);
+		return 1;
+	}
+
+	const auto* entries = (const dyno::shm::Entry*) ((const uint8_t*) memory + header->headerSize);
+
+	std::unordered_map<uint64_t, uint64_t> previousCalls;
+	auto previousTime = std::chrono::steady_clock::now();
+	std::vector<Row> rows;
+
+	while (true) {
+		const auto now = std::chrono::steady_clock::now();
+		const double elapsed = std::chrono::duration<double>(now - previousTime).count();
+		previousTime = now;
+
+		rows.clear();
+		uint64_t skipped = 0;
+		const uint32_t count = std::min(header->count.load(std::memory_order_acquire), header->capacity);
+		for (uint32_t i = 0; i < count; i++) {
+			Row row{};
+			if (!dyno::shm::readEntry(entries[i], row.entry)) {
+				skipped++;
+				continue;
+			}
+			if (row.entry.address == 0)
+				continue;
+
+			auto it = previousCalls.find(row.entry.address);
+			if (it != previousCalls.end() && elapsed > 0 && row.entry.calls >= it->second)
+				row.rate = (double) (row.entry.calls - it->second) / elapsed;
+			previousCalls[row.entry.address] = row.entry.calls;
+			rows.push_back(row);
+		}
+
+		std::sort(rows.begin(), rows.end(), [](const Row& a, const Row& b) {
+			return a.rate != b.rate ? a.rate > b.rate : a.entry.calls > b.entry.calls;
+		});
+
+		if (!once)
+			std::printf("\033[H\033[2J");
+
+		std::printf("pid %" PRIu64 "  hooks %zu  generation %" PRIu64 "%s\n\n", header->pid, rows.size(),
+			header->generation.load(std::memory_order_relaxed), skipped ? "  (some entries busy)" : "");
+		std::printf("%-18s %-7s %14s %12s %10s %10s %9s %9s %-12s %5s %9s\n",
+			"ADDRESS", "MODE", "CALLS", "CALLS/s", "OVERRIDE", "SUPERCEDE", "P50", "P99", "SCHEME", "PROL", "INSTALL");
+
+		for (size_t i = 0; i < rows.size() && i < top; i++) {
+			const auto& e = rows[i].entry;
+			char scheme[dyno::shm::kSchemeSize + 1]{};
+			std::memcpy(scheme, e.scheme, dyno::shm::kSchemeSize);
+
+			std::printf("0x%016" PRIx64 " %-7s %14" PRIu64 " %12.0f %10" PRIu64 " %10" PRIu64 " %9s %9s %-12s %5u %9s\n",
+				e.address, modeName(e.mode), e.calls, rows[i].rate, e.overrides, e.supercedes,
+				percentile(e, 0.5).c_str(), percentile(e, 0.99).c_str(), scheme[0] ? scheme : "-",
+				(unsigned) e.prologueSize, e.installNs ? formatNs(e.installNs).c_str() : "-");
+		}
+		std::fflush(stdout);
+
+		if (once)
+			break;
+
+		std::this_thread::sleep_for(std::chrono::milliseconds(intervalMs));
+	}
+
+	munmap(memory, size);
+	return 0;
+}
\ No newline at end of file